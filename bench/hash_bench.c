@@ -0,0 +1,505 @@
+/*
+ * impd4e - a small network probe which allows to monitor and sample datagrams
+ * from the network based on hash-based packet selection.
+ *
+ * Copyright (c) 2011
+ *
+ * Fraunhofer FOKUS
+ * www.fokus.fraunhofer.de
+ *
+ * in cooperation with
+ *
+ * Technical University Berlin
+ * www.av.tu-berlin.de
+ *
+ * authors:
+ * Ramon Masek <ramon.masek@fokus.fraunhofer.de>
+ * Christian Henke <c.henke@tu-berlin.de>
+ * Carsten Schmoll <carsten.schmoll@fokus.fraunhofer.de>
+ *
+ * For questions/comments contact packettracking@fokus.fraunhofer.de
+ *
+ * This program is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software Foundation;
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * micro benchmark of the selection and hash functions
+ *
+ * Every hash function is run with every selection function over a mix
+ * of synthetic IPv4/IPv6 packets (or the IP packets of a pcap file) the
+ * same way handle_ip_packet() does it. The tool reports ns per packet,
+ * cycles per hashed byte and the share of selected packets for the
+ * given selection range next to the expected share. With -u the share is
+ * measured for many seeds instead, to compare the uniformity.
+ *
+ * Before measuring, the hash values over a fixed synthetic packet set are
+ * checked against golden values, for the scattered, the gathered and the
+ * batch hash input; a mismatch makes the tool exit with 1. Golden values
+ * have to stay unchanged: other probes select by the same hash values.
+ *
+ * usage: impd4e_bench [-r <pcap file>] [-n <packets>] [-l <loops>]
+ *                     [-m <min>] [-M <max>] [-k <seed>] [-u <seeds>] [-g]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <netinet/in.h>
+
+#include <pcap.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "logger.h"
+#include "constants.h"
+
+#include "hash.h"
+#include "hash_batch.h"
+
+// -----------------------------------------------------------------------------
+// Structures, Typedefs
+// -----------------------------------------------------------------------------
+
+#define BENCH_SNAPLEN  1600
+#define BENCH_PACKETS  4096
+// size of the fixed packet set of the golden values
+#define GOLDEN_PACKETS 1024
+
+typedef struct bench_hash_s {
+   char*             name;
+   hashFunction      function;
+} bench_hash_t;
+
+typedef struct bench_selection_s {
+   char*             name;
+   selectionFunction function;
+   char*             range;   // offset list (-S) of the measurement
+} bench_selection_t;
+
+typedef struct packet_set_s {
+   packet_t*         packet;
+   uint32_t          count;
+} packet_set_t;
+
+// -----------------------------------------------------------------------------
+// Variables
+// -----------------------------------------------------------------------------
+
+static bench_hash_t hashes[] = {
+     { HASH_FUNCTION_BOB,   calcHashValue_BOB }
+   , { HASH_FUNCTION_TWMX,  calcHashValue_TWMXRSHash }
+   , { HASH_FUNCTION_HSIEH, calcHashValue_Hsieh }
+   , { HASH_FUNCTION_OAAT,  calcHashValue_OAAT }
+   , { HASH_FUNCTION_SBOX,  calcHashValue_SBOX }
+   , { HASH_FUNCTION_SBOX64, calcHashValue_SBOX64 }
+};
+#define HASHES (sizeof(hashes)/sizeof(bench_hash_t))
+
+static bench_selection_t selections[] = {
+     { HASH_INPUT_REC8,    copyFields_Rec,            "" }
+   , { HASH_INPUT_IP,      copyFields_Only_Net,       "" }
+   , { HASH_INPUT_IPTP,    copyFields_U_TCP_and_Net,  "" }
+   , { HASH_INPUT_PACKET,  copyFields_Packet,         "" }
+   , { HASH_INPUT_RAW,     copyFields_Raw,            "" }
+   , { HASH_INPUT_LAST,    copyFields_Last,           "20:20" } // the last 20 bytes
+   , { HASH_INPUT_LINK,    copyFields_Link,           "" }
+   , { HASH_INPUT_NET,     copyFields_Net,            "" }
+   , { HASH_INPUT_TRANS,   copyFields_Trans,          "" }
+   , { HASH_INPUT_PAYLOAD, copyFields_Payload,        "" }
+};
+#define SELECTIONS (sizeof(selections)/sizeof(bench_selection_t))
+
+// hash values over the golden packet set folded into one value,
+// indexed [hash][selection] like the tables above
+static const uint32_t golden[HASHES][SELECTIONS] = {
+#include "hash_golden.h"
+};
+
+static uint32_t rnd_state = 0x1e55ed;
+
+// -----------------------------------------------------------------------------
+// Functions
+// -----------------------------------------------------------------------------
+
+// xorshift; rand() differs between libc versions, the golden set must not
+static uint32_t rnd() {
+   rnd_state ^= rnd_state << 13;
+   rnd_state ^= rnd_state >> 17;
+   rnd_state ^= rnd_state << 5;
+   return rnd_state;
+}
+
+static uint64_t now_ns() {
+   struct timespec ts;
+   clock_gettime( CLOCK_MONOTONIC, &ts );
+   return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t now_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+   return __rdtsc();
+#else
+   return 0;
+#endif
+}
+
+/** IMIX like mix of raw IP packets: TCP, UDP and ICMP over IPv4 and IPv6 */
+static void synthetic_packet( packet_t* p ) {
+   static const uint32_t sizes[12] = { 64, 64, 64, 64, 64, 64, 64
+                                     , 576, 576, 576, 576, 1500 };
+   uint8_t* b    = (uint8_t*) p->ptr;
+   uint32_t kind = rnd() % 10;
+   uint32_t len  = sizes[rnd() % 12] - 14;  // no link layer
+   uint32_t i, ip_len;
+   uint8_t  proto;
+
+   for( i = 0; i < len; ++i ) {
+      b[i] = rnd();
+   }
+
+   proto = (kind < 4) ? IPPROTO_TCP : (kind < 7) ? IPPROTO_UDP : IPPROTO_ICMP;
+   if( kind < 8 ) {
+      ip_len = 20;
+      b[0] = 0x45;
+      b[2] = len >> 8;
+      b[3] = len & 0xff;
+      b[9] = proto;
+   }
+   else {
+      proto  = (kind < 9) ? IPPROTO_TCP : IPPROTO_UDP;
+      ip_len = 40;
+      b[0] = 0x60 | (b[0] & 0x0f);
+      b[4] = (len - 40) >> 8;
+      b[5] = (len - 40) & 0xff;
+      b[6] = proto;
+   }
+   if( IPPROTO_TCP == proto ) {
+      b[ip_len + 12] = 0x50;  // no tcp options
+   }
+
+   p->len = len;
+}
+
+static void synthetic_set( packet_set_t* set, uint32_t count, uint32_t seed ) {
+   uint32_t i;
+
+   rnd_state = seed;
+   set->packet = calloc( count, sizeof(packet_t) );
+   set->count  = count;
+   for( i = 0; i < count; ++i ) {
+      set->packet[i].ptr = calloc( BENCH_SNAPLEN, sizeof(uint8_t) );
+      synthetic_packet( &set->packet[i] );
+   }
+}
+
+/** IP packets of a pcap file; everything else is skipped */
+static void pcap_set( packet_set_t* set, uint32_t count, char* file ) {
+   char errbuf[PCAP_ERRBUF_SIZE];
+   struct pcap_pkthdr* hdr;
+   const u_char* data;
+   uint32_t offset;
+   pcap_t* pcap = pcap_open_offline( file, errbuf );
+
+   if( NULL == pcap ) {
+      fprintf( stderr, "%s\n", errbuf );
+      exit(1);
+   }
+
+   switch( pcap_datalink(pcap) ) {
+      case DLT_EN10MB:      offset = 14; break;
+      case DLT_ATM_RFC1483: offset = 8;  break;
+      case DLT_LINUX_SLL:   offset = 16; break;
+      default:              offset = 0;  break;
+   }
+
+   set->packet = calloc( count, sizeof(packet_t) );
+   set->count  = 0;
+   while( set->count < count && 1 == pcap_next_ex( pcap, &hdr, &data ) ) {
+      uint32_t len = hdr->caplen - offset;
+      uint8_t  version;
+
+      if( hdr->caplen <= offset ) continue;
+      if( BENCH_SNAPLEN < len ) len = BENCH_SNAPLEN;
+      version = data[offset] >> 4;
+      if( !(4 == version && 20 <= len) && !(6 == version && 40 <= len) ) continue;
+
+      packet_t* p = &set->packet[set->count++];
+      p->ptr = calloc( BENCH_SNAPLEN, sizeof(uint8_t) );
+      p->len = len;
+      memcpy( (uint8_t*) p->ptr, data + offset, len );
+   }
+   pcap_close( pcap );
+
+   if( 0 == set->count ) {
+      fprintf( stderr, "no IP packets in %s\n", file );
+      exit(1);
+   }
+}
+
+/** selection as done by handle_ip_packet() */
+static inline void select_fields( selectionFunction sel, packet_t* p, buffer_t* b ) {
+   uint32_t offsets[LAYER_COUNT] = {0};
+   uint8_t  layers[LAYER_COUNT]  = {0};
+
+   b->len   = 0;
+   b->count = 0;
+   findHeaders( p->ptr, p->len, offsets, layers );
+   sel( p, b, offsets, layers );
+}
+
+static uint32_t fold( uint32_t acc, uint32_t hash ) {
+   return (acc ^ hash) * 0x01000193;  // FNV prime
+}
+
+/**
+ * checks the golden values; every hash input is hashed scattered,
+ * gathered and in batches, all three have to agree
+ */
+static int check_golden( packet_set_t* set, int print ) {
+   static buffer_t  b[HASH_BATCH_MAX];
+   hash_ctx_t       ctx;
+   buffer_t*        in[HASH_BATCH_MAX];
+   uint32_t         batch[HASH_BATCH_MAX];
+   uint32_t         h, s, i, k;
+   int              failed = 0;
+
+   for( k = 0; k < HASH_BATCH_MAX; ++k ) {
+      b[k].ptr  = calloc( BENCH_SNAPLEN, sizeof(uint8_t) );
+      b[k].size = BENCH_SNAPLEN;
+      in[k]     = &b[k];
+   }
+
+   for( h = 0; h < HASHES; ++h ) {
+      ctx.function = hashes[h].function;
+      ctx.seed     = HASH_SEED_DEFAULT;
+      if( print ) printf( "   {" );
+      for( s = 0; s < SELECTIONS; ++s ) {
+         uint32_t acc = 0x811c9dc5;
+         int      mismatch = 0;
+
+         for( i = 0; i < set->count; i += k ) {
+            for( k = 0; k < HASH_BATCH_MAX && i+k < set->count; ++k ) {
+               select_fields( selections[s].function, &set->packet[i+k], &b[k] );
+            }
+            hash_batch( &ctx, in, k, batch );
+
+            for( k = 0; k < HASH_BATCH_MAX && i+k < set->count; ++k ) {
+               uint32_t value = hash_value( &ctx, &b[k] );
+               buffer_flatten( &b[k] );
+               b[k].count = 0;
+               if( value != hash_value( &ctx, &b[k] ) || value != batch[k] ) {
+                  mismatch = 1;
+               }
+               acc = fold( acc, value );
+            }
+         }
+
+         if( print ) {
+            printf( "%s 0x%08x", (0 == s) ? "" : ",", acc );
+         }
+         else if( mismatch || golden[h][s] != acc ) {
+            printf( "FAILED: %s/%s: 0x%08x, expected 0x%08x%s\n"
+                  , hashes[h].name, selections[s].name, acc, golden[h][s]
+                  , mismatch ? " (scattered/gathered/batch differ)" : "" );
+            failed = 1;
+         }
+      }
+      if( print ) printf( " },\n" );
+   }
+
+   for( k = 0; k < HASH_BATCH_MAX; ++k ) {
+      free( b[k].ptr );
+   }
+   return failed;
+}
+
+static void run_bench( packet_set_t* set, uint32_t loops, uint32_t seed
+      , uint32_t range_min, uint32_t range_max )
+{
+   buffer_t   b;
+   hash_ctx_t ctx;
+   uint32_t h, s, i, l;
+   double   expected = ((double) range_max - range_min + 1) / 4294967296.0;
+
+   b.ptr  = calloc( BENCH_SNAPLEN, sizeof(uint8_t) );
+   b.size = BENCH_SNAPLEN;
+
+   printf( "%u packets x %u loops, seed 0x%x, selection range [0x%08x, 0x%08x]"
+           ", batch kernels: %s\n\n"
+         , set->count, loops, seed, range_min, range_max, hash_batch_isa() );
+   printf( "%-7s %-8s %10s %10s %10s %10s\n"
+         , "hash", "input", "ns/pkt", "cyc/B", "selected", "expected" );
+
+   for( h = 0; h < HASHES; ++h ) {
+      ctx.function = hashes[h].function;
+      ctx.seed     = seed;
+      for( s = 0; s < SELECTIONS; ++s ) {
+         uint64_t bytes    = 0;
+         uint64_t selected = 0;
+         uint64_t t0, c0, ns, cycles;
+
+         parseRange( selections[s].range );
+         t0 = now_ns();
+         c0 = now_cycles();
+         for( l = 0; l < loops; ++l ) {
+            for( i = 0; i < set->count; ++i ) {
+               uint32_t hash_id;
+
+               select_fields( selections[s].function, &set->packet[i], &b );
+               if( 0 == b.len ) continue;
+               hash_id = hash_value( &ctx, &b );
+               bytes += b.len;
+               if( range_min <= hash_id && range_max >= hash_id ) {
+                  ++selected;
+               }
+            }
+         }
+         cycles = now_cycles() - c0;
+         ns     = now_ns() - t0;
+
+         printf( "%-7s %-8s %10.1f %10.2f %9.3f%% %9.3f%%\n"
+               , hashes[h].name, selections[s].name
+               , (double) ns / ((double) set->count * loops)
+               , (0 == bytes || 0 == cycles) ? 0.0 : (double) cycles / bytes
+               , 100.0 * selected / ((double) set->count * loops)
+               , 100.0 * expected );
+      }
+   }
+   free( b.ptr );
+}
+
+/**
+ * share of selected packets over 'seeds' different seeds; a uniform hash
+ * keeps it close to the expected share for every seed
+ */
+static void run_uniformity( packet_set_t* set, uint32_t seeds
+      , uint32_t range_min, uint32_t range_max )
+{
+   buffer_t   b;
+   hash_ctx_t ctx;
+   uint32_t   h, s, i, k;
+   double     expected = ((double) range_max - range_min + 1) / 4294967296.0;
+
+   b.ptr  = calloc( BENCH_SNAPLEN, sizeof(uint8_t) );
+   b.size = BENCH_SNAPLEN;
+
+   printf( "%u packets x %u seeds, selection range [0x%08x, 0x%08x]\n\n"
+         , set->count, seeds, range_min, range_max );
+   printf( "%-7s %-8s %10s %10s %10s %10s %10s\n"
+         , "hash", "input", "mean", "stddev", "min", "max", "expected" );
+
+   for( h = 0; h < HASHES; ++h ) {
+      ctx.function = hashes[h].function;
+      for( s = 0; s < SELECTIONS; ++s ) {
+         double sum = 0, sum2 = 0, min = 1, max = 0;
+
+         parseRange( selections[s].range );
+         for( k = 0; k < seeds; ++k ) {
+            uint64_t selected = 0;
+            double   share;
+
+            ctx.seed = HASH_SEED_DEFAULT + k * 0x9e3779b9;
+            for( i = 0; i < set->count; ++i ) {
+               uint32_t hash_id;
+
+               select_fields( selections[s].function, &set->packet[i], &b );
+               if( 0 == b.len ) continue;
+               hash_id = hash_value( &ctx, &b );
+               if( range_min <= hash_id && range_max >= hash_id ) {
+                  ++selected;
+               }
+            }
+            share = (double) selected / set->count;
+            sum  += share;
+            sum2 += share * share;
+            min   = (share < min) ? share : min;
+            max   = (share > max) ? share : max;
+         }
+
+         sum  /= seeds;
+         sum2  = sum2 / seeds - sum * sum;
+         printf( "%-7s %-8s %9.3f%% %9.3f%% %9.3f%% %9.3f%% %9.3f%%\n"
+               , hashes[h].name, selections[s].name
+               , 100.0 * sum, 100.0 * sqrt( (0 < sum2) ? sum2 : 0 )
+               , 100.0 * min, 100.0 * max, 100.0 * expected );
+      }
+   }
+   free( b.ptr );
+}
+
+int main( int argc, char* argv[] ) {
+   packet_set_t golden_set;
+   packet_set_t bench_set;
+   char*        pcap_file = NULL;
+   uint32_t     count     = BENCH_PACKETS;
+   uint32_t     loops     = 100;
+   uint32_t     range_min = SEL_RANGE_MIN_DEFAULT; // as the probe
+   uint32_t     range_max = SEL_RANGE_MAX_DEFAULT;
+   uint32_t     seed      = HASH_SEED_DEFAULT;
+   uint32_t     seeds     = 0;
+   int          print     = 0;
+   int          c;
+
+   while( -1 != (c = getopt( argc, argv, "r:n:l:m:M:k:u:g" )) ) {
+      switch( c ) {
+         case 'r': pcap_file = optarg; break;
+         case 'n': count     = strtoul( optarg, NULL, 0 ); break;
+         case 'l': loops     = strtoul( optarg, NULL, 0 ); break;
+         case 'm': range_min = strtoul( optarg, NULL, 0 ); break;
+         case 'M': range_max = strtoul( optarg, NULL, 0 ); break;
+         case 'k': seed      = strtoul( optarg, NULL, 0 ); break;
+         case 'u': seeds     = strtoul( optarg, NULL, 0 ); break;
+         case 'g': print     = 1; break;
+         default:
+            fprintf( stderr, "usage: %s [-r <pcap file>] [-n <packets>]"
+                  " [-l <loops>] [-m <min>] [-M <max>] [-k <seed>]"
+                  " [-u <seeds>] [-g]\n", argv[0] );
+            return 1;
+      }
+   }
+
+   logger_init( LOGGER_LEVEL_WARN );
+   // golden values: RAW, LINK, NET, TRANS, PAYLOAD without range, the
+   // whole layer; the measurements set the range of each selection
+   parseRange( "" );
+
+   synthetic_set( &golden_set, GOLDEN_PACKETS, 0x1e55ed );
+   if( print ) {
+      // regenerate hash_golden.h
+      return check_golden( &golden_set, 1 );
+   }
+   if( check_golden( &golden_set, 0 ) ) {
+      return 1;
+   }
+   printf( "golden values: ok\n" );
+
+   if( NULL != pcap_file ) {
+      pcap_set( &bench_set, count, pcap_file );
+   }
+   else {
+      synthetic_set( &bench_set, count, 0xbe4c4 );
+   }
+   if( 0 < seeds ) {
+      run_uniformity( &bench_set, seeds, range_min, range_max );
+   }
+   else {
+      run_bench( &bench_set, loops, seed, range_min, range_max );
+   }
+
+   return 0;
+}
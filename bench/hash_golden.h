@@ -0,0 +1,8 @@
+/* generated by 'impd4e_bench -g'; do not change - other probes select by
+ * the same hash values */
+   { 0x7c8dd2d5, 0x08b972be, 0x29b31d2a, 0x1d12f8e8, 0xc7b62b99, 0xf8ccadc5, 0xc7b62b99, 0xc7b62b99, 0xcf8d898d, 0x87277889 },
+   { 0xf45429d8, 0xda740225, 0x94258cf9, 0xa49e53bd, 0x66b50a38, 0x14baf1c5, 0x66b50a38, 0x66b50a38, 0x708bd6e3, 0x1b67687f },
+   { 0xe400be32, 0x84afa56f, 0x534cdb76, 0x1d6a803e, 0x722030ea, 0x1f116dc5, 0x722030ea, 0x722030ea, 0x7639f670, 0x571fefed },
+   { 0x66b4c622, 0x6ded5ee1, 0xc3ee6bdf, 0x2688471f, 0xdad71c2c, 0x1f116dc5, 0xdad71c2c, 0xdad71c2c, 0xf7d89ea9, 0xa7f76914 },
+   { 0xda237835, 0xf2732403, 0x7aec47ab, 0x20d3fe41, 0xe645fd74, 0x1f116dc5, 0xe645fd74, 0xe645fd74, 0x8bcbcff9, 0xe42cfd0c },
+   { 0xdd1a56c9, 0x6a005501, 0xdebf5f71, 0xf57eb342, 0x40568d66, 0x1f116dc5, 0x40568d66, 0x40568d66, 0x568b92fa, 0x9e63dfdd },
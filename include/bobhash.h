@@ -15,6 +15,20 @@ typedef  uint8_t   ub1;   /* unsigned 1-byte quantities */
 
 uint32_t BOB_Hash(uint8_t *databuffer, uint16_t databufferlength, uint32_t tinitval);
 
+/* incremental variant: feeding the key in arbitrary pieces through
+ * BOB_Hash_update() yields the same value as BOB_Hash() over the
+ * concatenation of all pieces */
+typedef struct bob_state_s {
+   ub4 a, b, c;
+   ub4 length;    /* bytes consumed so far */
+   ub4 fill;      /* bytes pending in tail */
+   ub1 tail[12];
+} bob_state_t;
+
+void     BOB_Hash_init(bob_state_t *state, uint32_t tinitval);
+void     BOB_Hash_update(bob_state_t *state, const uint8_t *data, uint32_t length);
+uint32_t BOB_Hash_final(bob_state_t *state);
+
 
 #endif /*BOBHASH_H_*/
 
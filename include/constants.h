@@ -35,6 +35,10 @@
 #ifndef CONSTANTS_H_
 #define CONSTANTS_H_
 
+#ifdef HAVE_CONFIG_H
+#include "config.h" // features found by configure
+#endif
+
 #include <stdbool.h>
 #include <stdint.h>
 #include <sys/types.h>
@@ -55,27 +59,71 @@
 #endif
 
 #define PCAP_DISPATCH_PACKET_COUNT 10 /*!< max number of packets to be processed on each dispatch */
+#define PCAP_REPLAY_PACKET_COUNT 10000 /*!< max number of packets to be processed on each replay dispatch */
 
 #define BUFFER_SIZE 1024
 
+#define SOCKET_BATCH_SIZE 64 /*!< max number of datagrams received by one recvmmsg() call */
+
 #ifdef PFRING
 #define MAX_RULES 256
 #endif // PFRING
 
+// memory mapped packet socket capture and capture workers; configure
+// checks <linux/if_packet.h> (HAVE_TPACKET3, HAVE_PACKET_FANOUT in config.h)
+#ifdef PFRING
+#undef HAVE_TPACKET3
+#undef HAVE_PACKET_FANOUT
+#endif
+
+#define TPACKET_RING_SIZE     (64*1024*1024) /*!< default ring size in bytes */
+#define TPACKET_BLOCK_SIZE    (1024*1024)    /*!< default block size in bytes */
+#define TPACKET_BLOCK_TIMEOUT 10             /*!< default block retire timeout in ms */
+
+#define MAX_WORKERS 32 /*!< max number of capture workers per interface */
+
+#define EXPORT_RING_SIZE   16384 /*!< packet id records per capture device (power of 2) */
+#define EXPORT_RING_WAKE   64    /*!< records in a ring which wake the sleeping exporter */
+#define EXPORTER_BATCH     1024  /*!< records encoded per hold of the exporter lock */
+#define EXPORTER_REPLAY_TICK 10  /*!< ms between the replay rounds of the spool */
+
+#define LINK_MAX_TAGS 8 /*!< max number of VLAN tags and MPLS labels in front of the network header */
+
+#define MAX_COLLECTORS     8           /*!< max number of collectors (-C) */
+#define EXPORT_QUEUE_SIZE  (256*1024)  /*!< unsent bytes buffered per collector */
+#define COLLECTOR_RETRY_TIME 5         /*!< seconds between connection attempts to a collector */
+#define EXPORTER_STOP_TIME 1000        /*!< ms to send the queued messages on shutdown */
+
 
 
+// max. number of packet pieces a selection may reference without copying
+#define MAX_BUFFER_SEGMENTS 16
+
+typedef struct segment_s {
+   const uint8_t* ptr;
+   uint32_t       len;
+}
+segment_t;
+
+// hash input; either 'len' bytes at 'ptr' (count == 0) or the
+// concatenation of the first 'count' segments, which point
+// straight into the captured packet
 typedef struct buffer_s {
    uint8_t*       ptr;
    uint32_t       len;
    uint32_t       size;
+   uint32_t       count;
+   segment_t      seg[MAX_BUFFER_SEGMENTS];
 }
 buffer_t;
 
 // hash functions for parsing
-#define HASH_FUNCTION_BOB   "BOB"
-#define HASH_FUNCTION_OAAT  "OAAT"
-#define HASH_FUNCTION_TWMX  "TWMX"
-#define HASH_FUNCTION_HSIEH "HSIEH"
+#define HASH_FUNCTION_BOB    "BOB"
+#define HASH_FUNCTION_OAAT   "OAAT"
+#define HASH_FUNCTION_TWMX   "TWMX"
+#define HASH_FUNCTION_HSIEH  "HSIEH"
+#define HASH_FUNCTION_SBOX   "SBOX"
+#define HASH_FUNCTION_SBOX64 "SBOX64"
 
 //hash input selection functions for parsing
 #define HASH_INPUT_REC8    "REC8"
@@ -94,9 +142,12 @@ typedef enum {
    L_LINK = 0,
    L_NET,
    L_TRANS,
-   L_PAYLOAD
+   L_PAYLOAD,
+   L_FRAG      // not a layer: offset of the fragment id, fragment_t (see findHeaders())
 } OSIlayer_t;
 
+#define LAYER_COUNT 5 /*!< size of the header offset and layer arrays */
+
 
 typedef enum {
     L_UNKNOWN = 0,
@@ -137,6 +188,46 @@ typedef enum {
    P_EXISTS = 1
 } payload_t;
 
+// fragment of the network layer; layers[L_FRAG]
+typedef enum {
+   F_NONE  = 0, // not fragmented
+   F_FIRST = 1, // first fragment; has the transport header
+   F_NEXT  = 2  // later fragment; no transport header (but an offset, see findHeaders())
+} fragment_t;
+
+// selection of fragments (-g)
+typedef enum {
+   FRAGMENTS_NONE = 0,  // no special handling; hash the selected fields
+   FRAGMENTS_INVARIANT, // hash addresses, protocol and fragment id
+   FRAGMENTS_TABLE      // later fragments take the decision of the first one
+} fragment_policy_t;
+
+#define FRAGMENT_TABLE_SIZE 1024 /*!< default entries of the fragment table (power of 2) */
+#define FRAGMENT_TIMEOUT    30   /*!< sec an entry of the fragment table is valid */
+
+// packet selector (-U); the values are the PSAMP selectorAlgorithm (RFC 5477)
+typedef enum {
+   SELECTOR_HASH   = 6, // hash-based filtering (-m, -M, -r, -H); 6 is "using BOB"
+   SELECTOR_COUNT  = 1, // systematic count-based: <interval> of <interval>+<space> packets
+   SELECTOR_TIME   = 2, // systematic time-based: <interval> of <interval>+<space> usec
+   SELECTOR_RANDOM = 3  // random n-out-of-N
+} selector_t;
+
+// adaptive sampling (-b)
+#define ADAPTIVE_INTERVAL   5.0 /*!< default sec between two decisions of the controller */
+#define ADAPTIVE_CPU_LIMIT  90  /*!< default % CPU per capture thread above which the ratio is halved */
+#define ADAPTIVE_RING_LIMIT 50  /*!< % fill of the export rings above which the ratio is halved */
+#define ADAPTIVE_GROW_TICKS 3   /*!< quiet intervals before the ratio is doubled again */
+
+// tunnels to decapsulate (-E); also the exported tunnel type
+typedef enum {
+   TUNNEL_NONE  = 0,
+   TUNNEL_IPIP  = 0x01,
+   TUNNEL_GRE   = 0x02,
+   TUNNEL_VXLAN = 0x04,
+   TUNNEL_GTPU  = 0x08
+} tunnel_t;
+
 typedef enum hash_function {
    FUNCTION_BOB       = 0x001,
    FUNCTION_TWMX      = 0x002,
@@ -165,6 +256,13 @@ enum {
    , ALL
 };
 
+// replay modes for pcap files
+typedef enum {
+     REPLAY_TIMER = 0 // legacy: PCAP_DISPATCH_PACKET_COUNT packets per second
+   , REPLAY_FAST      // as fast as possible
+   , REPLAY_PACED     // keep the trace timing (scaled by replay speed)
+} replay_mode_t;
+
 typedef enum {
      TYPE_UNKNOWN
    , TYPE_PCAP
@@ -176,8 +274,39 @@ typedef enum {
    #ifdef PFRING
    , TYPE_PFRING
    #endif
+   #ifdef HAVE_TPACKET3
+   , TYPE_TPACKET
+   #endif
 } device_type_t;
 
+// opaque memory mapped ring of a TYPE_TPACKET device
+struct tpacket_ring_s;
+
+// opaque receive buffers of a TYPE_SOCKET_* device
+struct socket_batch_s;
+
+// distribution of packets among capture workers (-W)
+typedef enum {
+     FANOUT_HASH = 0  // by flow hash; a flow stays at one worker
+   , FANOUT_CPU       // by the cpu the packet arrived on
+} fanout_mode_t;
+
+// opaque capture workers of a device
+struct worker_group_s;
+
+// distribution of the packet id messages among the collectors (-A)
+typedef enum {
+     DISTRIBUTE_ALL = 0  // every collector gets every message
+   , DISTRIBUTE_RR       // round robin per message
+   , DISTRIBUTE_HASH     // by packet id; each collector gets a disjoint hash range
+} distribution_t;
+
+// a collector address (-C); port 0 is the default port (-P)
+typedef struct collector_addr {
+   char     host[256];
+   uint16_t port;
+} collector_addr_t;
+
 typedef struct ipfix_conf {
    ipfix_t*          handle;
    ipfix_template_t* template;
@@ -193,6 +322,9 @@ typedef union device {
    #ifdef PFRING
    pfring* pfring;
    #endif
+   #ifdef HAVE_TPACKET3
+   struct tpacket_ring_s* tpacket;
+   #endif
 } device_t;
 
 typedef struct device_desc {
@@ -206,15 +338,46 @@ typedef union device_handle{
    pcap_t * pcap;
    #endif
    int      fd;
+   struct socket_batch_s* socket;
    #ifdef PFRING
    pfring* pfring;
    #endif
+   #ifdef HAVE_TPACKET3
+   struct tpacket_ring_s* tpacket;
+   #endif
 } dh_t;
 
 // function pointer for dispatch functions
 // structure similar to pcap_dispatch()
 typedef int (*dispatch_func_t)( dh_t dh , int cnt, pcap_handler packet_handler, u_char* user_args);
 
+// handler of ip packets; specialised for the current configuration
+struct packet_s;
+struct packet_info_s;
+typedef void (*ip_handler_t)( struct packet_s*, struct packet_info_s* );
+
+// cost split of the ip packet path; the cycles are sampled
+// (see ip_packet_select() in packet_handler.c)
+typedef struct path_stats_s {
+   uint64_t          selection_packets;  // tier 1: parse, select, hash
+   uint64_t          selection_cycles;
+   uint32_t          selection_samples;
+   uint64_t          export_packets;     // tier 2: decode, packet id, record
+   uint64_t          export_cycles;
+   uint32_t          export_samples;
+} path_stats_t;
+
+// hash id ranges to select (see selection.h); sorted, disjoint
+#define SELECTION_RANGES 8 /*!< ranges per selection (-H) */
+
+typedef struct selection_s {
+   uint64_t          full[4];    // buckets of the top 8 hash bits inside a range
+   uint64_t          partial[4]; // buckets with a range boundary; check the ranges
+   uint32_t          count;
+   uint32_t          min[SELECTION_RANGES];
+   uint32_t          span[SELECTION_RANGES]; // max - min
+} selection_t;
+
 typedef struct device_dev {
    // link data
    device_type_t     device_type;
@@ -223,6 +386,12 @@ typedef struct device_dev {
 
    dh_t              dh;            // device specific handler
    dispatch_func_t   dispatch;      // dispatch function pointer
+   ip_handler_t      ip_handler;    // see packet_path_configure()
+   ip_handler_t      ip_inner_handler; // behind the decapsulation stage (-E)
+   ip_handler_t      ip_single_handler; // per packet, behind the burst stage (-F <f>:batch)
+   struct packet_burst_s* burst;    // ip packets of a capture buffer (-F <f>:batch); lazy
+   struct fragment_table_s* fragments; // decisions of first fragments (-g table); lazy
+   uint8_t           fragments_failed; // no table; invariant hash instead
 
    #ifndef PFRING
    bpf_u_int32       IPv4address; // network byte order
@@ -248,13 +417,28 @@ typedef struct device_dev {
 //   ipfix_template_t *ipfixtmpl_ts_open_epc;
 
    uint32_t          pkt_offset; // points to first packet after link layer
+   uint16_t          rx_vlan_id; // tag stripped by the kernel (tpacket); 0 if none
    buffer_t          hash_buffer;
    uint32_t          export_packet_count;
    uint64_t          totalpacketcount;
    uint32_t          packets_dropped; // packet drop due to sampling
+   uint64_t          selected_total;    // packets selected since the start
+   uint32_t          selector_position; // -U count, random: packet in the current period
+   uint32_t          selector_chosen;   // -U random: packets selected in the current period
+   uint32_t          selector_random;   // -U random: xorshift state
+   uint32_t          sel_range_min; // own range (-m, -M, -r with @<interface>)
+   uint32_t          sel_range_max;
+   uint8_t           sel_local;     // own selection; not following the global one
+   selection_t       sel_sets[2];   // written by the main thread only
+   selection_t*      selection;     // active one of sel_sets; read by the capture thread(s)
+   uint32_t          sel_epoch;     // worker: odd while in the packet path; see workers_quiesce()
    struct timeval    last_export_time;
    uint32_t          sampling_size;
    uint64_t          sampling_delta_count;
+   path_stats_t      path;
+   struct export_ring_s* ring;      // packet id records to the exporter
+
+   struct worker_group_s* workers; // capture workers (-W); NULL if not used
 } device_dev_t;
 
 //typedef struct packet_data {
@@ -286,9 +470,30 @@ typedef struct packet_info_s {
    uint32_t       length;
    device_dev_t   *device;
    uint16_t       nettype;
+   uint32_t       link_offset; // network header behind tags and labels
+   uint16_t       vlan_id;     // outer VLAN tag; 0 if none
+   uint32_t       mpls_label;  // top label stack entry without TTL; 0 if none
+   uint8_t        tunnel_type; // tunnel_t of a decapsulated packet
+   uint32_t       tunnel_id;   // GRE key, VNI, TEID
 } packet_info_t;
 
-typedef uint32_t (*hashFunction)      (buffer_t*);
+// default seed of the hash functions; the init value BOB and TWMX have
+// always used, the other hashes start from (seed ^ HASH_SEED_DEFAULT)
+#define HASH_SEED_DEFAULT 0x32545
+
+// default selection range (-m, -M): 10% of the hash values; the edge of
+// the value range is left out
+#define SEL_RANGE_MIN_DEFAULT 0x19999999 /*!< 2^32 / 10 */
+#define SEL_RANGE_MAX_DEFAULT 0x33333333 /*!< 2^32 / 5 */
+
+typedef struct hash_ctx_s hash_ctx_t;
+typedef uint32_t (*hashFunction)      (const hash_ctx_t*, buffer_t*);
+
+// hash function together with its parameters
+struct hash_ctx_s {
+   hashFunction   function;
+   uint32_t       seed;
+};
 typedef uint32_t (*selectionFunction) (packet_t *, buffer_t *, uint32_t *, uint8_t *);
 //typedef void     (*device_handler)    (u_char*, void* , const u_char* );
 
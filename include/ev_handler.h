@@ -43,6 +43,8 @@
 
 typedef void (*timer_cb_t)(EV_P_ ev_timer *w, int revents);
 typedef void (*io_cb_t)(EV_P_ ev_io *w, int revents);
+typedef void (*idle_cb_t)(EV_P_ ev_idle *w, int revents);
+typedef void (*periodic_cb_t)(EV_P_ ev_periodic *w, int revents);
 typedef void (*watcher_cb_t)(EV_P_ ev_watcher *w, int revents);
 
 /* -- event loop -- */
@@ -54,9 +56,13 @@ ev_watcher* event_register_io_r(EV_P_ watcher_cb_t cb, int fd);
 ev_watcher* event_register_io_w(EV_P_ watcher_cb_t cb, int fd);
 ev_watcher* event_register_timer(EV_P_ watcher_cb_t cb, double timeout);
 ev_watcher* event_register_timer_w(EV_P_ watcher_cb_t cb, double timeout);
+ev_watcher* event_register_idle(EV_P_ watcher_cb_t cb);
+ev_watcher* event_register_periodic(EV_P_ watcher_cb_t cb, double interval);
 
 void event_deregister_timer( EV_P_ ev_timer *w );
+void event_deregister_periodic( EV_P_ ev_periodic *w );
 void event_deregister_io( EV_P_ ev_io *w );
+void event_deregister_idle( EV_P_ ev_idle *w );
 
 
 #endif /* EVENTHANDLER_H_ */
@@ -44,9 +44,14 @@ extern ev_timer* export_timer_pkid;
 extern ev_timer* export_timer_sampling;
 extern ev_timer* export_timer_stats;
 extern ev_timer* export_timer_location;
+extern ev_timer* export_timer_templates;
 
 void export_handler_init(EV_P);
 
+#ifndef PFRING
+int get_capture_stats(device_dev_t *dev, struct pcap_stat *ps);
+#endif
+
 void export_data_sync(device_dev_t *dev
       , int64_t observationTimeMilliseconds
       , u_int32_t messageId
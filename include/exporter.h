@@ -0,0 +1,122 @@
+/*
+ * impd4e - a small network probe which allows to monitor and sample datagrams
+ * from the network based on hash-based packet selection.
+ *
+ * Copyright (c) 2011
+ *
+ * Fraunhofer FOKUS
+ * www.fokus.fraunhofer.de
+ *
+ * in cooperation with
+ *
+ * Technical University Berlin
+ * www.av.tu-berlin.de
+ *
+ * authors:
+ * Ramon Masek <ramon.masek@fokus.fraunhofer.de>
+ * Christian Henke <c.henke@tu-berlin.de>
+ * Carsten Schmoll <carsten.schmoll@fokus.fraunhofer.de>
+ *
+ * For questions/comments contact packettracking@fokus.fraunhofer.de
+ *
+ * This program is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software Foundation;
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _EXPORTER_H_
+#define _EXPORTER_H_
+
+#include <stdint.h>
+
+#include "constants.h"
+#include "ipfix_encoder.h"
+
+// -----------------------------------------------------------------------------
+// Type definitions
+// -----------------------------------------------------------------------------
+
+/**
+ * single producer/single consumer ring of packet id records; the capture
+ * thread of a device writes, the exporter thread reads
+ */
+typedef struct export_ring_s {
+   pktid_record_t*   slot;
+   uint32_t          mask;
+   // producer side
+   uint32_t          head;
+   uint32_t          tail_cache;
+   uint64_t          drops;      // records lost because the ring was full
+   // consumer side
+   uint32_t          tail __attribute__((aligned(64)));
+} export_ring_t;
+
+// -----------------------------------------------------------------------------
+// Prototypes
+// -----------------------------------------------------------------------------
+
+// allocate a ring and hand it to the exporter; before exporter_start() only
+export_ring_t* export_ring_new();
+
+// number of records waiting in the ring
+static inline uint32_t export_ring_fill( export_ring_t* ring ) {
+   return __atomic_load_n( &ring->head, __ATOMIC_ACQUIRE )
+        - __atomic_load_n( &ring->tail, __ATOMIC_ACQUIRE );
+}
+
+/**
+ * next free record of the ring; NULL (and counted as drop) if the ring is
+ * full. The record is passed to the exporter by export_ring_commit().
+ */
+static inline pktid_record_t* export_ring_slot( export_ring_t* ring ) {
+   if( ring->head - ring->tail_cache > ring->mask ) {
+      ring->tail_cache = __atomic_load_n( &ring->tail, __ATOMIC_ACQUIRE );
+      if( ring->head - ring->tail_cache > ring->mask ) {
+         ring->drops++;
+         return NULL;
+      }
+   }
+   return &ring->slot[ring->head & ring->mask];
+}
+
+// set while the exporter thread sleeps
+extern int exporter_sleeping;
+
+// end the sleep of the exporter thread
+void exporter_wake();
+
+/**
+ * a sleeping exporter is woken once the ring holds EXPORT_RING_WAKE
+ * records; a missed wake-up only delays the records until the next
+ * commit or the next flush
+ */
+static inline void export_ring_commit( export_ring_t* ring ) {
+   __atomic_store_n( &ring->head, ring->head + 1, __ATOMIC_RELEASE );
+   if( __atomic_load_n( &exporter_sleeping, __ATOMIC_RELAXED ) ) {
+      ring->tail_cache = __atomic_load_n( &ring->tail, __ATOMIC_ACQUIRE );
+      if( EXPORT_RING_WAKE <= ring->head - ring->tail_cache ) {
+         exporter_wake();
+      }
+   }
+}
+
+// start/stop the exporter thread; stopping drains the rings and flushes
+void exporter_start();
+void exporter_stop();
+
+// ask the exporter to send the buffered records; wakes it
+void exporter_flush();
+
+// serialize the use of the ipfix handle with the exporter thread
+void exporter_lock();
+void exporter_unlock();
+
+#endif /* _EXPORTER_H_*/
@@ -0,0 +1,77 @@
+/*
+ * impd4e - a small network probe which allows to monitor and sample datagrams
+ * from the network based on hash-based packet selection.
+ *
+ * Copyright (c) 2011
+ *
+ * Fraunhofer FOKUS
+ * www.fokus.fraunhofer.de
+ *
+ * in cooperation with
+ *
+ * Technical University Berlin
+ * www.av.tu-berlin.de
+ *
+ * authors:
+ * Ramon Masek <ramon.masek@fokus.fraunhofer.de>
+ * Christian Henke <c.henke@tu-berlin.de>
+ * Carsten Schmoll <carsten.schmoll@fokus.fraunhofer.de>
+ *
+ * For questions/comments contact packettracking@fokus.fraunhofer.de
+ *
+ * This program is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software Foundation;
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _FLOW_CACHE_H_
+#define _FLOW_CACHE_H_
+
+#include <stdint.h>
+
+#include "ipfix_encoder.h"
+
+// -----------------------------------------------------------------------------
+// Type definitions
+// -----------------------------------------------------------------------------
+
+#define FLOW_CACHE_WAYS 16 /*!< entries a flow may be placed in (one cache line of tags) */
+
+// flowEndReason (RFC 5102, section 5.11.3)
+#define FLOW_END_IDLE_TIMEOUT    0x01
+#define FLOW_END_ACTIVE_TIMEOUT  0x02
+#define FLOW_END_FORCED          0x04
+#define FLOW_END_LACK_OF_RESOURCES 0x05
+
+// -----------------------------------------------------------------------------
+// Prototypes
+// -----------------------------------------------------------------------------
+
+/**
+ * allocate a cache of at least 'entries' flows (rounded up to a power
+ * of 2); timeouts in seconds
+ */
+int  flow_cache_init( uint32_t entries, double active_timeout, double idle_timeout );
+
+// 1 if the cache is allocated
+int  flow_cache_enabled();
+
+// account the packet of the record to its flow
+void flow_cache_add( const pktid_record_t* record );
+
+// export the flows which timed out; all flows if 'all' is set
+void flow_cache_expire( int all );
+
+// print the counters of the cache
+void flow_cache_report();
+
+#endif /* _FLOW_CACHE_H_*/
@@ -0,0 +1,70 @@
+/*
+ * impd4e - a small network probe which allows to monitor and sample datagrams
+ * from the network based on hash-based packet selection.
+ *
+ * Copyright (c) 2011
+ *
+ * Fraunhofer FOKUS
+ * www.fokus.fraunhofer.de
+ *
+ * in cooperation with
+ *
+ * Technical University Berlin
+ * www.av.tu-berlin.de
+ *
+ * authors:
+ * Ramon Masek <ramon.masek@fokus.fraunhofer.de>
+ * Christian Henke <c.henke@tu-berlin.de>
+ * Carsten Schmoll <carsten.schmoll@fokus.fraunhofer.de>
+ *
+ * For questions/comments contact packettracking@fokus.fraunhofer.de
+ *
+ * This program is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software Foundation;
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifndef _FRAGMENT_TABLE_H_
+#define _FRAGMENT_TABLE_H_
+
+#include <stdint.h>
+
+// -----------------------------------------------------------------------------
+// Type definitions
+// -----------------------------------------------------------------------------
+
+typedef struct fragment_entry_s {
+   uint32_t key;     // hash over the invariant fields of the datagram
+   uint32_t hash_id; // hash id of the first fragment
+   uint32_t time;    // packet time in sec; 0 if unused
+} fragment_entry_t;
+
+typedef struct fragment_table_s {
+   uint32_t         mask;
+   fragment_entry_t entry[];
+} fragment_table_t;
+
+// -----------------------------------------------------------------------------
+// Prototypes
+// -----------------------------------------------------------------------------
+
+// table of at least 'size' entries (power of 2); NULL on failure
+fragment_table_t* fragment_table_new( uint32_t size );
+
+// keep the hash id of the first fragment of a datagram
+void fragment_table_put( fragment_table_t* t, uint32_t key, uint32_t hash_id, uint32_t now );
+
+// hash id of the first fragment; 0 if unknown or timed out
+int  fragment_table_get( fragment_table_t* t, uint32_t key, uint32_t now, uint32_t* hash_id );
+
+#endif /* _FRAGMENT_TABLE_H_*/
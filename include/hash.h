@@ -50,55 +50,69 @@
 
 // find layers in pcap paket
 void findHeaders( const uint8_t *packet, uint16_t packetLength, uint32_t *headerOffset, uint8_t *layers );
+// network layer only; 1 if it fell back to findHeaders()
+int findNetHeader( const uint8_t *packet, uint16_t packetLength, uint32_t *headerOffset, uint8_t *layers );
 
 // parse range selection from given parameter
 // used to be a comma seperated list of byte offsets and ranges
 void parseRange( char* arg );
 
+// copy a scattered hash input into the buffer memory (b->ptr)
+void buffer_flatten( buffer_t *b );
+
 uint32_t copyFields_Rec( packet_t *packet,
       buffer_t *buffer,
-      uint32_t headerOffset[4], uint8_t layers[4]);
+      uint32_t headerOffset[LAYER_COUNT], uint8_t layers[LAYER_COUNT]);
+
+// invariant fields of a fragment
+uint32_t copyFields_Fragment( packet_t *packet,
+      buffer_t *buffer,
+      uint32_t headerOffset[LAYER_COUNT], uint8_t layers[LAYER_COUNT]);
 
 uint32_t copyFields_Only_Net( packet_t *packet,
       buffer_t *buffer,
-      uint32_t headerOffset[4], uint8_t layers[4]);
+      uint32_t headerOffset[LAYER_COUNT], uint8_t layers[LAYER_COUNT]);
 
 uint32_t copyFields_U_TCP_and_Net( packet_t *packet,
       buffer_t *buffer,
-      uint32_t headerOffset[4], uint8_t layers[4]);
+      uint32_t headerOffset[LAYER_COUNT], uint8_t layers[LAYER_COUNT]);
 
 uint32_t copyFields_Packet( packet_t *packet,
       buffer_t *buffer,
-      uint32_t headerOffset[4], uint8_t layers[4]);
+      uint32_t headerOffset[LAYER_COUNT], uint8_t layers[LAYER_COUNT]);
 
 uint32_t copyFields_Raw( packet_t *packet,
       buffer_t *buffer,
-      uint32_t headerOffset[4], uint8_t layers[4]);
+      uint32_t headerOffset[LAYER_COUNT], uint8_t layers[LAYER_COUNT]);
 
 uint32_t copyFields_Last( packet_t *packet,
       buffer_t *buffer,
-      uint32_t headerOffset[4], uint8_t layers[4]);
+      uint32_t headerOffset[LAYER_COUNT], uint8_t layers[LAYER_COUNT]);
 
 uint32_t copyFields_Link( packet_t *packet,
       buffer_t *buffer,
-      uint32_t headerOffset[4], uint8_t layers[4]);
+      uint32_t headerOffset[LAYER_COUNT], uint8_t layers[LAYER_COUNT]);
 
 uint32_t copyFields_Net( packet_t *packet,
       buffer_t *buffer,
-      uint32_t headerOffset[4], uint8_t layers[4]);
+      uint32_t headerOffset[LAYER_COUNT], uint8_t layers[LAYER_COUNT]);
 
 uint32_t copyFields_Trans( packet_t *packet,
       buffer_t *buffer,
-      uint32_t headerOffset[4], uint8_t layers[4]);
+      uint32_t headerOffset[LAYER_COUNT], uint8_t layers[LAYER_COUNT]);
 
 uint32_t copyFields_Payload( packet_t *packet,
       buffer_t *buffer,
-      uint32_t headerOffset[4], uint8_t layers[4]);
+      uint32_t headerOffset[LAYER_COUNT], uint8_t layers[LAYER_COUNT]);
+
+// hash value of the given input with the function and seed of ctx
+#define hash_value( ctx, b ) ((ctx)->function( (ctx), (b) ))
 
-uint32_t calcHashValue_BOB        ( buffer_t * );
-uint32_t calcHashValue_Hsieh      ( buffer_t * );
-uint32_t calcHashValue_OAAT       ( buffer_t * );
-uint32_t calcHashValue_TWMXRSHash ( buffer_t * );
-//uint32_t calcHashValue_SBOX       ( buffer_t * );
+uint32_t calcHashValue_BOB        ( const hash_ctx_t *, buffer_t * );
+uint32_t calcHashValue_Hsieh      ( const hash_ctx_t *, buffer_t * );
+uint32_t calcHashValue_OAAT       ( const hash_ctx_t *, buffer_t * );
+uint32_t calcHashValue_TWMXRSHash ( const hash_ctx_t *, buffer_t * );
+uint32_t calcHashValue_SBOX       ( const hash_ctx_t *, buffer_t * );
+uint32_t calcHashValue_SBOX64     ( const hash_ctx_t *, buffer_t * );
 
 #endif /*HASH_H_*/
@@ -0,0 +1,65 @@
+/*
+ * impd4e - a small network probe which allows to monitor and sample datagrams
+ * from the network based on hash-based packet selection.
+ *
+ * Copyright (c) 2011
+ *
+ * Fraunhofer FOKUS
+ * www.fokus.fraunhofer.de
+ *
+ * in cooperation with
+ *
+ * Technical University Berlin
+ * www.av.tu-berlin.de
+ *
+ * authors:
+ * Ramon Masek <ramon.masek@fokus.fraunhofer.de>
+ * Christian Henke <c.henke@tu-berlin.de>
+ * Carsten Schmoll <carsten.schmoll@fokus.fraunhofer.de>
+ *
+ * For questions/comments contact packettracking@fokus.fraunhofer.de
+ *
+ * This program is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software Foundation;
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HASH_BATCH_H_
+#define HASH_BATCH_H_
+
+#include <stdint.h>
+
+#include "constants.h"
+
+// max. number of inputs hashed side by side in one SIMD pass
+#define HASH_BATCH_MAX       16
+// inputs grouped by length per pass over the batch
+#define HASH_BATCH_BURST     32
+// shorter and longer inputs are always hashed by the scalar function;
+// below 16 bytes the transposition costs as much as the lanes save
+#define HASH_BATCH_MIN_LEN   16
+#define HASH_BATCH_MAX_LEN   64
+
+/**
+ * hashes n inputs with the hash function of ctx, result[i] is identical
+ * to hash_value(ctx, input[i]); inputs of the same length are hashed in
+ * SIMD lanes (4, 8 or 16 at once, depending on the cpu), everything else
+ * falls back to the scalar function
+ */
+void hash_batch( const hash_ctx_t* ctx, buffer_t* input[], uint32_t n, uint32_t result[] );
+
+// 1 if hash_batch() has lane kernels for the hash function (BOB, OAAT, TWMX)
+int hash_batch_supported( hashFunction f );
+
+// name of the instruction set chosen for the batch kernels
+const char* hash_batch_isa();
+
+#endif /*HASH_BATCH_H_*/
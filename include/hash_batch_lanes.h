@@ -0,0 +1,134 @@
+/*
+ * impd4e - a small network probe which allows to monitor and sample datagrams
+ * from the network based on hash-based packet selection.
+ *
+ * Copyright (c) 2011
+ *
+ * Fraunhofer FOKUS
+ * www.fokus.fraunhofer.de
+ *
+ * in cooperation with
+ *
+ * Technical University Berlin
+ * www.av.tu-berlin.de
+ *
+ * authors:
+ * Ramon Masek <ramon.masek@fokus.fraunhofer.de>
+ * Christian Henke <c.henke@tu-berlin.de>
+ * Carsten Schmoll <carsten.schmoll@fokus.fraunhofer.de>
+ *
+ * For questions/comments contact packettracking@fokus.fraunhofer.de
+ *
+ * This program is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software Foundation;
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * lane kernels of the batch hash functions; this is not a public header,
+ * it is included by hash_batch.c once per lane count with
+ *   LANES       - number of inputs hashed side by side
+ *   LANE_TARGET - function attribute selecting the instruction set
+ * defined. The kernels read the inputs as little endian 32 bit words,
+ * transposed so that word i of lane l is at w[i*LANES+l], and zero padded
+ * behind the input. All lanes have the same length 'len'; 'seed' is the
+ * value the scalar function passes on (see batch_seed()).
+ */
+
+#define LANE_CAT_(a, b)  a##b
+#define LANE_CAT(a, b)   LANE_CAT_(a, b)
+#define LANE_NAME(name)  LANE_CAT(name, LANES)
+
+typedef uint32_t LANE_NAME(lane_u32_) __attribute__ ((vector_size (4*LANES)));
+
+#define VU LANE_NAME(lane_u32_)
+
+#define LANE_LOAD(v, i)  memcpy( &(v), w + (i)*LANES, sizeof(v) )
+#define LANE_STORE(v)    memcpy( out, &(v), sizeof(v) )
+
+static LANE_TARGET
+void LANE_NAME(bob_lanes_)( const uint32_t *w, uint32_t len, uint32_t seed, uint32_t *out )
+{
+   VU a, b, c, k;
+   uint32_t i = 0;
+   uint32_t n = len / 12;
+
+   a = b = (VU){0} + 0x9e3779b9;
+   c = (VU){0} + seed;
+
+   for( ; n > 0; --n, i += 3 ) {
+      LANE_LOAD(k, i);   a += k;
+      LANE_LOAD(k, i+1); b += k;
+      LANE_LOAD(k, i+2); c += k;
+      BATCH_BOB_MIX(a, b, c);
+   }
+
+   // the zero padding takes the place of the switch over the last bytes;
+   // the first byte of c is reserved for the length
+   c += len;
+   LANE_LOAD(k, i);   a += k;
+   LANE_LOAD(k, i+1); b += k;
+   LANE_LOAD(k, i+2); c += k << 8;
+   BATCH_BOB_MIX(a, b, c);
+
+   LANE_STORE(c);
+}
+
+static LANE_TARGET
+void LANE_NAME(oaat_lanes_)( const uint32_t *w, uint32_t len, uint32_t seed, uint32_t *out )
+{
+   VU hash, k;
+   uint32_t i;
+
+   hash = (VU){0} + seed;
+   for( i = 0; i < len; ++i ) {
+      LANE_LOAD(k, i >> 2);
+      hash += (k >> ((i & 3) * 8)) & 0xff;
+      hash += (hash << 10);
+      hash ^= (hash >> 6);
+   }
+   hash += (hash << 3);
+   hash ^= (hash >> 11);
+   hash += (hash << 15);
+
+   LANE_STORE(hash);
+}
+
+static LANE_TARGET
+void LANE_NAME(twmx_lanes_)( const uint32_t *w, uint32_t len, uint32_t seed, uint32_t *out )
+{
+   VU key, k;
+   uint32_t i;
+
+   key = (VU){0} + seed;
+   for( i = 0; i < len / 4; ++i ) {
+      LANE_LOAD(k, i);
+      key += k;
+      BATCH_TWMX_MIX(key);
+   }
+   // remaining bytes, zero padded
+   LANE_LOAD(k, i);
+   key += k;
+   BATCH_TWMX_MIX(key);
+
+   LANE_STORE(key);
+}
+
+static const batch_kernels_t LANE_NAME(lane_kernels_) = {
+   LANES,
+   { LANE_NAME(bob_lanes_)
+   , LANE_NAME(oaat_lanes_)
+   , LANE_NAME(twmx_lanes_) }
+};
+
+#undef VU
+#undef LANE_LOAD
+#undef LANE_STORE
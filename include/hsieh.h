@@ -6,5 +6,21 @@
 
 #ifndef HSIEH_H_
 #define HSIEH_H_
-uint32_t Hsieh_Hash(const char * data, uint16_t len);
+#include <inttypes.h>
+
+uint32_t Hsieh_Hash(const char * data, uint16_t len, uint32_t seed);
+
+/* incremental variant; the total key length seeds the hash, so it has
+ * to be known up front. The seed is mixed into the initial value, 0
+ * gives the original hash */
+typedef struct hsieh_state_s {
+   uint32_t hash;
+   uint16_t length;  /* announced key length */
+   uint16_t fill;    /* bytes pending in tail */
+   char     tail[4];
+} hsieh_state_t;
+
+void     Hsieh_Hash_init(hsieh_state_t *state, uint16_t len, uint32_t seed);
+void     Hsieh_Hash_update(hsieh_state_t *state, const char *data, uint32_t len);
+uint32_t Hsieh_Hash_final(hsieh_state_t *state);
 #endif /*HSIEH_H_*/
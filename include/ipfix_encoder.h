@@ -0,0 +1,186 @@
+/*
+ * impd4e - a small network probe which allows to monitor and sample datagrams
+ * from the network based on hash-based packet selection.
+ *
+ * Copyright (c) 2011
+ *
+ * Fraunhofer FOKUS
+ * www.fokus.fraunhofer.de
+ *
+ * in cooperation with
+ *
+ * Technical University Berlin
+ * www.av.tu-berlin.de
+ *
+ * authors:
+ * Ramon Masek <ramon.masek@fokus.fraunhofer.de>
+ * Christian Henke <c.henke@tu-berlin.de>
+ * Carsten Schmoll <carsten.schmoll@fokus.fraunhofer.de>
+ *
+ * For questions/comments contact packettracking@fokus.fraunhofer.de
+ *
+ * This program is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software Foundation;
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _IPFIX_ENCODER_H_
+#define _IPFIX_ENCODER_H_
+
+#include <stdint.h>
+
+#include "ipfix.h"  // export_fields_t
+
+// -----------------------------------------------------------------------------
+// Type definitions
+// -----------------------------------------------------------------------------
+
+#define IPFIX_MESSAGE_SIZE  1400  /*!< default ipfix message size (fits into an ethernet MTU) */
+#define IPFIX_MESSAGE_MAX   65535 /*!< max ipfix message size (length field) */
+#define IPFIX_HEADER_SIZE     16
+#define IPFIX_SET_HEADER_SIZE  4
+#ifndef IPFIX_SETID_TEMPLATE
+#define IPFIX_SETID_TEMPLATE   2
+#endif
+#ifndef IPFIX_FT_VARLEN
+#define IPFIX_FT_VARLEN    65535
+#endif
+
+/**
+ * packet id record; the union of the fields of the
+ * MINT_ID, TS_ID, TS_TTL_PROTO_ID and TS_TTL_PROTO_IP(6)_ID templates
+ * (host byte order, except for the addresses); IPv4 addresses use the
+ * first 4 bytes
+ */
+typedef struct pktid_record {
+   uint64_t timestamp;   // observationTimeMicroseconds
+   uint32_t hash_id;     // digestHashValue
+   uint16_t length;      // totalLengthIPv4, payloadLengthIPv6
+   uint16_t src_port;
+   uint16_t dst_port;
+   uint8_t  ttl;
+   uint8_t  protocol;
+   uint8_t  ip_version;
+   uint8_t  src_ipa[16]; // network byte order
+   uint8_t  dst_ipa[16]; // network byte order
+   uint8_t  template_id; // template_id_t; set for the export ring
+   uint8_t  tunnel_type; // pt_tunnel_type
+   uint16_t vlan_id;     // vlanId
+   uint32_t mpls_label;  // mplsTopLabelStackSection (24 bit)
+   uint32_t tunnel_id;   // pt_tunnel_id
+} pktid_record_t;
+
+/**
+ * flow record of the FLOW_ID and FLOW6_ID templates (host byte order,
+ * except for the addresses); times in microseconds
+ */
+typedef struct flow_record {
+   uint64_t first;       // flowStartMilliseconds
+   uint64_t last;        // flowEndMilliseconds
+   uint64_t packets;     // packetDeltaCount
+   uint64_t bytes;       // octetDeltaCount
+   uint8_t  src_ipa[16]; // network byte order
+   uint8_t  dst_ipa[16]; // network byte order
+   uint16_t src_port;
+   uint16_t dst_port;
+   uint8_t  protocol;
+   uint8_t  ip_version;  // selects the template
+   uint8_t  end_reason;  // flowEndReason
+} flow_record_t;
+
+/**
+ * counters of a collector; the back-pressure shows in queued and blocked
+ */
+typedef struct collector_stats {
+   uint64_t messages;  // messages sent completely
+   uint64_t bytes;     // bytes sent
+   uint64_t blocked;   // sends which would have blocked
+   uint64_t dropped;   // messages lost (no spool, connection closed)
+   uint64_t spooled;   // messages put into the spool
+   uint64_t replayed;  // messages sent from the spool
+   uint32_t queued;    // bytes waiting in the queue
+} collector_stats_t;
+
+struct options;
+struct pollfd;
+
+// -----------------------------------------------------------------------------
+// Prototypes
+// -----------------------------------------------------------------------------
+
+// precompile the record layouts; the templates must be registered before
+void ipfix_encoder_init();
+
+// fields of a template; used to (re)send the template sets
+void ipfix_encoder_add_template( int template_id, const export_fields_t* fields, int nfields );
+
+// collectors (in option order) and the distribution mode; the encoder
+// connects to them itself
+void ipfix_encoder_set_collectors( struct options* options );
+
+// socket of the collector (index) at the last ipfix_encoder_take(); -1 if
+// not connected
+int  ipfix_encoder_collector_fd( int index );
+
+// counters of a collector (index); -1 if there is no such collector
+int  ipfix_encoder_collector_stats( int index, const char** host, int* port
+      , collector_stats_t* stats );
+
+// max size of a message; the messages are packed up to this size
+void ipfix_encoder_set_message_size( uint16_t size );
+
+// resend the template sets of all templates; required periodically for udp
+void ipfix_encoder_send_templates();
+
+// append a record of the given template (template_id_t) to the message buffer
+int  ipfix_encode_record( int template_id, const pktid_record_t* record );
+
+// append a flow record; the hash partitions the flows among the collectors
+int  ipfix_encode_flow( const flow_record_t* flow, uint32_t hash );
+
+// append a record of any template, like ipfix_export_array(); sent to all
+// collectors with the next flush
+int  ipfix_encode_array( ipfix_template_t* t, int nfields, void** fields, uint16_t* lengths );
+
+// move the buffered messages into the outboxes of the collectors; they
+// are sent by the exporter thread
+void ipfix_encoder_flush();
+
+/*
+ * The functions below are called by the exporter thread only; the
+ * exporter lock is held for ipfix_encoder_take() only.
+ */
+
+// take the outboxes for ipfix_encoder_send(); publishes the counters
+void ipfix_encoder_take();
+
+// send the taken messages and the queued data, spool what cannot be sent,
+// and reconnect the collectors which are due; does not block
+void ipfix_encoder_send();
+
+/**
+ * the sockets (max MAX_COLLECTORS) which wait for POLLOUT: pending connects
+ * and queues which the socket did not take; *timeout (ms, -1 for none) is
+ * lowered to the next connection attempt. Returns the number of sockets.
+ */
+int  ipfix_encoder_poll( struct pollfd* fds, int* timeout );
+
+// 1 if a connected collector has data in its queue
+int  ipfix_encoder_queued();
+
+// close the connections; the queued messages go to the spool
+void ipfix_encoder_close();
+
+// resend spooled messages (oldest first) up to max_bytes; returns the bytes sent
+uint32_t ipfix_encoder_replay( uint32_t max_bytes );
+
+#endif /* _IPFIX_ENCODER_H_*/
+
@@ -63,6 +63,16 @@ typedef enum template_id_u{
       , TS_ID
       , TS_TTL_PROTO_ID
       , TS_TTL_PROTO_IP_ID
+      , FLOW_ID
+      // IPv6 variants; chosen per packet (per flow) by the address family
+      , TS_TTL_PROTO_IP6_ID
+      , FLOW6_ID
+      // "ls" with the VLAN id and the top MPLS label
+      , TS_TTL_PROTO_IP_LINK_ID
+      , TS_TTL_PROTO_IP6_LINK_ID
+      // PSAMP selector report
+      , SELECTOR_ID
+      , TEMPLATE_COUNT // not a template
 }
 template_id_t;
 
@@ -70,6 +80,8 @@ template_id_t;
 #define TS_TTL_RROTO_NAME     "lp"
 #define TS_NAME               "ts"
 #define TS_TTL_RROTO_IP_NAME  "ls"
+#define FLOW_NAME             "flow"
+#define TS_TTL_PROTO_IP_LINK_NAME "lsl"
 
 
 
@@ -41,6 +41,19 @@
 
 
 
+/*
+ * probe internal information elements; registered in addition to the
+ * FOKUS elements of libipfix (ipfix_ft_fokus). The numbers are taken from
+ * the top of the 15 bit range, far above the FOKUS assigned ones;
+ * libipfix_init() refuses to start if ipfix_ft_fokus uses one of them.
+ */
+#define IPFIX_FT_PT_EXPORT_RING_FILL 0x4000
+#define IPFIX_FT_PT_TUNNEL_TYPE      0x4001
+#define IPFIX_FT_PT_TUNNEL_ID        0x4002
+
+// defined in ipfix_handler.c
+extern ipfix_field_type_t ipfix_ft_impd4e[];
+
 /* help macros */
 #define IPFIX_MAKE_TEMPLATE(handle,template,fields) \
 	ipfix_make_template(handle, &(template), fields, sizeof(fields) / sizeof(export_fields_t) )
@@ -107,6 +120,99 @@ export_fields_t export_fields_ts_ttl_proto_ip[] = {
     { 0, IPFIX_FT_DESTINATIONTRANSPORTPORT, 2},
 };
 
+/*
+ * "-t ls" for IPv6 packets
+ */
+export_fields_t export_fields_ts_ttl_proto_ip6[] = {
+    { 0, IPFIX_FT_OBSERVATIONTIMEMICROSECONDS, 8},
+    { 0, IPFIX_FT_DIGESTHASHVALUE, 4},
+    { 0, IPFIX_FT_IPTTL, 1},
+    { 0, IPFIX_FT_PAYLOADLENGTHIPV6, 2},
+    { 0, IPFIX_FT_PROTOCOLIDENTIFIER, 1},
+    { 0, IPFIX_FT_IPVERSION, 1},
+    { 0, IPFIX_FT_SOURCEIPV6ADDRESS, 16},
+    { 0, IPFIX_FT_SOURCETRANSPORTPORT, 2},
+    { 0, IPFIX_FT_DESTINATIONIPV6ADDRESS, 16},
+    { 0, IPFIX_FT_DESTINATIONTRANSPORTPORT, 2},
+};
+
+/*
+ * when invoked with "-t lsl" the fields of "-t ls" and the link layer
+ * tags and the tunnel (-E) are exported in each IPFIX data record
+ * (0 if untagged):
+ */
+export_fields_t export_fields_ts_ttl_proto_ip_link[] = {
+    { 0, IPFIX_FT_OBSERVATIONTIMEMICROSECONDS, 8},
+    { 0, IPFIX_FT_DIGESTHASHVALUE, 4},
+    { 0, IPFIX_FT_IPTTL, 1},
+    { 0, IPFIX_FT_TOTALLENGTHIPV4, 2},
+    { 0, IPFIX_FT_PROTOCOLIDENTIFIER, 1},
+    { 0, IPFIX_FT_IPVERSION, 1},
+    { 0, IPFIX_FT_SOURCEIPV4ADDRESS, 4},
+    { 0, IPFIX_FT_SOURCETRANSPORTPORT, 2},
+    { 0, IPFIX_FT_DESTINATIONIPV4ADDRESS, 4},
+    { 0, IPFIX_FT_DESTINATIONTRANSPORTPORT, 2},
+    { 0, IPFIX_FT_VLANID, 2},
+    { 0, IPFIX_FT_MPLSTOPLABELSTACKSECTION, 3},
+    { IPFIX_ENO_FOKUS, IPFIX_FT_PT_TUNNEL_TYPE, 1},
+    { IPFIX_ENO_FOKUS, IPFIX_FT_PT_TUNNEL_ID, 4},
+};
+
+/*
+ * "-t lsl" for IPv6 packets
+ */
+export_fields_t export_fields_ts_ttl_proto_ip6_link[] = {
+    { 0, IPFIX_FT_OBSERVATIONTIMEMICROSECONDS, 8},
+    { 0, IPFIX_FT_DIGESTHASHVALUE, 4},
+    { 0, IPFIX_FT_IPTTL, 1},
+    { 0, IPFIX_FT_PAYLOADLENGTHIPV6, 2},
+    { 0, IPFIX_FT_PROTOCOLIDENTIFIER, 1},
+    { 0, IPFIX_FT_IPVERSION, 1},
+    { 0, IPFIX_FT_SOURCEIPV6ADDRESS, 16},
+    { 0, IPFIX_FT_SOURCETRANSPORTPORT, 2},
+    { 0, IPFIX_FT_DESTINATIONIPV6ADDRESS, 16},
+    { 0, IPFIX_FT_DESTINATIONTRANSPORTPORT, 2},
+    { 0, IPFIX_FT_VLANID, 2},
+    { 0, IPFIX_FT_MPLSTOPLABELSTACKSECTION, 3},
+    { IPFIX_ENO_FOKUS, IPFIX_FT_PT_TUNNEL_TYPE, 1},
+    { IPFIX_ENO_FOKUS, IPFIX_FT_PT_TUNNEL_ID, 4},
+};
+
+/*
+ * when invoked with "-t flow" the selected packets are aggregated in the
+ * flow cache; the following fields are exported for each flow:
+ */
+export_fields_t export_fields_flow[] = {
+    { 0, IPFIX_FT_FLOWSTARTMILLISECONDS, 8},
+    { 0, IPFIX_FT_FLOWENDMILLISECONDS, 8},
+    { 0, IPFIX_FT_SOURCEIPV4ADDRESS, 4},
+    { 0, IPFIX_FT_SOURCETRANSPORTPORT, 2},
+    { 0, IPFIX_FT_DESTINATIONIPV4ADDRESS, 4},
+    { 0, IPFIX_FT_DESTINATIONTRANSPORTPORT, 2},
+    { 0, IPFIX_FT_PROTOCOLIDENTIFIER, 1},
+    { 0, IPFIX_FT_IPVERSION, 1},
+    { 0, IPFIX_FT_PACKETDELTACOUNT, 8},
+    { 0, IPFIX_FT_OCTETDELTACOUNT, 8},
+    { 0, IPFIX_FT_FLOWENDREASON, 1},
+};
+
+/*
+ * "-t flow" for IPv6 flows
+ */
+export_fields_t export_fields_flow6[] = {
+    { 0, IPFIX_FT_FLOWSTARTMILLISECONDS, 8},
+    { 0, IPFIX_FT_FLOWENDMILLISECONDS, 8},
+    { 0, IPFIX_FT_SOURCEIPV6ADDRESS, 16},
+    { 0, IPFIX_FT_SOURCETRANSPORTPORT, 2},
+    { 0, IPFIX_FT_DESTINATIONIPV6ADDRESS, 16},
+    { 0, IPFIX_FT_DESTINATIONTRANSPORTPORT, 2},
+    { 0, IPFIX_FT_PROTOCOLIDENTIFIER, 1},
+    { 0, IPFIX_FT_IPVERSION, 1},
+    { 0, IPFIX_FT_PACKETDELTACOUNT, 8},
+    { 0, IPFIX_FT_OCTETDELTACOUNT, 8},
+    { 0, IPFIX_FT_FLOWENDREASON, 1},
+};
+
 export_fields_t export_fields_interface_stats[] = {
     { 0, IPFIX_FT_OBSERVATIONTIMEMILLISECONDS, 8},
     { 0, IPFIX_FT_SAMPLINGSIZE, 4},
@@ -115,6 +221,9 @@ export_fields_t export_fields_interface_stats[] = {
     { IPFIX_ENO_FOKUS, IPFIX_FT_PT_PCAPSTAT_DROP, 4}, /* PFIX_CODING_UINT, "pcap_drop",  "number of packets dropped by pcap"  }, */
     { IPFIX_ENO_FOKUS, IPFIX_FT_PT_INTERFACE_NAME, 65535},
     { IPFIX_ENO_FOKUS, IPFIX_FT_PT_INTERFACE_DESCRIPTION, 65535},
+    /* appended; the fields above keep their positions for existing collectors */
+    { IPFIX_ENO_FOKUS, IPFIX_FT_PT_EXPORT_RING_FILL, 4},
+    { 0, IPFIX_FT_NOTSENTPACKETTOTALCOUNT, 8}, /* records dropped, the export ring was full */
 };
 
 export_fields_t export_fields_probe_stats[] = {
@@ -128,6 +237,38 @@ export_fields_t export_fields_probe_stats[] = {
     { IPFIX_ENO_FOKUS, IPFIX_FT_PT_SYSTEM_MEM_TOTAL, 8}, /* IPFIX_CODING_UINT,  "sys_mem_total",  "PT system total memory in kilobytes"  }, */
 };
 
+/*
+ * PSAMP selector report (RFC 5476, RFC 5477), with the interface stats; one
+ * record per interface, for the hash selector one per selected range.
+ * The fields of other selectors are 0.
+ *
+ * selectorId = interface * SELECTION_RANGES + 1 + range, with the position
+ * of the interface on the command line (-i) and the position of the range
+ * in its selection (0 for the other selectors), both counted from 0. The
+ * ids are positional: they change if the interfaces are given in another
+ * order, and the ranges are kept sorted by their lower bound and merged,
+ * so a new range (-H, or the config channel) can move the ranges above it.
+ * A collector has to take the range from the hashSelectedRangeMin/Max
+ * fields of each report, not from an earlier one with the same id.
+ */
+export_fields_t export_fields_selector[] = {
+    { 0, IPFIX_FT_OBSERVATIONTIMEMILLISECONDS, 8},
+    { 0, IPFIX_FT_SELECTORID, 8},
+    { 0, IPFIX_FT_SELECTORALGORITHM, 2},
+    { 0, IPFIX_FT_SAMPLINGPACKETINTERVAL, 4},
+    { 0, IPFIX_FT_SAMPLINGPACKETSPACE, 4},
+    { 0, IPFIX_FT_SAMPLINGTIMEINTERVAL, 4},
+    { 0, IPFIX_FT_SAMPLINGTIMESPACE, 4},
+    { 0, IPFIX_FT_SAMPLINGSIZE, 4},
+    { 0, IPFIX_FT_SAMPLINGPOPULATION, 4},
+    { 0, IPFIX_FT_HASHSELECTEDRANGEMIN, 4},
+    { 0, IPFIX_FT_HASHSELECTEDRANGEMAX, 4},
+    { 0, IPFIX_FT_HASHINITIALISERVALUE, 4},
+    { 0, IPFIX_FT_SELECTORIDTOTALPKTSOBSERVED, 8},
+    { 0, IPFIX_FT_SELECTORIDTOTALPKTSSELECTED, 8},
+    { IPFIX_ENO_FOKUS, IPFIX_FT_PT_INTERFACE_NAME, 65535},
+};
+
 export_fields_t export_fields_location[] = {
     { 0, IPFIX_FT_OBSERVATIONTIMEMILLISECONDS, 8},
     { 0, IPFIX_FT_SOURCEIPV4ADDRESS, 4},
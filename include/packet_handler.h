@@ -36,6 +36,7 @@
 #define _PACKET_HANDLER_H_
 
 #include "ev_handler.h"
+#include "constants.h"
 
 #ifndef PFRING
 void handle_packet(u_char *user_args, const struct pcap_pkthdr *header, const u_char * packet);
@@ -43,6 +44,18 @@ void handle_packet(u_char *user_args, const struct pcap_pkthdr *header, const u_
 
 void packet_watcher_cb(EV_P_ ev_watcher *w, int revents);
 
+// generic ip packet handler; evaluates the configuration per packet
+void handle_ip_packet(packet_t *packet, packet_info_t *packet_info);
+
+// select the specialised ip packet handler of each device; call again
+// after the selection function, hash function or template changed
+void packet_path_configure();
+
+// packets handled between begin and end are hashed together (-F <f>:batch);
+// the capture buffer has to stay valid until packet_burst_end()
+void packet_burst_begin(device_dev_t *device);
+void packet_burst_end(device_dev_t *device);
+
 #ifdef PFRING
 void packet_pfring_cb(u_char *user_args, const struct pfring_pkthdr *header,
         const u_char *packet);
@@ -50,6 +50,10 @@
 void open_pcap_file(device_dev_t* if_dev, options_t *options);
 
 void open_pcap(device_dev_t* if_dev, options_t *options);
+void open_pcap_capture(device_dev_t* if_dev, options_t *options);
+
+// print achieved packet rate of pcap file replays
+void pcap_replay_report();
 
 #endif /* PFRING */
 
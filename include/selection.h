@@ -0,0 +1,91 @@
+/*
+ * impd4e - a small network probe which allows to monitor and sample datagrams
+ * from the network based on hash-based packet selection.
+ *
+ * Copyright (c) 2011
+ *
+ * Fraunhofer FOKUS
+ * www.fokus.fraunhofer.de
+ *
+ * in cooperation with
+ *
+ * Technical University Berlin
+ * www.av.tu-berlin.de
+ *
+ * authors:
+ * Ramon Masek <ramon.masek@fokus.fraunhofer.de>
+ * Christian Henke <c.henke@tu-berlin.de>
+ * Carsten Schmoll <carsten.schmoll@fokus.fraunhofer.de>
+ *
+ * For questions/comments contact packettracking@fokus.fraunhofer.de
+ *
+ * This program is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software Foundation;
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifndef _SELECTION_H_
+#define _SELECTION_H_
+
+#include <stdint.h>
+
+#include "constants.h"
+
+// -----------------------------------------------------------------------------
+// Prototypes
+// -----------------------------------------------------------------------------
+
+void   selection_clear( selection_t* s );
+
+// add [min, max]; overlapping and adjacent ranges are merged;
+// -1 if SELECTION_RANGES are used up
+int    selection_add( selection_t* s, uint32_t min, uint32_t max );
+
+// ranges "<min>-<max>[,<min>-<max>...]" (hex|int); -1 on error
+int    selection_parse( selection_t* s, const char* arg );
+
+// selected part of the hash space in %
+double selection_ratio( const selection_t* s );
+
+// make 's' the selection of the device and its workers
+void   selection_publish( device_dev_t* dev, const selection_t* s );
+
+// the global selection (-H, -m, -M, -r) to all devices without an own one
+void   selection_publish_global();
+
+// device given by name; NULL if unknown
+device_dev_t* selection_device( const char* name );
+
+/**
+ * hash id selected? One bitmap lookup on the top 8 bits for most ids, a
+ * branchless check of the ranges for the buckets with a range boundary
+ */
+static inline int selection_match( const selection_t* s, uint32_t hash_id ) {
+   uint32_t b   = hash_id >> 24;
+   uint64_t bit = 1ull << (b & 63);
+   uint32_t i;
+   int      match = 0;
+
+   if( s->full[b >> 6] & bit ) {
+      return 1;
+   }
+   if( !(s->partial[b >> 6] & bit) ) {
+      return 0;
+   }
+   for( i = 0; i < s->count; ++i ) {
+      match |= (hash_id - s->min[i]) <= s->span[i];
+   }
+   return match;
+}
+
+#endif /* _SELECTION_H_*/
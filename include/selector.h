@@ -0,0 +1,106 @@
+/*
+ * impd4e - a small network probe which allows to monitor and sample datagrams
+ * from the network based on hash-based packet selection.
+ *
+ * Copyright (c) 2011
+ *
+ * Fraunhofer FOKUS
+ * www.fokus.fraunhofer.de
+ *
+ * in cooperation with
+ *
+ * Technical University Berlin
+ * www.av.tu-berlin.de
+ *
+ * authors:
+ * Ramon Masek <ramon.masek@fokus.fraunhofer.de>
+ * Christian Henke <c.henke@tu-berlin.de>
+ * Carsten Schmoll <carsten.schmoll@fokus.fraunhofer.de>
+ *
+ * For questions/comments contact packettracking@fokus.fraunhofer.de
+ *
+ * This program is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software Foundation;
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifndef _SELECTOR_H_
+#define _SELECTOR_H_
+
+#include <stdint.h>
+
+#include "constants.h"
+#include "settings.h" // g_options
+
+// -----------------------------------------------------------------------------
+// Prototypes
+// -----------------------------------------------------------------------------
+
+// "hash", "count:<N>", "count:<interval>:<space>", "time:<interval>:<space>",
+// "random:<n>:<N>"; -1 on error
+int  selector_parse( options_t* options, const char* arg );
+
+// per device state of the selectors
+void selector_init_device( device_dev_t* dev );
+
+// PSAMP selectorAlgorithm of the configuration (RFC 5477)
+uint16_t selector_algorithm();
+
+static inline uint32_t selector_xorshift( uint32_t* state ) {
+   uint32_t x = *state;
+   x ^= x << 13;
+   x ^= x >> 17;
+   x ^= x << 5;
+   return *state = x;
+}
+
+/**
+ * systematic and random selection (-U); no look at the packet content.
+ *  - count:  the first <interval> of every <interval>+<space> packets
+ *  - time:   packets in the first <interval> usec of every <interval>+<space>
+ *            usec, counted from the epoch, so probes select the same windows
+ *  - random: n of every N packets; each subset of n equally likely
+ *            (selection sampling, Knuth's algorithm S)
+ */
+static inline int selector_match( device_dev_t* dev, const packet_info_t* info ) {
+   uint32_t pos;
+
+   switch( g_options.selector ) {
+   case SELECTOR_COUNT:
+      pos = dev->selector_position;
+      dev->selector_position = (pos + 1 == g_options.selector_period)? 0 : pos + 1;
+      return pos < g_options.selector_interval;
+
+   case SELECTOR_TIME:
+      return ((uint64_t) info->ts.tv_sec * 1000000 + info->ts.tv_usec)
+            % g_options.selector_period < g_options.selector_interval;
+
+   case SELECTOR_RANDOM:
+   {
+      uint32_t left   = g_options.selector_period - dev->selector_position;
+      uint32_t needed = g_options.selector_interval - dev->selector_chosen;
+      int      match  = selector_xorshift(&dev->selector_random) % left < needed;
+
+      dev->selector_chosen += match;
+      if( ++dev->selector_position == g_options.selector_period ) {
+         dev->selector_position = 0;
+         dev->selector_chosen   = 0;
+      }
+      return match;
+   }
+   default:
+      return 1;
+   }
+}
+
+#endif /* _SELECTOR_H_*/
@@ -48,8 +48,12 @@ typedef struct options
 	uint8_t  number_interfaces;
 	uint32_t templateID;
         uint32_t offset;
-	char     collectorIP[256];
-	int16_t  collectorPort;
+	collector_addr_t collectors[MAX_COLLECTORS];
+	uint8_t  number_collectors;
+	int16_t  collectorPort;  // default port
+	distribution_t distribution;
+	int      collectorProto; // IPFIX_PROTO_TCP|UDP|SCTP
+	uint16_t path_mtu;
 	char*    bpf; // berkley packet filter
     #ifdef PFRING
     filtering_rule rules[MAX_RULES];
@@ -59,12 +63,21 @@ typedef struct options
 	int               ai_family;
 	uint32_t          observationDomainID;
 	uint32_t          ipAddress; // network byte order
-	hashFunction      hash_function;
-	hashFunction      pktid_function;
+	hash_ctx_t        hash_function;
+	int               hash_batch;  // hash bursts in SIMD lanes (-F <f>:batch)
+	hash_ctx_t        pktid_function;
 	selectionFunction selection_function;
 	uint32_t sel_range_min;
 	uint32_t sel_range_max;
+	selection_t selection;        // -H; if empty: sel_range_min, sel_range_max
 	uint16_t snapLength;
+	replay_mode_t replay_mode;
+	double   replay_speed;
+	uint32_t tpacket_ring_size;
+	uint32_t tpacket_block_size;
+	uint32_t tpacket_block_timeout;
+	uint8_t  workers;
+	fanout_mode_t fanout_mode;
 	uint8_t  verbosity;
 	char*    verbosity_filter_string;
 	uint32_t export_packet_count;
@@ -80,6 +93,23 @@ typedef struct options
 	double export_sampling_interval;
 	double export_stats_interval;
 	double export_location_interval;
+	double template_refresh_interval;
+	char*    spool_file; // NULL: no spool
+	uint64_t spool_size; // bytes
+	uint32_t spool_rate; // replay rate in bytes/s
+	uint32_t decapsulation;       // tunnel_t flags (-E)
+	uint32_t fragment_policy;     // fragment_policy_t (-g)
+	uint32_t fragment_table_size; // entries
+	double   adaptive_min_ratio;  // % (-b); 0: fixed selection range
+	double   adaptive_max_ratio;  // %
+	double   adaptive_interval;   // sec
+	double   adaptive_cpu_limit;  // % CPU per capture thread
+	uint32_t selector;            // selector_t (-U)
+	uint32_t selector_interval;   // packets or usec selected; random: n
+	uint32_t selector_period;     // interval + space; random: N
+	uint32_t flow_cache_size;     // entries
+	double   flow_active_timeout; // sec
+	double   flow_idle_timeout;   // sec
 	int hashAsPacketID;
 	int use_oid_first_interface;
 } options_t;
@@ -94,10 +124,13 @@ inline options_t* getOptions();
 int set_sampling_ratio(options_t *options, char* value);
 int set_sampling_lowerbound(options_t *options, char* value);
 int set_sampling_upperbound(options_t *options, char* value);
+int set_selection_ranges(options_t *options, char* value);
+uint32_t set_hash_seed(options_t *options, char* value);
 
 int parse_template(char *arg_string);
 void parseSelFunction(char *arg_string, options_t *options);
 hashFunction parseFunction(char *arg_string);
+hashFunction lookupFunction(char *arg_string);
 
 void print_help();
 void parse_cmdline(int argc, char **argv);
@@ -0,0 +1,77 @@
+/*
+ * impd4e - a small network probe which allows to monitor and sample datagrams
+ * from the network based on hash-based packet selection.
+ *
+ * Copyright (c) 2011
+ *
+ * Fraunhofer FOKUS
+ * www.fokus.fraunhofer.de
+ *
+ * in cooperation with
+ *
+ * Technical University Berlin
+ * www.av.tu-berlin.de
+ *
+ * authors:
+ * Ramon Masek <ramon.masek@fokus.fraunhofer.de>
+ * Christian Henke <c.henke@tu-berlin.de>
+ * Carsten Schmoll <carsten.schmoll@fokus.fraunhofer.de>
+ *
+ * For questions/comments contact packettracking@fokus.fraunhofer.de
+ *
+ * This program is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software Foundation;
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _SPOOL_H_
+#define _SPOOL_H_
+
+#include <stdint.h>
+
+// -----------------------------------------------------------------------------
+// Type definitions
+// -----------------------------------------------------------------------------
+
+#define SPOOL_HEADER_SIZE 4096 /*!< header page of the spool file */
+
+// -----------------------------------------------------------------------------
+// Prototypes
+// -----------------------------------------------------------------------------
+
+/**
+ * map the spool file; an existing spool of the same size is kept and
+ * replayed, otherwise the file is (re)initialised. size in bytes.
+ */
+int  spool_open( const char* path, uint64_t size );
+void spool_close();
+
+// 1 if a spool is open
+int  spool_enabled();
+
+/**
+ * append an encoded ipfix message for the given collector (index);
+ * the oldest messages are overwritten if the spool is full
+ */
+int  spool_append( uint8_t collector, const uint8_t* data, uint16_t len );
+
+// number of spooled messages
+uint64_t spool_pending();
+
+/**
+ * oldest message of the spool (a copy); NULL if empty.
+ * The message stays in the spool until spool_release().
+ */
+const uint8_t* spool_peek( uint8_t* collector, uint16_t* len );
+void spool_release();
+
+#endif /* _SPOOL_H_*/
@@ -77,6 +77,7 @@ struct probe_stat {
 
 };
 int get_probe_stats(struct probe_stat *stats );
+int get_process_cpu(float *percent);
 
 
 #endif /* STAT_H_ */
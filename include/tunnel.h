@@ -0,0 +1,66 @@
+/*
+ * impd4e - a small network probe which allows to monitor and sample datagrams
+ * from the network based on hash-based packet selection.
+ *
+ * Copyright (c) 2011
+ *
+ * Fraunhofer FOKUS
+ * www.fokus.fraunhofer.de
+ *
+ * in cooperation with
+ *
+ * Technical University Berlin
+ * www.av.tu-berlin.de
+ *
+ * authors:
+ * Ramon Masek <ramon.masek@fokus.fraunhofer.de>
+ * Christian Henke <c.henke@tu-berlin.de>
+ * Carsten Schmoll <carsten.schmoll@fokus.fraunhofer.de>
+ *
+ * For questions/comments contact packettracking@fokus.fraunhofer.de
+ *
+ * This program is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software Foundation;
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifndef _TUNNEL_H_
+#define _TUNNEL_H_
+
+#include <stdint.h>
+
+#include "constants.h"
+
+// -----------------------------------------------------------------------------
+// Type definitions
+// -----------------------------------------------------------------------------
+
+#define VXLAN_PORT 4789 /*!< IANA assigned udp port of VXLAN */
+#define GTPU_PORT  2152 /*!< udp port of GTP-U */
+
+// -----------------------------------------------------------------------------
+// Prototypes
+// -----------------------------------------------------------------------------
+
+/**
+ * locate the inner ip header of a tunnel of the given types (tunnel_t
+ * flags); the packet is advanced to the inner header and the tunnel type
+ * and id (GRE key, VNI, TEID) are set in the packet info.
+ * returns 1 if the packet was decapsulated, 0 otherwise (unchanged)
+ */
+int tunnel_decapsulate( packet_t* packet, packet_info_t* info, uint32_t types );
+
+// parse a comma separated list of tunnel types; -1 if invalid
+int tunnel_parse_types( const char* arg );
+
+#endif /* _TUNNEL_H_*/
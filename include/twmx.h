@@ -10,4 +10,15 @@
 #include <inttypes.h>
 
 uint32_t TWMXHash(uint8_t *data, uint32_t length, uint32_t initval);
+
+/* incremental variant of TWMXHash() over a key given in pieces */
+typedef struct twmx_state_s {
+   uint32_t key;
+   uint32_t fill;    /* bytes pending in tail */
+   uint8_t  tail[4];
+} twmx_state_t;
+
+void     TWMXHash_init(twmx_state_t *state, uint32_t initval);
+void     TWMXHash_update(twmx_state_t *state, const uint8_t *data, uint32_t length);
+uint32_t TWMXHash_final(twmx_state_t *state);
 #endif /*TWMX_H_*/
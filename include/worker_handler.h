@@ -0,0 +1,78 @@
+/*
+ * impd4e - a small network probe which allows to monitor and sample datagrams
+ * from the network based on hash-based packet selection.
+ *
+ * Copyright (c) 2011
+ *
+ * Fraunhofer FOKUS
+ * www.fokus.fraunhofer.de
+ *
+ * in cooperation with
+ *
+ * Technical University Berlin
+ * www.av.tu-berlin.de
+ *
+ * authors:
+ * Ramon Masek <ramon.masek@fokus.fraunhofer.de>
+ * Christian Henke <c.henke@tu-berlin.de>
+ * Carsten Schmoll <carsten.schmoll@fokus.fraunhofer.de>
+ *
+ * For questions/comments contact packettracking@fokus.fraunhofer.de
+ *
+ * This program is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software Foundation;
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _WORKER_HANDLER_H_
+#define _WORKER_HANDLER_H_
+
+
+#include <ev.h>
+
+#include "constants.h"
+#include "settings.h"
+
+// -----------------------------------------------------------------------------
+// Type definitions
+// -----------------------------------------------------------------------------
+
+
+// -----------------------------------------------------------------------------
+// Prototypes
+// -----------------------------------------------------------------------------
+
+#ifdef HAVE_PACKET_FANOUT
+// open n capture workers for the device instead of a single capture
+void open_workers(device_dev_t* if_device, options_t *options);
+
+// start/stop the worker threads; called from the main thread
+void workers_start(EV_P);
+void workers_stop();
+
+// add the counters of the workers to the device
+void workers_merge_stats(device_dev_t* if_device);
+int  workers_capture_stats(device_dev_t* if_device, struct pcap_stat* ps);
+void workers_ring_stats(device_dev_t* if_device, uint32_t* fill, uint64_t* drops);
+
+// hand the template, ip packet handler and selection of the device to its workers
+void workers_sync(device_dev_t* if_device);
+
+// wait until no worker reads a selection published before the current one
+void workers_quiesce(device_dev_t* if_device);
+#else
+#define workers_sync(if_device)
+#define workers_quiesce(if_device)
+#endif
+
+
+#endif /* _WORKER_HANDLER_H_*/
+
@@ -0,0 +1,247 @@
+/*
+ * impd4e - a small network probe which allows to monitor and sample datagrams
+ * from the network based on hash-based packet selection.
+ *
+ * Copyright (c) 2011
+ *
+ * Fraunhofer FOKUS
+ * www.fokus.fraunhofer.de
+ *
+ * in cooperation with
+ *
+ * Technical University Berlin
+ * www.av.tu-berlin.de
+ *
+ * authors:
+ * Ramon Masek <ramon.masek@fokus.fraunhofer.de>
+ * Christian Henke <c.henke@tu-berlin.de>
+ * Carsten Schmoll <carsten.schmoll@fokus.fraunhofer.de>
+ *
+ * For questions/comments contact packettracking@fokus.fraunhofer.de
+ *
+ * This program is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software Foundation;
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * adaptive sampling
+ *
+ * Closed loop control of the selection range. A periodic timer looks at
+ * the kernel drops of the capture, the export rings and the CPU usage of
+ * the process; under pressure the selection ratio is halved, after
+ * ADAPTIVE_GROW_TICKS quiet intervals it is doubled again, within the
+ * bounds given with -b.
+ *
+ * The ratios form a fixed ladder (max, max/2, max/4, ... min) and all ranges
+ * start at the same lower bound, so a packet selected at a lower ratio is
+ * selected at every higher one: probes at different levels still select
+ * consistent subsets. The timer fires at multiples of the interval in wall
+ * clock time, so all probes decide at the same instants.
+ *
+ * Every change is announced with a sync record (message value: the new
+ * ratio in parts per million), collectors rescale the counts from there.
+ *
+ * The controller sets the global selection; interfaces with an own one
+ * (@<interface>) keep it.
+ */
+
+#include <stdio.h>   // snprintf
+
+#include "adaptive_sampling.h"
+
+#include "ev_handler.h"
+#include "export_handler.h"
+#include "exporter.h"
+#include "selection.h"
+#include "worker_handler.h"
+
+#include "settings.h" // g_options
+#include "constants.h"
+#include "logger.h"
+#include "stats.h"    // get_process_cpu
+
+// -----------------------------------------------------------------------------
+// Variables
+// -----------------------------------------------------------------------------
+
+static uint32_t range_min   = 0; // common lower bound of all levels
+static int      level       = 0; // ratio = max / 2^level
+static int      level_max   = 0;
+static int      quiet_ticks = 0;
+static uint64_t last_drops  = 0; // kernel
+static uint64_t last_ring_drops = 0;
+
+// -----------------------------------------------------------------------------
+// Functions
+// -----------------------------------------------------------------------------
+
+static double level_ratio(int l) {
+   double ratio = g_options.adaptive_max_ratio / (1 << l);
+   return (ratio < g_options.adaptive_min_ratio)? g_options.adaptive_min_ratio : ratio;
+}
+
+/** kernel drops of a device since the start; 0 if unknown */
+static uint64_t capture_drops(device_dev_t* dev) {
+#ifndef PFRING
+   struct pcap_stat ps;
+   if (0 > get_capture_stats(dev, &ps)) {
+      return 0;
+   }
+   return ps.ps_drop;
+#else
+   pfring_stat ps;
+   if (TYPE_PFRING != dev->device_type ||
+         0 > pfring_stats(dev->device_handle.pfring, &ps)) {
+      return 0;
+   }
+   return ps.drop;
+#endif
+}
+
+/** drops and export ring state summed over all devices */
+static void collect(uint64_t* drops, uint64_t* ring_drops,
+      uint32_t* fill, uint32_t* capacity, int* threads) {
+   int i;
+
+   *drops = *ring_drops = 0;
+   *fill = *capacity = 0;
+   *threads = 0;
+   for (i = 0; i < g_options.number_interfaces; ++i) {
+      device_dev_t* dev = &if_devices[i];
+      uint32_t f = 0;
+      uint64_t d = 0;
+      int      n = 1;
+
+#ifdef HAVE_PACKET_FANOUT
+      if (NULL != dev->workers) {
+         workers_ring_stats(dev, &f, &d);
+         n = g_options.workers;
+      }
+      else
+#endif
+      {
+         f = export_ring_fill(dev->ring);
+         d = dev->ring->drops;
+      }
+      *drops      += capture_drops(dev);
+      *ring_drops += d;
+      *fill       += f;
+      *capacity   += n * EXPORT_RING_SIZE;
+      *threads    += n;
+   }
+}
+
+/** set the selection range of the current level and announce it */
+static void apply(EV_P_ const char* reason) {
+   double ratio = level_ratio(level);
+   char   message[128];
+   int    i;
+
+   g_options.sel_range_max = range_min + (double) UINT32_MAX / 100 * ratio;
+   selection_publish_global();
+
+   snprintf(message, sizeof(message), "INFO: adaptive sampling ratio set: %g%% (%s)"
+         , ratio, reason);
+   LOGGER_info("%s; selection range: %#08x - %#08x", message
+         , g_options.sel_range_min, g_options.sel_range_max);
+
+   for (i = 0; i < g_options.number_interfaces; ++i) {
+      export_data_sync(&if_devices[i]
+            , ev_now(EV_A) * 1000
+            , 0
+            , (uint32_t) (ratio * 10000)
+            , message);
+   }
+}
+
+static void adaptive_sampling_cb(EV_P_ ev_periodic *w, int revents) {
+   uint64_t    drops, ring_drops;
+   uint32_t    fill, capacity;
+   int         threads;
+   float       cpu = 0;
+   const char* reason = NULL;
+
+   collect(&drops, &ring_drops, &fill, &capacity, &threads);
+   if (0 > get_process_cpu(&cpu)) {
+      cpu = 0;
+   }
+
+   if (drops > last_drops) {
+      reason = "kernel drops";
+   }
+   else if (ring_drops > last_ring_drops) {
+      reason = "export ring drops";
+   }
+   else if ((uint64_t) fill * 100 > (uint64_t) capacity * ADAPTIVE_RING_LIMIT) {
+      reason = "export ring fill";
+   }
+   else if (cpu > g_options.adaptive_cpu_limit * threads) {
+      reason = "cpu";
+   }
+   LOGGER_debug("adaptive sampling: drops %lu, ring drops %lu, ring fill %u/%u, cpu %.1f%%"
+         , (unsigned long) (drops - last_drops)
+         , (unsigned long) (ring_drops - last_ring_drops)
+         , fill, capacity, cpu);
+   last_drops      = drops;
+   last_ring_drops = ring_drops;
+
+   if (NULL != reason) {
+      quiet_ticks = 0;
+      if (level < level_max) {
+         ++level;
+         apply(EV_A_ reason);
+      }
+   }
+   else if (ADAPTIVE_GROW_TICKS <= ++quiet_ticks && 0 < level) {
+      quiet_ticks = 0;
+      --level;
+      apply(EV_A_ "recovered");
+   }
+}
+
+void adaptive_sampling_init(EV_P) {
+   double   span_max;
+   uint32_t fill, capacity;
+   int      threads;
+   float    cpu;
+
+   if (0 >= g_options.adaptive_max_ratio) {
+      return;
+   }
+
+   level     = 0;
+   level_max = 0;
+   while (level_ratio(level_max) > g_options.adaptive_min_ratio && level_max < 31) {
+      ++level_max;
+   }
+
+   // the largest range must fit above the common lower bound
+   span_max  = (double) UINT32_MAX / 100 * g_options.adaptive_max_ratio;
+   range_min = g_options.sel_range_min;
+   if (range_min > UINT32_MAX - span_max) {
+      range_min = UINT32_MAX - span_max;
+   }
+   g_options.sel_range_min = range_min;
+   g_options.sel_range_max = range_min + span_max;
+   selection_clear(&g_options.selection);
+   selection_publish_global();
+
+   // counters up to now are not the business of the controller
+   collect(&last_drops, &last_ring_drops, &fill, &capacity, &threads);
+   get_process_cpu(&cpu);
+
+   LOGGER_info("register event timer: adaptive sampling %g%% - %g%%, %d levels"
+         , g_options.adaptive_min_ratio, g_options.adaptive_max_ratio, level_max + 1);
+   event_register_periodic(EV_A_ (watcher_cb_t) adaptive_sampling_cb
+         , g_options.adaptive_interval);
+}
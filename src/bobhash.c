@@ -7,6 +7,7 @@
 
 #include "bobhash.h"
 #include <stdio.h>
+#include <string.h>
 #define hashsize(n) ((ub4)1<<(n))
 #define hashmask(n) (hashsize(n)-1)
 
@@ -127,3 +128,74 @@ uint32_t BOB_Hash(uint8_t *databuffer, uint16_t databufferlength,uint32_t tinitv
 	result = bobhash(databuffer,databufferlength,tinitval);
 	return result;	
 }
+
+/*
+--------------------------------------------------------------------
+incremental interface -- same result as bobhash() over the
+concatenation of all pieces passed to BOB_Hash_update(). Pieces
+that do not fill a 12 byte block are kept in state->tail until
+the next update (or the final call) completes them.
+--------------------------------------------------------------------
+*/
+#define bob_block(s, k) \
+{ \
+   (s)->a += ((k)[0] +((ub4)(k)[1]<<8) +((ub4)(k)[2]<<16) +((ub4)(k)[3]<<24)); \
+   (s)->b += ((k)[4] +((ub4)(k)[5]<<8) +((ub4)(k)[6]<<16) +((ub4)(k)[7]<<24)); \
+   (s)->c += ((k)[8] +((ub4)(k)[9]<<8) +((ub4)(k)[10]<<16)+((ub4)(k)[11]<<24)); \
+   mix((s)->a,(s)->b,(s)->c); \
+}
+
+void BOB_Hash_init(bob_state_t *state, uint32_t tinitval) {
+   state->a = state->b = 0x9e3779b9;
+   state->c = tinitval;
+   state->length = 0;
+   state->fill = 0;
+}
+
+void BOB_Hash_update(bob_state_t *state, const uint8_t *k, uint32_t len) {
+   state->length += len;
+
+   /*------------------------------- complete a pending partial block */
+   if (0 != state->fill) {
+      ub4 n = 12 - state->fill;
+      if (n > len) n = len;
+      memcpy(state->tail + state->fill, k, n);
+      state->fill += n;
+      k += n; len -= n;
+      if (12 > state->fill) return;
+      bob_block(state, state->tail);
+      state->fill = 0;
+   }
+
+   while (len >= 12)
+   {
+      bob_block(state, k);
+      k += 12; len -= 12;
+   }
+
+   memcpy(state->tail, k, len);
+   state->fill = len;
+}
+
+uint32_t BOB_Hash_final(bob_state_t *state) {
+   register ub4 a = state->a, b = state->b, c = state->c;
+   const ub1 *k = state->tail;
+
+   c += state->length;
+   switch(state->fill)      /* all the case statements fall through */
+   {
+   case 11: c+=((ub4)k[10]<<24);
+   case 10: c+=((ub4)k[9]<<16);
+   case 9 : c+=((ub4)k[8]<<8);
+   case 8 : b+=((ub4)k[7]<<24);
+   case 7 : b+=((ub4)k[6]<<16);
+   case 6 : b+=((ub4)k[5]<<8);
+   case 5 : b+=k[4];
+   case 4 : a+=((ub4)k[3]<<24);
+   case 3 : a+=((ub4)k[2]<<16);
+   case 2 : a+=((ub4)k[1]<<8);
+   case 1 : a+=k[0];
+   }
+   mix(a,b,c);
+   return c;
+}
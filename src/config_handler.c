@@ -44,6 +44,12 @@
 
 #include "logger.h"
 #include "netcon.h"
+#include "packet_handler.h"
+#include "worker_handler.h"
+#include "ipfix_handler.h"
+#include "ipfix_encoder.h"
+#include "exporter.h"
+#include "flow_cache.h"
 #include "settings.h"
 #include "helper.h"
 #include "netcon.h"
@@ -77,6 +83,11 @@ char* configuration_set_export_to_pktid(unsigned long mid, char *msg);
 char* configuration_set_min_selection(unsigned long mid, char *msg);
 char* configuration_set_max_selection(unsigned long mid, char *msg);
 char* configuration_set_ratio(unsigned long mid, char *msg);
+char* configuration_set_ranges(unsigned long mid, char *msg);
+char* configuration_set_hash_function(unsigned long mid, char *msg);
+char* configuration_set_hash_seed(unsigned long mid, char *msg);
+char* configuration_get_path_cost(unsigned long mid, char *msg);
+char* configuration_get_collectors(unsigned long mid, char *msg);
 
 set_cfg_fct_t getFunction(char cmd);
 
@@ -105,14 +116,19 @@ void config_handler_init(EV_P) {
 cfg_fct_t configuration_fct[] = {
     { '?', &configuration_help, "INFO: -? this help\n"},
     { 'h', &configuration_help, "INFO: -h this help\n"},
-    { 'r', &configuration_set_ratio, "INFO: -r capturing ratio in %\n"},
-    { 'm', &configuration_set_min_selection, "INFO: -m capturing selection range min (hex|int)\n"},
-    { 'M', &configuration_set_max_selection, "INFO: -M capturing selection range max (hex|int)\n"},
+    { 'r', &configuration_set_ratio, "INFO: -r capturing ratio in %[@<interface>]\n"},
+    { 'm', &configuration_set_min_selection, "INFO: -m capturing selection range min (hex|int)[@<interface>]\n"},
+    { 'M', &configuration_set_max_selection, "INFO: -M capturing selection range max (hex|int)[@<interface>]\n"},
+    { 'H', &configuration_set_ranges, "INFO: -H selection ranges <min>-<max>[,<min>-<max>...][@<interface>]\n"},
     { 'f', &configuration_set_filter, "INFO: -f bpf filter expression\n"},
-    { 't', &configuration_set_template, "INFO: -t template (ts|min|lp)\n"},
+    { 't', &configuration_set_template, "INFO: -t template (ts|min|lp|ls|lsl|flow)\n"},
     { 'I', &configuration_set_export_to_pktid, "INFO: -I pktid export interval (s)\n"},
     { 'J', &configuration_set_export_to_probestats, "INFO: -J porbe stats export interval (s)\n"},
-    { 'K', &configuration_set_export_to_ifstats, "INFO: -K interface stats export interval (s)\n"}
+    { 'K', &configuration_set_export_to_ifstats, "INFO: -K interface stats export interval (s)\n"},
+    { 'F', &configuration_set_hash_function, "INFO: -F hash function (BOB|OAAT|TWMX|HSIEH|SBOX|SBOX64)\n"},
+    { 'k', &configuration_set_hash_seed, "INFO: -k hash seed (hex|int)\n"},
+    { 'c', &configuration_get_path_cost, "INFO: -c packet path cost of selection and export\n"},
+    { 'C', &configuration_get_collectors, "INFO: -C collector send and back-pressure counters\n"}
 };
 
 char cfg_response[256];
@@ -285,6 +301,17 @@ char* configuration_help(unsigned long mid, char *msg) {
     }
 }
 
+// the exporter thread might already use the flow cache functions
+static int flow_cache_init_locked() {
+    int rc;
+
+    exporter_lock();
+    rc = flow_cache_init(getOptions()->flow_cache_size
+            , getOptions()->flow_active_timeout, getOptions()->flow_idle_timeout);
+    exporter_unlock();
+    return rc;
+}
+
 /**
  * command: t <value>
  * returns: 1 consumed, 0 otherwise
@@ -297,6 +324,10 @@ char* configuration_set_template(unsigned long mid, char *msg) {
         LOGGER_warn("unknown template: %s", msg);
         SET_CFG_RESPONSE("INFO: unknown template: %s", msg);
     }
+    else if (FLOW_ID == t_id && !flow_cache_enabled()
+            && 0 > flow_cache_init_locked()) {
+        SET_CFG_RESPONSE("INFO: cannot allocate flow cache");
+    }
     else {
         // TODO: handling for different devices
         int i = 0;
@@ -305,6 +336,7 @@ char* configuration_set_template(unsigned long mid, char *msg) {
             if_devices[i].template_id = -1;
         }
         getOptions()->templateID = t_id;
+        packet_path_configure();
         SET_CFG_RESPONSE("INFO: new template set: %s", msg);
     }
     return CFG_RESPONSE;
@@ -392,7 +424,7 @@ char* configuration_set_min_selection(unsigned long mid, char *msg) {
     LOGGER_debug("Message ID: %lu", mid);
 
     uint32_t value = set_sampling_lowerbound(&g_options, msg);
-    SET_CFG_RESPONSE("INFO: minimum selection range set: %d", value);
+    SET_CFG_RESPONSE("INFO: minimum selection range set: %d (%s)", value, msg);
 
     return CFG_RESPONSE;
 }
@@ -405,7 +437,7 @@ char* configuration_set_max_selection(unsigned long mid, char *msg) {
     LOGGER_debug("Message ID: %lu", mid);
 
     uint32_t value = set_sampling_upperbound(&g_options, msg);
-    SET_CFG_RESPONSE("INFO: maximum selection range set: %d", value);
+    SET_CFG_RESPONSE("INFO: maximum selection range set: %d (%s)", value, msg);
 
     return CFG_RESPONSE;
 }
@@ -428,3 +460,116 @@ char* configuration_set_ratio(unsigned long mid, char *msg) {
     return CFG_RESPONSE;
 }
 
+/**
+ * command: H <ranges>
+ * returns: 1 consumed, 0 otherwise
+ */
+char* configuration_set_ranges(unsigned long mid, char *msg) {
+    LOGGER_debug("Message ID: %lu", mid);
+
+    if (-1 == set_selection_ranges(&g_options, msg)) {
+        SET_CFG_RESPONSE("INFO: error setting selection ranges: %s", msg);
+    }
+    else {
+        SET_CFG_RESPONSE("INFO: new selection ranges set: %s", msg);
+    }
+    return CFG_RESPONSE;
+}
+
+/**
+ * command: F <value>
+ * returns: 1 consumed, 0 otherwise
+ */
+char* configuration_set_hash_function(unsigned long mid, char *msg) {
+    LOGGER_debug("Message ID: %lu", mid);
+
+    hashFunction f = lookupFunction(msg);
+    if (NULL == f) {
+        LOGGER_warn("unknown hash function: %s", msg);
+        SET_CFG_RESPONSE("INFO: unknown hash function: %s", msg);
+    }
+    else {
+        // the hash values change; probes selecting the same packets
+        // have to be switched as well
+        g_options.hash_function.function = f;
+        packet_path_configure();
+        SET_CFG_RESPONSE("INFO: new hash function set: %s", msg);
+    }
+    return CFG_RESPONSE;
+}
+
+/**
+ * command: k <value>
+ * returns: 1 consumed, 0 otherwise
+ */
+char* configuration_set_hash_seed(unsigned long mid, char *msg) {
+    LOGGER_debug("Message ID: %lu", mid);
+
+    // rotates the selected population; takes effect with the next packet
+    uint32_t value = set_hash_seed(&g_options, msg);
+    SET_CFG_RESPONSE("INFO: new hash seed set: %#x", value);
+
+    return CFG_RESPONSE;
+}
+
+/**
+ * command: c
+ * returns: 1 consumed, 0 otherwise
+ */
+char* configuration_get_path_cost(unsigned long mid, char *msg) {
+    LOGGER_debug("Message ID: %lu", mid);
+
+    char* p = cfg_response;
+    int left = sizeof(cfg_response);
+    int i = 0;
+
+    cfg_response[0] = '\0';
+    for (i = 0; i < g_options.number_interfaces && 0 < left; ++i) {
+        device_dev_t* dev = &if_devices[i];
+        path_stats_t* ps = &dev->path;
+#ifdef HAVE_PACKET_FANOUT
+        if (NULL != dev->workers) {
+            workers_merge_stats(dev);
+        }
+#endif
+        // average cycles per packet of each tier
+        int n = snprintf(p, left, "INFO: %s: selection %llu pkts %llu cycles/pkt"
+                ", export %llu pkts %llu cycles/pkt\n", dev->device_name
+                , (unsigned long long) ps->selection_packets
+                , (unsigned long long) (ps->selection_samples
+                        ? ps->selection_cycles / ps->selection_samples : 0)
+                , (unsigned long long) ps->export_packets
+                , (unsigned long long) (ps->export_samples
+                        ? ps->export_cycles / ps->export_samples : 0));
+        p += n;
+        left -= n;
+    }
+    return CFG_RESPONSE;
+}
+
+char* configuration_get_collectors(unsigned long mid, char *msg) {
+    LOGGER_debug("Message ID: %lu", mid);
+
+    char* p = cfg_response;
+    int left = sizeof(cfg_response);
+    collector_stats_t cs;
+    const char* host;
+    int port;
+    int i = 0;
+
+    cfg_response[0] = '\0';
+    exporter_lock();
+    for (i = 0; 0 < left && 0 == ipfix_encoder_collector_stats(i, &host, &port, &cs); ++i) {
+        int n = snprintf(p, left, "INFO: %s:%d: %llu msgs, %llu queued bytes"
+                ", %llu blocked, %llu dropped, %llu spooled\n", host, port
+                , (unsigned long long) cs.messages
+                , (unsigned long long) cs.queued
+                , (unsigned long long) cs.blocked
+                , (unsigned long long) cs.dropped
+                , (unsigned long long) cs.spooled);
+        p += n;
+        left -= n;
+    }
+    exporter_unlock();
+    return CFG_RESPONSE;
+}
@@ -183,6 +183,36 @@ ev_watcher* event_register_timer_w(EV_P_ watcher_cb_t cb, double to) {
 	return (ev_watcher*) ev_handle;
 }
 
+/**
+ * register periodic callbacks
+ * executed at multiples of the interval in wall clock time, so all probes
+ * with the same interval run the callback at the same instants
+ */
+ev_watcher* event_register_periodic(EV_P_ watcher_cb_t cb, double interval) {
+	ev_periodic* ev_handle = (ev_periodic*) malloc(sizeof(ev_periodic));
+
+	// ev_init does not case to ev_watcher, while setting callback
+	ev_init( ev_handle, (periodic_cb_t)cb);
+	ev_periodic_set(ev_handle, 0, interval, 0);
+    ev_periodic_start(EV_A_ ev_handle);
+
+	return (ev_watcher*) ev_handle;
+}
+
+/**
+ * register idle callbacks
+ * callback is executed whenever no other event is pending
+ */
+ev_watcher* event_register_idle(EV_P_ watcher_cb_t cb) {
+	ev_idle* ev_handle = (ev_idle*) malloc(sizeof(ev_idle));
+
+	// ev_init does not case to ev_watcher, while setting callback
+	ev_init( ev_handle, (idle_cb_t)cb);
+    ev_idle_start(EV_A_ ev_handle);
+
+	return (ev_watcher*) ev_handle;
+}
+
 /**
  * deregister timer event handler
  */
@@ -192,6 +222,15 @@ void event_deregister_timer( EV_P_ ev_timer *w ) {
 	return;
 }
 
+/**
+ * deregister periodic event handler
+ */
+
+void event_deregister_periodic( EV_P_ ev_periodic *w ) {
+	ev_periodic_stop( EV_A_ w );
+	return;
+}
+
 /**
  * deregister io event handler
  */
@@ -201,3 +240,12 @@ void event_deregister_io( EV_P_ ev_io *w ) {
 	return;
 }
 
+/**
+ * deregister idle event handler
+ */
+
+void event_deregister_idle( EV_P_ ev_idle *w ) {
+	ev_idle_stop( EV_A_ w );
+	return;
+}
+
@@ -42,6 +42,11 @@
 
 #include "ev_handler.h"
 #include "ipfix_handler.h"
+#include "ipfix_encoder.h"
+#include "exporter.h"
+#include "tpacket_handler.h"
+#include "worker_handler.h"
+#include "selector.h"
 
 #include "helper.h"   // ntoa
 #include "settings.h" // g_options
@@ -54,6 +59,7 @@ void export_timer_pktid_cb    (EV_P_ ev_watcher *w, int revents);
 void export_timer_sampling_cb (EV_P_ ev_watcher *w, int revents);
 void export_timer_stats_cb    (EV_P_ ev_watcher *w, int revents);
 void export_timer_location_cb (EV_P_ ev_watcher *w, int revents);
+void export_timer_templates_cb(EV_P_ ev_watcher *w, int revents);
 
 
 // TODO: not here
@@ -62,6 +68,9 @@ void export_data_interface_stats(device_dev_t *dev
       , uint64_t observationTimeMilliseconds
       , u_int32_t size
       , u_int64_t deltaCount);
+void export_data_selector(device_dev_t *dev
+      , uint64_t selectorId
+      , uint64_t observationTimeMilliseconds);
 void export_data_probe_stats(int64_t observationTimeMilliseconds);
 void export_data_sync(device_dev_t *dev
       , int64_t observationTimeMilliseconds
@@ -76,6 +85,7 @@ ev_timer* export_timer_pkid;
 ev_timer* export_timer_sampling;
 ev_timer* export_timer_stats;
 ev_timer* export_timer_location;
+ev_timer* export_timer_templates;
 
 void export_handler_init(EV_P) {
     LOGGER_info("call");
@@ -112,28 +122,71 @@ void export_handler_init(EV_P) {
     		export_timer_location_cb,
     		g_options.export_location_interval
     		);
+
+    /* udp does not keep a state; resend the templates periodically */
+    if (IPFIX_PROTO_UDP == g_options.collectorProto &&
+            0 < g_options.template_refresh_interval) {
+        LOGGER_info("register event timer: template retransmission");
+        export_timer_templates = (ev_timer*)event_register_timer(
+                EV_A_
+                export_timer_templates_cb,
+                g_options.template_refresh_interval
+                );
+    }
 }
 
 /*-----------------------------------------------------------------------------
   Export
   -----------------------------------------------------------------------------*/
+#ifndef PFRING
+/**
+ * kernel counters of received and dropped packets of a live capture;
+ * counting since the start. Returns -1 for files and sockets.
+ */
+int get_capture_stats(device_dev_t *dev, struct pcap_stat *ps) {
+#ifdef HAVE_PACKET_FANOUT
+    if (NULL != dev->workers) {
+        return workers_capture_stats(dev, ps);
+    }
+#endif
+    if (TYPE_PCAP == dev->device_type) {
+        if (pcap_stats(dev->device_handle.pcap, ps) < 0) {
+            LOGGER_error("Error DeviceNo   %s: %s", dev->device_name,
+                    pcap_geterr(dev->device_handle.pcap));
+            return -1;
+        }
+        return 0;
+    }
+#ifdef HAVE_TPACKET3
+    if (TYPE_TPACKET == dev->device_type) {
+        return tpacket_stats(dev, ps);
+    }
+#endif
+    return -1;
+}
+#endif
+
 void export_data_interface_stats(device_dev_t *dev,
         uint64_t observationTimeMilliseconds, u_int32_t size,
         u_int64_t deltaCount) {
-    static uint16_t lengths[] = {8, 4, 8, 4, 4, 0, 0};
+    static uint16_t lengths[] = {8, 4, 8, 4, 4, 0, 0, 4, 8};
     static char interfaceDescription[16];
+    uint32_t ringFill = 0;
+    uint64_t ringDrops = 0;
 #ifndef PFRING
     struct pcap_stat pcapStat;
     void* fields[] = {&observationTimeMilliseconds, &size, &deltaCount,
-        &pcapStat.ps_recv, &pcapStat.ps_drop, dev->device_name,
-        interfaceDescription};
+        &pcapStat.ps_recv, &pcapStat.ps_drop,
+        dev->device_name, interfaceDescription, &ringFill, &ringDrops};
 #else
     pfring_stat pfringStat;
     void* fields[] = {&observationTimeMilliseconds, &size, &deltaCount
         , &pfringStat.recv
         , &pfringStat.drop
         , dev->device_name
-        , interfaceDescription};
+        , interfaceDescription
+        , &ringFill
+        , &ringDrops};
 #endif
 
     snprintf(interfaceDescription, sizeof (interfaceDescription), "%s",
@@ -141,14 +194,21 @@ void export_data_interface_stats(device_dev_t *dev,
     lengths[5] = strlen(dev->device_name);
     lengths[6] = strlen(interfaceDescription);
 
+    /* occupancy and overflow drops of the export ring(s) */
+#ifdef HAVE_PACKET_FANOUT
+    if (NULL != dev->workers) {
+        workers_ring_stats(dev, &ringFill, &ringDrops);
+    }
+    else
+#endif
+    {
+        ringFill  = export_ring_fill(dev->ring);
+        ringDrops = dev->ring->drops;
+    }
+
 #ifndef PFRING
     /* Get pcap statistics in case of live capture */
-    if (TYPE_PCAP == dev->device_type) {
-        if (pcap_stats(dev->device_handle.pcap, &pcapStat) < 0) {
-            LOGGER_error("Error DeviceNo   %s: %s", dev->device_name,
-                    pcap_geterr(dev->device_handle.pcap));
-        }
-    } else {
+    if (get_capture_stats(dev, &pcapStat) < 0) {
         pcapStat.ps_drop = 0;
         pcapStat.ps_recv = 0;
     }
@@ -165,7 +225,7 @@ void export_data_interface_stats(device_dev_t *dev,
 #endif
 
     LOGGER_trace("sampling: (%d, %lu)", size, (long unsigned) deltaCount);
-    if (ipfix_export_array(ipfix(), get_template(INTF_STATS_ID), 7,
+    if (ipfix_encode_array(get_template(INTF_STATS_ID), 9,
             fields, lengths) < 0) {
         LOGGER_error("ipfix export failed: %s", strerror(errno));
     } else {
@@ -174,6 +234,64 @@ void export_data_interface_stats(device_dev_t *dev,
     }
 }
 
+/**
+ * PSAMP selector report (RFC 5476): the parameters of the selector of the
+ * interface, the observed and selected packets. The hash selector gets
+ * one record per range; selectorId, selectorId + 1, ... (see the id
+ * scheme at export_fields_selector). A hash selection without a range
+ * selects nothing and gets no record.
+ */
+void export_data_selector(device_dev_t *dev, uint64_t selectorId,
+        uint64_t observationTimeMilliseconds) {
+    static uint16_t lengths[] = {8, 8, 2, 4, 4, 4, 4, 4, 4, 4, 4, 4, 8, 8, 0};
+    uint16_t algorithm = selector_algorithm();
+    uint32_t packetInterval = 0, packetSpace = 0;
+    uint32_t timeInterval = 0, timeSpace = 0;
+    uint32_t size = 0, population = 0;
+    uint32_t rangeMin = 0, rangeMax = 0;
+    uint32_t seed = g_options.hash_function.seed;
+    void* fields[] = {&observationTimeMilliseconds, &selectorId, &algorithm,
+        &packetInterval, &packetSpace, &timeInterval, &timeSpace,
+        &size, &population, &rangeMin, &rangeMax, &seed,
+        &dev->totalpacketcount, &dev->selected_total, dev->device_name};
+    selection_t ranges;
+    uint32_t i, count = 1;
+
+    uint32_t space = g_options.selector_period - g_options.selector_interval;
+    switch (g_options.selector) {
+    case SELECTOR_COUNT:
+        packetInterval = g_options.selector_interval;
+        packetSpace    = space;
+        break;
+    case SELECTOR_TIME:
+        timeInterval   = g_options.selector_interval;
+        timeSpace      = space;
+        break;
+    case SELECTOR_RANDOM:
+        size           = g_options.selector_interval;
+        population     = g_options.selector_period;
+        break;
+    }
+    lengths[14] = strlen(dev->device_name);
+
+    ranges = *__atomic_load_n(&dev->selection, __ATOMIC_ACQUIRE);
+    if (SELECTOR_HASH == g_options.selector) {
+        count = ranges.count;
+    }
+    for (i = 0; i < count; ++i) {
+        if (SELECTOR_HASH == g_options.selector) {
+            rangeMin = ranges.min[i];
+            rangeMax = ranges.min[i] + ranges.span[i];
+        }
+        if (ipfix_encode_array(get_template(SELECTOR_ID), 15,
+                fields, lengths) < 0) {
+            LOGGER_error("ipfix export failed: %s", strerror(errno));
+            return;
+        }
+        selectorId++;
+    }
+}
+
 void export_data_sync(device_dev_t *dev, int64_t observationTimeMilliseconds,
         u_int32_t messageId, u_int32_t messageValue, char * message) {
     static uint16_t lengths[] = {8, 4, 4, 0};
@@ -181,15 +299,15 @@ void export_data_sync(device_dev_t *dev, int64_t observationTimeMilliseconds,
     void *fields[] = {&observationTimeMilliseconds, &messageId, &messageValue,
         message};
     LOGGER_debug("export data sync");
-    if (ipfix_export_array(ipfix(), get_template(SYNC_ID), 4, fields,
+    exporter_lock();
+    if (ipfix_encode_array(get_template(SYNC_ID), 4, fields,
             lengths) < 0) {
         LOGGER_error("ipfix export failed: %s", strerror(errno));
-        return;
     }
-    if (ipfix_export_flush(ipfix()) < 0) {
-        LOGGER_error("Could not export IPFIX (flush) ");
+    else {
+        export_flush();
     }
-
+    exporter_unlock();
 }
 
 void export_data_probe_stats(int64_t observationTimeMilliseconds) {
@@ -211,13 +329,14 @@ void export_data_probe_stats(int64_t observationTimeMilliseconds) {
     probeStat.observationTimeMilliseconds = observationTimeMilliseconds;
     get_probe_stats(&probeStat);
 
-    if (ipfix_export_array(ipfix(), t, t->nfields, fields, lengths) < 0) {
+    exporter_lock();
+    if (ipfix_encode_array(t, t->nfields, fields, lengths) < 0) {
         LOGGER_error("ipfix export failed: %s", strerror(errno));
-        return;
     }
-    if (ipfix_export_flush(ipfix()) < 0) {
-        LOGGER_error("Could not export IPFIX (flush) ");
+    else {
+        export_flush();
     }
+    exporter_unlock();
 }
 
 void export_data_location(int64_t observationTimeMilliseconds) {
@@ -232,14 +351,15 @@ void export_data_location(int64_t observationTimeMilliseconds) {
 
     LOGGER_debug("export data location");
     //LOGGER_fatal("%s; %s",getOptions()->s_latitude, getOptions()->s_longitude );
-    if (ipfix_export_array(ipfix(), get_template(LOCATION_ID),
+    exporter_lock();
+    if (ipfix_encode_array(get_template(LOCATION_ID),
             sizeof (lengths) / sizeof (lengths[0]), fields, lengths) < 0) {
         LOGGER_error("ipfix export failed: %s", strerror(errno));
-        return;
     }
-    if (ipfix_export_flush(ipfix()) < 0) {
-        LOGGER_error("Could not export IPFIX (flush) ");
+    else {
+        export_flush();
     }
+    exporter_unlock();
 }
 
 void export_flush_all() {
@@ -254,10 +374,9 @@ void export_flush_device(device_dev_t* device) {
     LOGGER_trace("export_flush_device");
     if (0 != device) {
         device->export_packet_count = 0;
-        if (ipfix_export_flush(ipfix()) < 0) {
-            LOGGER_error("Could not export IPFIX: %s", device->device_name);
-            //         ipfix_reconnect();
-        }
+        exporter_lock();
+        ipfix_encoder_flush();
+        exporter_unlock();
     }
 }
 
@@ -266,7 +385,8 @@ void export_flush_device(device_dev_t* device) {
  */
 void export_timer_pktid_cb(EV_P_ ev_watcher *w, int revents) {
     LOGGER_trace("export timer tick");
-    export_flush();
+    // the packet id records are owned by the exporter thread
+    exporter_flush();
 }
 
 /**
@@ -277,9 +397,17 @@ void export_timer_sampling_cb(EV_P_ ev_watcher *w, int revents) {
     uint64_t observationTimeMilliseconds;
     LOGGER_trace("export timer sampling call back");
     observationTimeMilliseconds = (uint64_t) ev_now(EV_A) * 1000;
+    exporter_lock();
     for (i = 0; i < g_options.number_interfaces; i++) {
         device_dev_t *dev = &if_devices[i];
+#ifdef HAVE_PACKET_FANOUT
+        if (NULL != dev->workers) {
+            workers_merge_stats(dev);
+        }
+#endif
         export_data_interface_stats(dev, observationTimeMilliseconds, dev->sampling_size, dev->sampling_delta_count);
+        export_data_selector(dev, (uint64_t) i * SELECTION_RANGES + 1,
+                observationTimeMilliseconds);
 #ifdef PFRING
 #ifdef PFRING_STATS
         print_stats(dev);
@@ -287,6 +415,7 @@ void export_timer_sampling_cb(EV_P_ ev_watcher *w, int revents) {
 #endif
     }
     export_flush();
+    exporter_unlock();
 }
 
 void export_timer_stats_cb(EV_P_ ev_watcher *w, int revents) {
@@ -302,3 +431,12 @@ void export_timer_location_cb(EV_P_ ev_watcher *w, int revents) {
     export_data_location( (uint64_t) ev_now(EV_A) * 1000 );
 }
 
+/**
+ * Periodically called each template refresh interval (udp only)
+ */
+void export_timer_templates_cb(EV_P_ ev_watcher *w, int revents) {
+    LOGGER_trace("export timer templates call back");
+    exporter_lock();
+    ipfix_encoder_send_templates();
+    exporter_unlock();
+}
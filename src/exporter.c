@@ -0,0 +1,369 @@
+/*
+ * impd4e - a small network probe which allows to monitor and sample datagrams
+ * from the network based on hash-based packet selection.
+ *
+ * Copyright (c) 2011
+ *
+ * Fraunhofer FOKUS
+ * www.fokus.fraunhofer.de
+ *
+ * in cooperation with
+ *
+ * Technical University Berlin
+ * www.av.tu-berlin.de
+ *
+ * authors:
+ * Ramon Masek <ramon.masek@fokus.fraunhofer.de>
+ * Christian Henke <c.henke@tu-berlin.de>
+ * Carsten Schmoll <carsten.schmoll@fokus.fraunhofer.de>
+ *
+ * For questions/comments contact packettracking@fokus.fraunhofer.de
+ *
+ * This program is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software Foundation;
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * exporter thread
+ *
+ * The capture path only writes packet id records into the ring of its
+ * device. The exporter thread encodes the records and sends the messages,
+ * so a stalled collector connection no longer blocks the capture; if the
+ * ring is full, the records are dropped and counted.
+ *
+ * The exporter lock is held while records are encoded (at most
+ * EXPORTER_BATCH at a time) and while the finished messages are taken
+ * from the encoder; the messages are sent without it. When there is
+ * nothing to do, the thread sleeps in poll() on a wake-up pipe and on
+ * the collector sockets which wait for room. A ring which fills up to
+ * EXPORT_RING_WAKE records, exporter_flush() and exporter_wake() end the
+ * sleep.
+ *
+ * Messages spooled during a collector outage are replayed after the live
+ * records, limited to spool_rate bytes per second.
+ *
+ * Records of the flow template go into the flow cache; the flows which
+ * timed out are exported with each timed flush.
+ */
+
+#include <stdlib.h>  // calloc
+#include <string.h>  // strerror
+#include <errno.h>   // errno
+#include <time.h>    // clock_gettime
+#include <unistd.h>  // pipe
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+
+// Custom logger
+#include "logger.h"
+
+#include "constants.h"
+#include "settings.h"    // g_options
+#include "ipfix_handler.h"
+#include "ipfix_encoder.h"
+#include "exporter.h"
+#include "spool.h"
+#include "flow_cache.h"
+
+// -----------------------------------------------------------------------------
+// Global Variables
+// -----------------------------------------------------------------------------
+
+static export_ring_t*   rings[MAX_INTERFACES * (MAX_WORKERS + 1)];
+static int              ring_count = 0;
+
+static pthread_t        thread;
+static pthread_mutex_t  ipfix_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int              running = 0;
+static int              flush_requested = 0;
+
+// wake-up pipe of the sleeping exporter thread
+static int              wake_fd[2] = { -1, -1 };
+int                     exporter_sleeping = 0;
+
+// records encoded since the last flush
+static uint32_t         pending = 0;
+
+// replay budget of the spool in bytes; refilled with spool_rate
+static double           replay_budget = 0;
+static struct timespec  replay_time;
+
+// -----------------------------------------------------------------------------
+// Functions
+// -----------------------------------------------------------------------------
+
+export_ring_t* export_ring_new() {
+   export_ring_t* ring = NULL;
+
+   if( sizeof(rings)/sizeof(rings[0]) <= ring_count ) {
+      LOGGER_fatal( "too many export rings" );
+      exit(1);
+   }
+
+   if( 0 != posix_memalign( (void**) &ring, 64, sizeof(export_ring_t) ) ) {
+      LOGGER_fatal( "cannot allocate export ring: %s", strerror(errno));
+      exit(1);
+   }
+   memset( ring, 0, sizeof(export_ring_t) );
+   ring->mask = EXPORT_RING_SIZE - 1;
+   ring->slot = calloc( EXPORT_RING_SIZE, sizeof(pktid_record_t) );
+   if( NULL == ring->slot ) {
+      LOGGER_fatal( "cannot allocate export ring: %s", strerror(errno));
+      exit(1);
+   }
+
+   rings[ring_count++] = ring;
+   return ring;
+}
+
+// -----------------------------------------------------------------------------
+
+void exporter_lock() {
+   pthread_mutex_lock( &ipfix_mutex );
+}
+
+void exporter_unlock() {
+   pthread_mutex_unlock( &ipfix_mutex );
+}
+
+void exporter_flush() {
+   __atomic_store_n( &flush_requested, 1, __ATOMIC_SEQ_CST );
+   exporter_wake();
+}
+
+void exporter_wake() {
+   // one byte per sleep is enough
+   if( __atomic_exchange_n( &exporter_sleeping, 0, __ATOMIC_SEQ_CST ) ) {
+      if( 0 > write( wake_fd[1], "", 1 ) && EAGAIN != errno ) {
+         LOGGER_error( "cannot wake the exporter: %s", strerror(errno) );
+      }
+   }
+}
+
+// -----------------------------------------------------------------------------
+
+/**
+ * encode up to EXPORTER_BATCH records of the ring; the slots are released
+ * one by one, so the capture can go on meanwhile
+ */
+static uint32_t drain( export_ring_t* ring ) {
+   uint32_t tail = ring->tail;
+   uint32_t head = __atomic_load_n( &ring->head, __ATOMIC_ACQUIRE );
+   uint32_t n    = head - tail;
+
+   if( 0 == n ) {
+      return 0;
+   }
+   if( EXPORTER_BATCH < n ) {
+      n    = EXPORTER_BATCH;
+      head = tail + n;
+   }
+
+   exporter_lock();
+   for( ; tail != head; ++tail ) {
+      const pktid_record_t* r = &ring->slot[tail & ring->mask];
+
+      if( FLOW_ID == r->template_id ) {
+         if( flow_cache_enabled() ) {
+            flow_cache_add( r );
+         }
+         __atomic_store_n( &ring->tail, tail + 1, __ATOMIC_RELEASE );
+         continue;
+      }
+      if( 0 > ipfix_encode_record( r->template_id, r ) ) {
+         LOGGER_fatal( "ipfix_encode_record() failed" );
+      }
+      __atomic_store_n( &ring->tail, tail + 1, __ATOMIC_RELEASE );
+
+      // flush ipfix storage if max packetcount is reached
+      if( ++pending >= g_options.export_packet_count ) {
+         pending = 0;
+         ipfix_encoder_flush();
+      }
+   }
+   exporter_unlock();
+
+   return n;
+}
+
+static uint32_t drain_all() {
+   uint32_t n = 0;
+   int i;
+
+   for( i = 0; i < ring_count; ++i ) {
+      n += drain( rings[i] );
+   }
+
+   exporter_lock();
+   if( __atomic_exchange_n( &flush_requested, 0, __ATOMIC_ACQ_REL ) ) {
+      pending = 0;
+      flow_cache_expire( 0 );
+      ipfix_encoder_flush();
+   }
+   ipfix_encoder_take();
+   exporter_unlock();
+
+   // the messages of this round and what the collectors did not take yet
+   ipfix_encoder_send();
+   return n;
+}
+
+/**
+ * replay spooled messages within the rate limit; the live records are
+ * always drained first, so the replay only uses the remaining time
+ */
+static uint32_t replay() {
+   struct timespec now;
+   double burst = g_options.spool_rate;
+   uint32_t n;
+
+   if( 0 == spool_pending() ) {
+      replay_budget = 0;
+      return 0;
+   }
+
+   // the largest message must fit into the bucket
+   if( IPFIX_MESSAGE_MAX > burst ) {
+      burst = IPFIX_MESSAGE_MAX;
+   }
+   clock_gettime( CLOCK_MONOTONIC, &now );
+   replay_budget += ( (now.tv_sec - replay_time.tv_sec)
+                    + (now.tv_nsec - replay_time.tv_nsec) / 1e9 )
+                  * g_options.spool_rate;
+   replay_time = now;
+   if( burst < replay_budget ) {
+      replay_budget = burst;
+   }
+
+   n = ipfix_encoder_replay( (uint32_t) replay_budget );
+
+   replay_budget -= n;
+   return n;
+}
+
+/**
+ * send what is left for up to EXPORTER_STOP_TIME ms; the rest goes to
+ * the spool
+ */
+static void exporter_stop_send() {
+   int i;
+
+   exporter_lock();
+   ipfix_encoder_flush();
+   ipfix_encoder_take();
+   exporter_unlock();
+   ipfix_encoder_send();
+   for( i = 0; i < EXPORTER_STOP_TIME && ipfix_encoder_queued(); ++i ) {
+      struct pollfd fds[MAX_COLLECTORS];
+      int timeout = 1;
+
+      poll( fds, ipfix_encoder_poll( fds, &timeout ), timeout );
+      ipfix_encoder_send();
+   }
+   ipfix_encoder_close();
+}
+
+// 1 if a ring has a record or a flush is requested
+static int exporter_busy() {
+   int i;
+
+   if( __atomic_load_n( &flush_requested, __ATOMIC_SEQ_CST ) ) {
+      return 1;
+   }
+   for( i = 0; i < ring_count; ++i ) {
+      if( 0 < export_ring_fill( rings[i] ) ) {
+         return 1;
+      }
+   }
+   return 0;
+}
+
+/**
+ * sleep until a ring fills up, a flush is requested, a collector socket
+ * takes data again or the next connection attempt is due
+ */
+static void exporter_sleep() {
+   struct pollfd fds[MAX_COLLECTORS + 1];
+   char buf[64];
+   int timeout = -1;
+   int n;
+
+   n = ipfix_encoder_poll( fds + 1, &timeout );
+   if( 0 < spool_pending() && (0 > timeout || EXPORTER_REPLAY_TICK < timeout) ) {
+      timeout = EXPORTER_REPLAY_TICK;
+   }
+   fds[0].fd     = wake_fd[0];
+   fds[0].events = POLLIN;
+
+   __atomic_store_n( &exporter_sleeping, 1, __ATOMIC_SEQ_CST );
+   // a record committed before the flag was set does not wake us
+   if( !exporter_busy() ) {
+      poll( fds, n + 1, timeout );
+   }
+   __atomic_store_n( &exporter_sleeping, 0, __ATOMIC_RELEASE );
+
+   while( 0 < read( wake_fd[0], buf, sizeof(buf) ) );
+}
+
+static void* exporter_run( void* arg ) {
+   LOGGER_info( "exporter started: %d rings", ring_count );
+   clock_gettime( CLOCK_MONOTONIC, &replay_time );
+   while( __atomic_load_n( &running, __ATOMIC_ACQUIRE ) ) {
+      uint32_t n = drain_all();
+
+      if( spool_enabled() ) {
+         replay();
+      }
+      if( 0 == n ) {
+         exporter_sleep();
+      }
+   }
+
+   // records pushed before the capture stopped
+   __atomic_store_n( &flush_requested, 1, __ATOMIC_SEQ_CST );
+   while( 0 < drain_all() );
+   if( flow_cache_enabled() ) {
+      exporter_lock();
+      flow_cache_expire( 1 );
+      ipfix_encoder_flush();
+      flow_cache_report();
+      exporter_unlock();
+   }
+   exporter_stop_send();
+   LOGGER_info( "exporter stopped" );
+   return NULL;
+}
+
+void exporter_start() {
+   if( 0 != pipe( wake_fd ) ) {
+      LOGGER_fatal( "cannot create exporter pipe: %s", strerror(errno));
+      exit(1);
+   }
+   fcntl( wake_fd[0], F_SETFL, fcntl( wake_fd[0], F_GETFL ) | O_NONBLOCK );
+   fcntl( wake_fd[1], F_SETFL, fcntl( wake_fd[1], F_GETFL ) | O_NONBLOCK );
+
+   running = 1;
+   if( 0 != pthread_create( &thread, NULL, exporter_run, NULL ) ) {
+      LOGGER_fatal( "could not start exporter: %s", strerror(errno));
+      exit(1);
+   }
+}
+
+void exporter_stop() {
+   if( !running ) {
+      return;
+   }
+   __atomic_store_n( &running, 0, __ATOMIC_SEQ_CST );
+   exporter_flush();
+   pthread_join( thread, NULL );
+}
@@ -0,0 +1,318 @@
+/*
+ * impd4e - a small network probe which allows to monitor and sample datagrams
+ * from the network based on hash-based packet selection.
+ *
+ * Copyright (c) 2011
+ *
+ * Fraunhofer FOKUS
+ * www.fokus.fraunhofer.de
+ *
+ * in cooperation with
+ *
+ * Technical University Berlin
+ * www.av.tu-berlin.de
+ *
+ * authors:
+ * Ramon Masek <ramon.masek@fokus.fraunhofer.de>
+ * Christian Henke <c.henke@tu-berlin.de>
+ * Carsten Schmoll <carsten.schmoll@fokus.fraunhofer.de>
+ *
+ * For questions/comments contact packettracking@fokus.fraunhofer.de
+ *
+ * This program is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software Foundation;
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * flow cache
+ *
+ * Aggregates the selected packets by 5-tuple (addresses, ports,
+ * protocol) into flow records: packet and byte counts, first and last
+ * timestamp. A flow is exported when it was idle for the idle timeout,
+ * when it is older than the active timeout, or when it has to make room.
+ *
+ * The table is allocated once; its memory does not grow with the
+ * traffic. A flow hashes to a group of FLOW_CACHE_WAYS slots whose tags
+ * (a part of the flow hash; 0 marks a free slot) fill one cache line, so
+ * a lookup reads one line of tags and only the entries with a matching
+ * tag. The entries are aligned to cache lines as well. If the group is
+ * full, the flow with the oldest packet is evicted.
+ *
+ * Only the exporter thread uses the cache, with the exporter lock held.
+ * Time is the packet time (trace time for pcap files), advanced by the
+ * monotonic clock while no packets arrive.
+ */
+
+#include <stdlib.h>  // posix_memalign
+#include <string.h>  // memcmp, memset
+#include <errno.h>   // errno
+#include <time.h>    // clock_gettime
+
+// Custom logger
+#include "logger.h"
+
+#include "constants.h"
+#include "ipfix_encoder.h"
+#include "flow_cache.h"
+
+// -----------------------------------------------------------------------------
+// Structures, Typedefs
+// -----------------------------------------------------------------------------
+
+typedef struct flow_entry {
+   flow_record_t  rec;
+   uint32_t       hash; // for the partitioning among the collectors
+} __attribute__((aligned(64))) flow_entry_t;
+
+// -----------------------------------------------------------------------------
+// Global Variables
+// -----------------------------------------------------------------------------
+
+static uint32_t*       tags    = NULL;
+static flow_entry_t*   entries = NULL;
+static uint32_t        nslots  = 0;
+static uint32_t        group_mask;
+static uint64_t        active_us;
+static uint64_t        idle_us;
+
+// latest packet time and when it was seen
+static uint64_t        last_seen  = 0;
+static uint64_t        trace_time = 0;
+static struct timespec trace_wall;
+
+static struct {
+   uint64_t created;
+   uint64_t exported;
+   uint64_t evicted;
+   uint32_t active;
+} counters;
+
+// -----------------------------------------------------------------------------
+// Functions
+// -----------------------------------------------------------------------------
+
+int flow_cache_init( uint32_t size, double active_timeout, double idle_timeout ) {
+   uint32_t n = FLOW_CACHE_WAYS;
+
+   if( NULL != tags ) {
+      return 0;
+   }
+   while( n < size && n < (1u << 31) ) {
+      n <<= 1;
+   }
+
+   if( 0 != posix_memalign( (void**) &tags, 64, n * sizeof(uint32_t) )
+    || 0 != posix_memalign( (void**) &entries, 64, n * sizeof(flow_entry_t) ) ) {
+      LOGGER_error( "cannot allocate flow cache: %s", strerror(errno) );
+      free( tags );
+      tags = NULL;
+      return -1;
+   }
+   memset( tags, 0, n * sizeof(uint32_t) );
+   memset( &counters, 0, sizeof(counters) );
+
+   nslots     = n;
+   group_mask = n / FLOW_CACHE_WAYS - 1;
+   active_us  = active_timeout * 1000000;
+   idle_us    = idle_timeout * 1000000;
+   clock_gettime( CLOCK_MONOTONIC, &trace_wall );
+
+   LOGGER_info( "flow cache: %u entries (%lu bytes), timeouts %.1fs active, %.1fs idle"
+         , n, (unsigned long) n * (sizeof(uint32_t) + sizeof(flow_entry_t))
+         , active_timeout, idle_timeout );
+   return 0;
+}
+
+int flow_cache_enabled() {
+   return NULL != tags;
+}
+
+// -----------------------------------------------------------------------------
+
+static inline uint64_t mix64( uint64_t h ) {
+   h ^= h >> 33;
+   h *= 0xff51afd7ed558ccdULL;
+   h ^= h >> 33;
+   h *= 0xc4ceb9fe1a85ec53ULL;
+   h ^= h >> 33;
+   return h;
+}
+
+// only the first 4 bytes of the addresses are set for IPv4
+static inline int ipa_length( uint8_t ip_version ) {
+   return (N_IP6 == ip_version) ? 16 : 4;
+}
+
+static inline uint64_t get_ipa( const uint8_t* ipa, int length ) {
+   uint64_t a = 0;
+   uint32_t w;
+   int i;
+
+   for( i = 0; i < length; i += 4 ) {
+      memcpy( &w, ipa + i, 4 );
+      a = mix64( a ^ w );
+   }
+   return a;
+}
+
+static inline uint64_t flow_hash( const pktid_record_t* r ) {
+   int      len = ipa_length( r->ip_version );
+   uint64_t a = get_ipa( r->src_ipa, len ) ^ (get_ipa( r->dst_ipa, len ) << 1);
+   uint64_t b = ((uint64_t) r->src_port << 48) | ((uint64_t) r->dst_port << 32)
+              | (r->protocol << 8) | r->ip_version;
+   return mix64( a ^ mix64( b ) );
+}
+
+static inline int flow_match( const flow_record_t* f, const pktid_record_t* r ) {
+   return f->src_port   == r->src_port
+       && f->dst_port   == r->dst_port
+       && f->protocol   == r->protocol
+       && f->ip_version == r->ip_version
+       && 0 == memcmp( f->src_ipa, r->src_ipa, ipa_length( r->ip_version ) )
+       && 0 == memcmp( f->dst_ipa, r->dst_ipa, ipa_length( r->ip_version ) );
+}
+
+static void flow_export( uint32_t slot, uint8_t reason ) {
+   flow_entry_t* e = &entries[slot];
+
+   e->rec.end_reason = reason;
+   if( 0 > ipfix_encode_flow( &e->rec, e->hash ) ) {
+      LOGGER_error( "ipfix_encode_flow() failed" );
+   }
+   tags[slot] = 0;
+   counters.active--;
+   counters.exported++;
+}
+
+static void flow_start( uint32_t slot, uint32_t tag, uint64_t hash
+      , const pktid_record_t* r ) {
+   flow_record_t* f = &entries[slot].rec;
+
+   f->first      = r->timestamp;
+   f->last       = r->timestamp;
+   f->packets    = 1;
+   f->bytes      = r->length;
+   memcpy( f->src_ipa, r->src_ipa, ipa_length( r->ip_version ) );
+   memcpy( f->dst_ipa, r->dst_ipa, ipa_length( r->ip_version ) );
+   f->src_port   = r->src_port;
+   f->dst_port   = r->dst_port;
+   f->protocol   = r->protocol;
+   f->ip_version = r->ip_version;
+   f->end_reason = 0;
+   entries[slot].hash = (uint32_t) hash;
+
+   tags[slot] = tag;
+   counters.active++;
+   counters.created++;
+}
+
+void flow_cache_add( const pktid_record_t* r ) {
+   uint64_t  h    = flow_hash( r );
+   uint32_t  tag  = (uint32_t) h | 1;
+   uint32_t  base = ((h >> 32) & group_mask) * FLOW_CACHE_WAYS;
+   uint32_t* t    = &tags[base];
+   int i, slot = -1;
+
+   if( r->timestamp > last_seen ) {
+      last_seen = r->timestamp;
+   }
+
+   for( i = 0; i < FLOW_CACHE_WAYS; ++i ) {
+      if( tag == t[i] && flow_match( &entries[base + i].rec, r ) ) {
+         flow_record_t* f = &entries[base + i].rec;
+
+         if( r->timestamp > f->first + active_us ) {
+            // long lived flow; report it and start over
+            flow_export( base + i, FLOW_END_ACTIVE_TIMEOUT );
+            flow_start( base + i, tag, h, r );
+            return;
+         }
+         if( r->timestamp < f->first ) f->first = r->timestamp;
+         if( r->timestamp > f->last  ) f->last  = r->timestamp;
+         f->packets++;
+         f->bytes += r->length;
+         return;
+      }
+      if( 0 == t[i] && 0 > slot ) {
+         slot = i;
+      }
+   }
+
+   if( 0 > slot ) {
+      // group is full; evict the flow with the oldest packet
+      slot = 0;
+      for( i = 1; i < FLOW_CACHE_WAYS; ++i ) {
+         if( entries[base + i].rec.last < entries[base + slot].rec.last ) {
+            slot = i;
+         }
+      }
+      flow_export( base + slot, FLOW_END_LACK_OF_RESOURCES );
+      counters.evicted++;
+   }
+   flow_start( base + slot, tag, h, r );
+}
+
+// -----------------------------------------------------------------------------
+
+// packet time; advanced by the clock while no packets arrive
+static uint64_t flow_time() {
+   struct timespec now;
+
+   clock_gettime( CLOCK_MONOTONIC, &now );
+   if( last_seen != trace_time ) {
+      trace_time = last_seen;
+      trace_wall = now;
+      return trace_time;
+   }
+   return trace_time
+        + (now.tv_sec  - trace_wall.tv_sec) * 1000000LL
+        + (now.tv_nsec - trace_wall.tv_nsec) / 1000;
+}
+
+void flow_cache_expire( int all ) {
+   uint64_t now;
+   uint32_t slot;
+
+   if( NULL == tags || 0 == counters.active ) {
+      return;
+   }
+   now = flow_time();
+
+   for( slot = 0; slot < nslots; ++slot ) {
+      const flow_record_t* f = &entries[slot].rec;
+
+      if( 0 == tags[slot] ) {
+         continue;
+      }
+      if( all ) {
+         flow_export( slot, FLOW_END_FORCED );
+      }
+      else if( now > f->last + idle_us ) {
+         flow_export( slot, FLOW_END_IDLE_TIMEOUT );
+      }
+      else if( now > f->first + active_us ) {
+         flow_export( slot, FLOW_END_ACTIVE_TIMEOUT );
+      }
+   }
+}
+
+void flow_cache_report() {
+   if( NULL == tags ) {
+      return;
+   }
+   LOGGER_info( "flow cache: %llu flows, %llu exported, %llu evicted, %u active"
+         , (unsigned long long) counters.created
+         , (unsigned long long) counters.exported
+         , (unsigned long long) counters.evicted
+         , counters.active );
+}
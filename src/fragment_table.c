@@ -0,0 +1,87 @@
+/*
+ * impd4e - a small network probe which allows to monitor and sample datagrams
+ * from the network based on hash-based packet selection.
+ *
+ * Copyright (c) 2011
+ *
+ * Fraunhofer FOKUS
+ * www.fokus.fraunhofer.de
+ *
+ * in cooperation with
+ *
+ * Technical University Berlin
+ * www.av.tu-berlin.de
+ *
+ * authors:
+ * Ramon Masek <ramon.masek@fokus.fraunhofer.de>
+ * Christian Henke <c.henke@tu-berlin.de>
+ * Carsten Schmoll <carsten.schmoll@fokus.fraunhofer.de>
+ *
+ * For questions/comments contact packettracking@fokus.fraunhofer.de
+ *
+ * This program is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software Foundation;
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * fragment table
+ *
+ * Keeps the hash id of the first fragment of a datagram, so the later
+ * fragments get the same selection decision and packet id. The table is
+ * direct mapped on the hash over the invariant fields of the datagram
+ * (addresses, protocol, identification); a new datagram overwrites the
+ * entry, entries older than FRAGMENT_TIMEOUT are ignored.
+ *
+ * Each capture thread has its own table; no locking.
+ */
+
+#include <stdlib.h>  // calloc
+
+#include "constants.h"
+#include "fragment_table.h"
+
+// -----------------------------------------------------------------------------
+// Functions
+// -----------------------------------------------------------------------------
+
+fragment_table_t* fragment_table_new( uint32_t size ) {
+   fragment_table_t* t;
+   uint32_t n = 1;
+
+   while( n < size && n < (1u << 24) ) {
+      n <<= 1;
+   }
+   t = calloc( 1, sizeof(fragment_table_t) + n * sizeof(fragment_entry_t) );
+   if( NULL != t ) {
+      t->mask = n - 1;
+   }
+   return t;
+}
+
+void fragment_table_put( fragment_table_t* t, uint32_t key, uint32_t hash_id, uint32_t now ) {
+   fragment_entry_t* e = &t->entry[key & t->mask];
+
+   e->key     = key;
+   e->hash_id = hash_id;
+   e->time    = now;
+}
+
+int fragment_table_get( fragment_table_t* t, uint32_t key, uint32_t now, uint32_t* hash_id ) {
+   const fragment_entry_t* e = &t->entry[key & t->mask];
+
+   if( 0 == e->time || key != e->key || e->time + FRAGMENT_TIMEOUT < now ) {
+      return 0;
+   }
+   *hash_id = e->hash_id;
+   return 1;
+}
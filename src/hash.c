@@ -61,7 +61,11 @@
     typeof (Y) y_ = (Y);        \
     (x_ < y_) ? x_ : y_; })
 
-const uint32_t initval=0x32545;
+#define hash_max(X, Y)          \
+   ({ typeof (X) x_ = (X);      \
+    typeof (Y) y_ = (Y);        \
+    (x_ > y_) ? x_ : y_; })
+
 
 //! netmask for filter code
 //! do not try to get the real one -> ip broadcast wont work
@@ -81,6 +85,7 @@ const uint8_t IP6HDR_FRAG  = 44;
 const uint8_t IP6HDR_DEST  = 60;
 const uint8_t IP6HDR_AH    = 51;
 const uint8_t IP6HDR_ESP   = 50;
+const uint8_t IP6HDR_MOBILITY = 135;
 
 const int OFLAG = 1;
 
@@ -93,6 +98,41 @@ struct range_select {
 static struct range_select baseSelection;
 struct range_select* rSel = &baseSelection;
 
+// byte range selection compiled from the rSel list
+#define RANGE_GATHER_MAX 64 /*!< max selection size for the byte gather fast path */
+
+typedef enum {
+     RANGE_GENERIC = 0  // bounds checked copy of each range
+   , RANGE_REST         // single range up to the end of the packet
+   , RANGE_SINGLE       // single fixed length range
+   , RANGE_GATHER       // fixed length ranges of at most RANGE_GATHER_MAX bytes
+   , RANGE_MULTI        // fixed length ranges
+} range_shape_t;
+
+typedef struct range_op {
+   uint32_t offset;     // reverse programs: distance from the packet end
+   uint32_t length;     // 0: up to the end of the packet
+} range_op_t;
+
+typedef struct range_program {
+   range_shape_t shape;
+   range_op_t*   ops;          // adjacent ranges merged; used by the fast paths
+   uint32_t      nops;
+   range_op_t*   raw;          // ranges as given; used by the generic path
+   uint32_t      nraw;
+   uint32_t      min_len;      // packet length needed by the fast paths
+   uint32_t      total;        // bytes copied by the fast paths
+   uint16_t      gather[RANGE_GATHER_MAX];
+} range_program_t;
+
+// default: the whole packet; nothing for the reverse selection
+static range_op_t      baseOp = { 0, 0 };
+static range_program_t baseForward = { RANGE_REST, &baseOp, 1, &baseOp, 1, 0, 0, {0} };
+static range_program_t baseReverse = { RANGE_GENERIC, &baseOp, 1, &baseOp, 1, 0, 0, {0} };
+
+static range_program_t* rForward = &baseForward;
+static range_program_t* rReverse = &baseReverse;
+
 // ****************************************************************************
 // prototypes
 // ****************************************************************************
@@ -115,8 +155,40 @@ void print_selection_offsets( struct range_select* p ) {
    while( NULL != (p = p->next) );
 }
 
+/** gathers the segments of the hash input into its own memory */
+void buffer_flatten( buffer_t *b ) {
+   uint32_t i   = 0;
+   uint32_t off = 0;
+
+   if( 0 == b->count ) return;
+
+   for( i = 0; i < b->count; ++i ) {
+      // the first segment may already be the buffer itself
+      memmove( b->ptr+off, b->seg[i].ptr, b->seg[i].len );
+      off += b->seg[i].len;
+   }
+   b->seg[0].ptr = b->ptr;
+   b->seg[0].len = off;
+   b->count = 1;
+}
+
+/** adds a piece of the packet to the hash input; only the reference is
+ *  kept, the hash functions read the bytes straight from the packet */
 inline void append_packet( buffer_t *b, const uint8_t *p, uint32_t count ) {
-   memcpy( b->ptr+b->len, p, count );
+   segment_t* last = b->seg + b->count - 1;
+
+   if( 0 < b->count && last->ptr + last->len == p ) {
+      // continues the previous piece
+      last->len += count;
+   }
+   else {
+      if( MAX_BUFFER_SEGMENTS == b->count ) {
+         buffer_flatten( b );
+      }
+      b->seg[b->count].ptr = p;
+      b->seg[b->count].len = count;
+      ++b->count;
+   }
    b->len += count;
 }
 
@@ -125,7 +197,7 @@ inline void append_packet( buffer_t *b, const uint8_t *p, uint32_t count ) {
 // assume 'findHeaders()' run before calling that function
 uint32_t copy_NetFields( packet_t *packet,
       buffer_t *buffer,
-      uint32_t headerOffset[4], uint8_t layers[4] )
+      uint32_t headerOffset[LAYER_COUNT], uint8_t layers[LAYER_COUNT] )
 {   // copy Net_Layer_Fields
 
    if (layers[L_NET] == N_IP) {  // case IPv4
@@ -144,11 +216,35 @@ uint32_t copy_NetFields( packet_t *packet,
 }
 
 
+/**
+ * copies the fields all fragments of a datagram share into the hash input:
+ * identification, protocol, addresses; for fragments only (layers[L_FRAG])
+ */
+uint32_t copyFields_Fragment( packet_t *packet,
+      buffer_t *buffer,
+      uint32_t headerOffset[LAYER_COUNT], uint8_t layers[LAYER_COUNT] )
+{
+   if (layers[L_NET] == N_IP) {  // case IPv4
+      append_packet( buffer, packet->ptr+headerOffset[L_FRAG]+4, 2);
+      append_packet( buffer, packet->ptr+headerOffset[L_NET]+9,  1);
+      append_packet( buffer, packet->ptr+headerOffset[L_NET]+12, 8);
+   }
+
+   if (layers[L_NET] == N_IP6)  { // case IPv6; fragment header
+      append_packet( buffer, packet->ptr+headerOffset[L_FRAG]+4, 4);
+      append_packet( buffer, packet->ptr+headerOffset[L_FRAG],   1);
+      append_packet( buffer, packet->ptr+headerOffset[L_NET]+8, 32);
+   }
+
+   return buffer->len;
+}
+
+
 /** copy recommended 8 bytes -- only TCP UDP ICMP supported */
 
 uint32_t copyFields_Rec( packet_t *packet,
     buffer_t *buffer,
-    uint32_t headerOffset[4], uint8_t layers[4] ) { // these are just pointer, the size doesn't matter
+    uint32_t headerOffset[LAYER_COUNT], uint8_t layers[LAYER_COUNT] ) { // these are just pointer, the size doesn't matter
 
    if ((headerOffset[L_TRANS] != -1) && (layers[L_TRANS] != T_UNKNOWN) ) {
       if (layers[L_NET] == N_IP) {
@@ -178,7 +274,7 @@ uint32_t copyFields_Rec( packet_t *packet,
 
 uint32_t copyFields_Only_Net( packet_t *packet,
       buffer_t *buffer,
-      uint32_t headerOffset[4], uint8_t layers[4]
+      uint32_t headerOffset[LAYER_COUNT], uint8_t layers[LAYER_COUNT]
       )
 {   // copy Net_Layer_Fields
 
@@ -191,7 +287,7 @@ uint32_t copyFields_Only_Net( packet_t *packet,
 
 uint32_t copyFields_U_TCP_and_Net( packet_t *packet,
       buffer_t *buffer,
-      uint32_t headerOffset[4], uint8_t layers[4]
+      uint32_t headerOffset[LAYER_COUNT], uint8_t layers[LAYER_COUNT]
       )
 {
    int     piece_length = 0;
@@ -210,7 +306,8 @@ uint32_t copyFields_U_TCP_and_Net( packet_t *packet,
       }
    }
    else {
-      buffer->len = 0;
+      buffer->len   = 0;
+      buffer->count = 0;
    }
 
    return buffer->len;
@@ -219,7 +316,7 @@ uint32_t copyFields_U_TCP_and_Net( packet_t *packet,
 /** copy everything that is in the packet except variable fields into the hash input */
 uint32_t copyFields_Packet( packet_t *packet,
       buffer_t *buffer,
-      uint32_t headerOffset[4], uint8_t layers[4]
+      uint32_t headerOffset[LAYER_COUNT], uint8_t layers[LAYER_COUNT]
       )
 {
    int piecelength     = 0;
@@ -237,7 +334,7 @@ uint32_t copyFields_Packet( packet_t *packet,
 // packetLength - offset as start position of copy operation
 uint32_t copyFields_Last( packet_t *packet,
       buffer_t *buffer,
-      uint32_t headerOffset[4], uint8_t layers[4])
+      uint32_t headerOffset[LAYER_COUNT], uint8_t layers[LAYER_COUNT])
 {
    LOGGER_debug( "copyFields_Last(): pL=%d, bL=%d", packet->len, buffer->size);
 
@@ -247,7 +344,7 @@ uint32_t copyFields_Last( packet_t *packet,
 
 uint32_t copyFields_Raw( packet_t *packet,
       buffer_t *buffer,
-      uint32_t headerOffset[4], uint8_t layers[4])
+      uint32_t headerOffset[LAYER_COUNT], uint8_t layers[LAYER_COUNT])
 {
    LOGGER_debug( "copyFields_Raw(): pL=%d, bL=%d", packet->len, buffer->size);
 
@@ -257,7 +354,7 @@ uint32_t copyFields_Raw( packet_t *packet,
 
 uint32_t copyFields_Link( packet_t *packet,
       buffer_t *buffer,
-      uint32_t headerOffset[4], uint8_t layers[4])
+      uint32_t headerOffset[LAYER_COUNT], uint8_t layers[LAYER_COUNT])
 {
    LOGGER_debug( "copyFields_Link(): pL=%d, bL=%d", packet->len, buffer->size);
 
@@ -276,7 +373,7 @@ uint32_t copyFields_Link( packet_t *packet,
 
 uint32_t copyFields_Net( packet_t *packet,
       buffer_t *buffer,
-      uint32_t headerOffset[4], uint8_t layers[4])
+      uint32_t headerOffset[LAYER_COUNT], uint8_t layers[LAYER_COUNT])
 {
    LOGGER_debug( "copyFields_Net(): pL=%d, bL=%d", packet->len, buffer->size);
 
@@ -295,7 +392,7 @@ uint32_t copyFields_Net( packet_t *packet,
 
 uint32_t copyFields_Trans( packet_t *packet,
       buffer_t *buffer,
-      uint32_t headerOffset[4], uint8_t layers[4])
+      uint32_t headerOffset[LAYER_COUNT], uint8_t layers[LAYER_COUNT])
 {
    LOGGER_debug( "copyFields_Trans(): pL=%d, bL=%d", packet->len, buffer->size);
 
@@ -314,7 +411,7 @@ uint32_t copyFields_Trans( packet_t *packet,
 
 uint32_t copyFields_Payload( packet_t *packet,
       buffer_t *buffer,
-      uint32_t headerOffset[4], uint8_t layers[4])
+      uint32_t headerOffset[LAYER_COUNT], uint8_t layers[LAYER_COUNT])
 {
    LOGGER_debug(  "copyFields_Payload(): pL=%d, bL=%d", packet->len, buffer->size);
 
@@ -331,36 +428,108 @@ uint32_t copyFields_Payload( packet_t *packet,
 }
 
 
-uint32_t copyFields_Select(const uint8_t *packet, uint16_t packetLength,
-      uint8_t *b, uint16_t bLen )
+/**
+ * bounds checked copy of the selected ranges; used if the packet is shorter
+ * than needed by the fast paths or the buffer is too small
+ */
+static uint32_t select_generic(const range_program_t* prog
+      , const uint8_t *packet, uint16_t packetLength, uint8_t *b, uint16_t bLen )
 {
-   struct range_select* range = rSel;
    uint32_t written = 0;
+   uint32_t i;
 
-   do
-   {
-      LOGGER_info(  "sizes: pL=%d, bL=%d, oS=%d, oL=%d"
-            , packetLength, bLen, range->offset, range->length );
+   for( i = 0; i < prog->nraw && 0 < bLen; ++i ) {
+      const range_op_t* range = &prog->raw[i];
 
       // calculate copy range, prevent segmentation faults
-      int write = packetLength - range->offset;
+      int write = (int) packetLength - (int) range->offset;
       if( 0 < write ) {
          write = (0==range->length)?write:hash_min(write,range->length);
          write = hash_min(write, bLen);
-         LOGGER_debug( "-> write: %d", write );
 
          memcpy( b+written, packet+range->offset, write );
          written += write;
          bLen   -= write;
       }
       else {
-         LOGGER_info(  "range selection out of range: pL=%d, oS=%d, oL=%d"
+         LOGGER_trace( "range selection out of range: pL=%d, oS=%d, oL=%d"
                , packetLength, range->offset, range->length );
       }
    }
-   while(0 < bLen && NULL != (range = range->next) );
 
-   //print_byte_array_hex( b, written );
+   return written;
+}
+
+uint32_t copyFields_Select(const uint8_t *packet, uint16_t packetLength,
+      uint8_t *b, uint16_t bLen )
+{
+   const range_program_t* prog = rForward;
+   uint32_t i;
+
+   if( RANGE_REST == prog->shape ) {
+      int write = (int) packetLength - (int) prog->ops[0].offset;
+      if( 0 >= write ) return 0;
+      write = hash_min(write, bLen);
+      memcpy( b, packet+prog->ops[0].offset, write );
+      return write;
+   }
+
+   // fast paths: all ranges are within the packet and fit into the buffer
+   if( packetLength < prog->min_len || bLen < prog->total ) {
+      return select_generic( prog, packet, packetLength, b, bLen );
+   }
+
+   switch( prog->shape ) {
+      case RANGE_SINGLE:
+         memcpy( b, packet+prog->ops[0].offset, prog->total );
+         return prog->total;
+
+      case RANGE_GATHER:
+         for( i = 0; i < prog->total; ++i ) {
+            b[i] = packet[prog->gather[i]];
+         }
+         return prog->total;
+
+      case RANGE_MULTI: {
+         uint8_t* p = b;
+         for( i = 0; i < prog->nops; ++i ) {
+            memcpy( p, packet+prog->ops[i].offset, prog->ops[i].length );
+            p += prog->ops[i].length;
+         }
+         return prog->total;
+      }
+
+      default:
+         return select_generic( prog, packet, packetLength, b, bLen );
+   }
+}
+
+/**
+ * bounds checked copy of the selected ranges counted from the packet end
+ */
+static uint32_t select_reverse_generic(const range_program_t* prog
+      , const uint8_t *packet, uint16_t packetLength, uint8_t *b, uint16_t bLen )
+{
+   uint32_t written = 0;
+   uint32_t i;
+
+   for( i = 0; i < prog->nraw && 0 < bLen; ++i ) {
+      const range_op_t* range = &prog->raw[i];
+
+      int write = (int) range->offset;
+      if ( !(packetLength < write) ) {
+         write = (0==range->length)?write:hash_min(write,range->length);
+         write = hash_min(write, bLen);
+
+         memcpy( b+written, (packet + (packetLength - range->offset)), write );
+         written += write;
+         bLen    -= write;
+      }
+      else {
+         LOGGER_trace( "range selection out of range: pL=%d, oS=%d, oL=%d"
+               , packetLength, range->offset, range->length );
+      }
+   }
 
    return written;
 }
@@ -371,31 +540,129 @@ uint32_t copyFields_Select(const uint8_t *packet, uint16_t packetLength,
 uint32_t copyFields_Select_reverse(const uint8_t *packet, uint16_t packetLength,
       uint8_t *b, uint16_t bLen )
 {
-    struct range_select* range = rSel;
-    uint32_t written = 0;
-
-    do {
-        LOGGER_info(  "sizes: pL=%d, bL=%d, oS=%d, oL=%d"
-                    , packetLength, bLen, range->offset, range->length );
-
-        int write = range->offset;
-        if ( !(packetLength < write) ) {
-            write = (0==range->length)?write:hash_min(write,range->length);
-            write = hash_min(write, bLen);
-            LOGGER_debug( "-> write: %d", write );
-
-            memcpy( b+written, (packet + (packetLength - range->offset)), write );
-            written += write;
-            bLen    -= write;
-        }
-        else {
-            LOGGER_info(  "range selection out of range: pL=%d, oS=%d, oL=%d"
-                    , packetLength, range->offset, range->length );
-        }
-    }
-    while ( (0 < bLen) && (NULL != (range = range->next)) );
-
-    return written;
+   const range_program_t* prog = rReverse;
+   const uint8_t* end = packet + packetLength;
+   uint32_t i;
+
+   // fast paths: all ranges are within the packet and fit into the buffer
+   if( packetLength < prog->min_len || bLen < prog->total ) {
+      return select_reverse_generic( prog, packet, packetLength, b, bLen );
+   }
+
+   switch( prog->shape ) {
+      case RANGE_SINGLE:
+         memcpy( b, end - prog->ops[0].offset, prog->total );
+         return prog->total;
+
+      case RANGE_GATHER:
+         for( i = 0; i < prog->total; ++i ) {
+            b[i] = *(end - prog->gather[i]);
+         }
+         return prog->total;
+
+      case RANGE_MULTI: {
+         uint8_t* p = b;
+         for( i = 0; i < prog->nops; ++i ) {
+            memcpy( p, end - prog->ops[i].offset, prog->ops[i].length );
+            p += prog->ops[i].length;
+         }
+         return prog->total;
+      }
+
+      default:
+         return select_reverse_generic( prog, packet, packetLength, b, bLen );
+   }
+}
+
+/**
+ * compile the range list into a flat program; the reverse program
+ * interprets the offsets as distance from the packet end
+ */
+static range_program_t* compile_ranges( struct range_select* list, bool reverse ) {
+   range_program_t*     prog = NULL;
+   struct range_select* r = NULL;
+   uint32_t n = 0;
+   uint32_t i;
+   bool     fixed = true;
+
+   for( r = list; NULL != r; r = r->next ) ++n;
+
+   prog = (range_program_t*) calloc( 1, sizeof(range_program_t) );
+   prog->raw  = (range_op_t*) calloc( n, sizeof(range_op_t) );
+   prog->ops  = (range_op_t*) calloc( n, sizeof(range_op_t) );
+   prog->nraw = n;
+
+   for( i = 0, r = list; NULL != r; r = r->next, ++i ) {
+      range_op_t op = { r->offset, r->length };
+      prog->raw[i] = op;
+
+      if( reverse ) {
+         // the copy is limited by the distance to the packet end
+         op.length = (0 == op.length) ? op.offset : hash_min(op.offset, op.length);
+         // all ranges in bounds: packetLength >= offset
+         prog->min_len = hash_max(prog->min_len, op.offset);
+         if( 0 == op.length ) continue;
+      }
+      else {
+         if( 0 == op.length ) {
+            // up to the end of the packet; size depends on the packet
+            fixed = false;
+            continue;
+         }
+         // all ranges in bounds: packetLength >= offset + length
+         prog->min_len = hash_max(prog->min_len, op.offset + op.length);
+      }
+
+      // merge with the previous range if adjacent
+      if( 0 < prog->nops ) {
+         range_op_t* last = &prog->ops[prog->nops-1];
+         if( (!reverse && last->offset + last->length == op.offset)
+            || (reverse && last->offset - last->length == op.offset) )
+         {
+            last->length += op.length;
+            prog->total  += op.length;
+            continue;
+         }
+      }
+      prog->ops[prog->nops++] = op;
+      prog->total += op.length;
+   }
+
+   if( !fixed ) {
+      if( 1 == n ) {
+         prog->shape = RANGE_REST;
+         prog->ops[0] = prog->raw[0];
+         prog->nops   = 1;
+      }
+      else {
+         prog->shape = RANGE_GENERIC;
+      }
+   }
+   else if( 1 == prog->nops ) {
+      prog->shape = RANGE_SINGLE;
+   }
+   else if( RANGE_GATHER_MAX >= prog->total ) {
+      uint32_t k = 0;
+      for( i = 0; i < prog->nops; ++i ) {
+         uint32_t j;
+         for( j = 0; j < prog->ops[i].length; ++j ) {
+            // reverse: distance from the packet end
+            prog->gather[k++] = reverse
+               ? prog->ops[i].offset - j
+               : prog->ops[i].offset + j;
+         }
+      }
+      prog->shape = RANGE_GATHER;
+   }
+   else {
+      prog->shape = RANGE_MULTI;
+   }
+
+   LOGGER_debug( "range selection (%s): %u ranges; %u merged; shape %d; min length %u; size %u"
+         , reverse ? "reverse" : "forward", prog->nraw, prog->nops, prog->shape
+         , prog->min_len, prog->total );
+
+   return prog;
 }
 
 //
@@ -466,33 +733,75 @@ void parseRange( char* arg ) {
 
    //print_selection_offsets( rSel );
 
+   // the previous programs are not freed; they might still be in use
+   rForward = compile_ranges( rSel, false );
+   rReverse = compile_ranges( rSel, true );
+
    return;
 }
 
 //
 //
-uint32_t calcHashValue_BOB( buffer_t *b )
+// hash functions consume the segments of a scattered hash input one by
+// one; the result is the same as for the gathered bytes
+uint32_t calcHashValue_BOB( const hash_ctx_t *ctx, buffer_t *b )
 {   
-   uint32_t result;
-   result = BOB_Hash(b->ptr, b->len, initval);
+   uint32_t    result;
+   bob_state_t state;
+   uint32_t    i;
+
+   if( 0 == b->count ) {
+      return BOB_Hash(b->ptr, b->len, ctx->seed);
+   }
+   if( 1 == b->count ) {
+      return BOB_Hash((uint8_t*)b->seg[0].ptr, b->seg[0].len, ctx->seed);
+   }
+
+   BOB_Hash_init( &state, ctx->seed );
+   for( i = 0; i < b->count; ++i ) {
+      BOB_Hash_update( &state, b->seg[i].ptr, b->seg[i].len );
+   }
+   result = BOB_Hash_final( &state );
    return result;
 }
 
-uint32_t calcHashValue_Hsieh( buffer_t *b )
+uint32_t calcHashValue_Hsieh( const hash_ctx_t *ctx, buffer_t *b )
 {   
-   uint32_t result;
-   result = Hsieh_Hash((char*)b->ptr, b->len);
+   uint32_t      result;
+   hsieh_state_t state;
+   uint32_t      seed = ctx->seed ^ HASH_SEED_DEFAULT;
+   uint32_t      i;
+
+   if( 0 == b->count ) {
+      return Hsieh_Hash((char*)b->ptr, b->len, seed);
+   }
+   if( 1 == b->count ) {
+      return Hsieh_Hash((const char*)b->seg[0].ptr, b->seg[0].len, seed);
+   }
+
+   Hsieh_Hash_init( &state, b->len, seed );
+   for( i = 0; i < b->count; ++i ) {
+      Hsieh_Hash_update( &state, (const char*)b->seg[i].ptr, b->seg[i].len );
+   }
+   result = Hsieh_Hash_final( &state );
    return result;
 }
 
-uint32_t calcHashValue_OAAT( buffer_t *b )
+uint32_t calcHashValue_OAAT( const hash_ctx_t *ctx, buffer_t *b )
 {
-   uint32_t   hash, i;
-   for (hash=0, i=0; i<b->len; ++i)
+   uint32_t   hash, i, j;
+   segment_t  whole = { b->ptr, b->len };
+   segment_t* seg   = (0 == b->count) ? &whole : b->seg;
+   uint32_t   count = (0 == b->count) ? 1 : b->count;
+
+   for (hash=ctx->seed ^ HASH_SEED_DEFAULT, j=0; j<count; ++j)
    {
-      hash += b->ptr[i];
-      hash += (hash << 10);
-      hash ^= (hash >> 6);
+      for (i=0; i<seg[j].len; ++i)
+      {
+         hash += seg[j].ptr[i];
+         hash += (hash << 10);
+         hash ^= (hash >> 6);
+      }
    }
    hash += (hash << 3);
    hash ^= (hash >> 11);
@@ -500,9 +809,8 @@ uint32_t calcHashValue_OAAT( buffer_t *b )
    return hash;
 }
 
-uint32_t calcHashValue_SBOX( buffer_t *b )
-{   
-   uint64_t sbox[256] = {
+// substitution box of the SBOX hash
+static const uint32_t sbox[256] = {
    0xF53E1837, 0x5F14C86B, 0x9EE3964C, 0xFA796D53,
    0x32223FC3, 0x4D82BC98, 0xA0C7FA62, 0x63E2C982,
    0x24994A5B, 0x1ECE7BEE, 0x292B38EF, 0xD5CD4E56,
@@ -566,24 +874,217 @@ uint32_t calcHashValue_SBOX( buffer_t *b )
    0xD9EB3E69, 0xD3C7DF60, 0xD2F2C336, 0x2DDD067B,
    0xBD122835, 0xB0B3BD3A, 0xB0D54E46, 0x8641F1E4,
    0xA0B38F96, 0x51D39199, 0x37A6AD75, 0xDF84EE41,
-   0x3C034CBA, 0xACDA62FC, 0x11923B8B, 0x45EF170A,
-                         };
-   uint32_t hash = 0;
-   uint16_t i;
-   for (i = 0; i< b->len; i++ )
-   {
-      hash ^= sbox[b->ptr[i]];
-      hash *= 3;
+   0x3C034CBA, 0xACDA62FC, 0x11923B8B, 0x45EF170A
+};
+
+// 64 bit wide substitution box of SBOX64; entry i holds sbox[i] in the
+// upper and sbox[255-i] in the lower half
+static const uint64_t sbox64[256] = {
+   0xF53E183745EF170AULL, 0x5F14C86B11923B8BULL,
+   0x9EE3964CACDA62FCULL, 0xFA796D533C034CBAULL,
+   0x32223FC3DF84EE41ULL, 0x4D82BC9837A6AD75ULL,
+   0xA0C7FA6251D39199ULL, 0x63E2C982A0B38F96ULL,
+   0x24994A5B8641F1E4ULL, 0x1ECE7BEEB0D54E46ULL,
+   0x292B38EFB0B3BD3AULL, 0xD5CD4E56BD122835ULL,
+   0x514F43032DDD067BULL, 0x7BE12B83D2F2C336ULL,
+   0x7192F195D3C7DF60ULL, 0x82DC7300D9EB3E69ULL,
+   0x084380B4151F0E64ULL, 0x480B55D3397A98E6ULL,
+   0x5F43047100C134FBULL, 0x13F75991DC813D31ULL,
+   0x3F9CF22C336B84DEULL, 0x2FE0907A1DA4B695ULL,
+   0xFD8E1E69A62B5F49ULL, 0x7B1D5DE8BB4F08E4ULL,
+   0xD575A85CAE99BBFAULL, 0xAD01C50A435BA1B2ULL,
+   0x7EE00737BC232088ULL, 0x3CE981E8876A6133ULL,
+   0x0E447EFA119BAFE2ULL, 0x23089DD6CFED03D0ULL,
+   0xB59F149F1A52C0DBULL, 0x13600EC72C550A21ULL,
+   0xE802C8E64ABC653EULL, 0x670921E4B44ECDE2ULL,
+   0x7207EFF04D54CC20ULL, 0xE74761B075D0E766ULL,
+   0x69035234068C9EC5ULL, 0xBFA40F197052A114ULL,
+   0xF63651A0D8704910ULL, 0x29E64C263DEE0689ULL,
+   0x1F98CCA74496596FULL, 0xD957007ED167BFAFULL,
+   0xE71DDC75611F3571ULL, 0x3E72959501DC4063ULL,
+   0x7580B7CC63FDC933ULL, 0xD7FAF60BDE4EB7A3ULL,
+   0x924843232C37A673ULL, 0xA44113EBFE2E0182ULL,
+   0xE4CBDE08C5CDFCB6ULL, 0x346827C9344B64D0ULL,
+   0x3CF32AFABF7D1428ULL, 0x0B29BCF1F6CD4B7FULL,
+   0x6E29F7DFE3473F3FULL, 0xB01E71CB71CB5641ULL,
+   0x3BFBC0D14D8DBA36ULL, 0x62EDC5B8387F2D75ULL,
+   0xB7DE789A472B3E4CULL, 0xA4748EC95B24ABA2ULL,
+   0xE17A4C4F3D3BFF35ULL, 0x67E5BD03900531E6ULL,
+   0xF3B33D1A6DDEF22BULL, 0x97D8D3E9A449AD03ULL,
+   0x09121BC01A58DBDFULL, 0x347B2D2CEDA20BBFULL,
+   0x79A1913CB2A42D27ULL, 0x504172DEB4B95DD6ULL,
+   0x7F1F848373E3891FULL, 0x13AC3CF6CF719928ULL,
+   0x7A2094DB6DA8D843ULL, 0xC778FA123EDF1A75ULL,
+   0xADF7469F52F206B8ULL, 0x21786B7BFA1F86C7ULL,
+   0x71A445D05ACEA629ULL, 0xA8896C1B2E9E8F46ULL,
+   0x656F62FB21300BBEULL, 0x83A059B3BE00F621ULL,
+   0x972DFE6E10D6FF74ULL, 0x4122000C69668D58ULL,
+   0x97D9DA19CE5BC543ULL, 0x17D5947B007F077FULL,
+   0xB1AFFD0CA24820C5ULL, 0x6EF83B9792AAFF6CULL,
+   0xAF7F780B1C42A9CBULL, 0x4613138A38E8D018ULL,
+   0x7C3E73A636063802ULL, 0xCF15E03D9E280F7AULL,
+   0x415763229438D42DULL, 0x672DF2920AAC88CBULL,
+   0xB658588DFC43A78FULL, 0x33EBEFA9192C2749ULL,
+   0x938CBF06D89D9C78ULL, 0x06B67381E02191A2ULL,
+   0x07F192C688D0F089ULL, 0x2BDA58554A04C34AULL,
+   0x348EE0E8D739F2B9ULL, 0x19DBB6E3F3D70AB9ULL,
+   0x3222184BBB8AEDCAULL, 0xB69D5DBA8B59E826ULL,
+   0x7E760B888F830661ULL, 0xAF4D815473E7B486ULL,
+   0x007A51ADF2C70414ULL, 0x35112500664455EAULL,
+   0xC9CD2D7D0E33E801ULL, 0x4F4FB76152B7CCDEULL,
+   0x694772E3FF105F94ULL, 0x694C8351A7846A8DULL,
+   0x4A7E3AF5E556CDA0ULL, 0x67D65CE1EED17DC0ULL,
+   0x9287DE923B4571BFULL, 0x2518DB3CB609C91BULL,
+   0x8CB4EC061F954EF6ULL, 0xD154D38FE6CE7C5CULL,
+   0xE19A26BB23F432F0ULL, 0x295EE439A7EFCB63ULL,
+   0xC50A110487BB1E2FULL, 0x2153C6A75F747F5CULL,
+   0x823666562ACFD0CFULL, 0x0713BC2F13F0D332ULL,
+   0x6462215A00078472ULL, 0x21D9BFCEE8F24803ULL,
+   0xBA8EACE6852C156DULL, 0xAE2DF4C12DA7900BULL,
+   0x2A8D5E801485B08AULL, 0x3F7E52D13BCA22A3ULL,
+   0x293593990736E92FULL, 0xFEA1D19CD1028839ULL,
+   0x1887931362609838ULL, 0x455AFA81FADFE838ULL,
+   0xFADFE838455AFA81ULL, 0x6260983818879313ULL,
+   0xD1028839FEA1D19CULL, 0x0736E92F29359399ULL,
+   0x3BCA22A33F7E52D1ULL, 0x1485B08A2A8D5E80ULL,
+   0x2DA7900BAE2DF4C1ULL, 0x852C156DBA8EACE6ULL,
+   0xE8F2480321D9BFCEULL, 0x000784726462215AULL,
+   0x13F0D3320713BC2FULL, 0x2ACFD0CF82366656ULL,
+   0x5F747F5C2153C6A7ULL, 0x87BB1E2FC50A1104ULL,
+   0xA7EFCB63295EE439ULL, 0x23F432F0E19A26BBULL,
+   0xE6CE7C5CD154D38FULL, 0x1F954EF68CB4EC06ULL,
+   0xB609C91B2518DB3CULL, 0x3B4571BF9287DE92ULL,
+   0xEED17DC067D65CE1ULL, 0xE556CDA04A7E3AF5ULL,
+   0xA7846A8D694C8351ULL, 0xFF105F94694772E3ULL,
+   0x52B7CCDE4F4FB761ULL, 0x0E33E801C9CD2D7DULL,
+   0x664455EA35112500ULL, 0xF2C70414007A51ADULL,
+   0x73E7B486AF4D8154ULL, 0x8F8306617E760B88ULL,
+   0x8B59E826B69D5DBAULL, 0xBB8AEDCA3222184BULL,
+   0xF3D70AB919DBB6E3ULL, 0xD739F2B9348EE0E8ULL,
+   0x4A04C34A2BDA5855ULL, 0x88D0F08907F192C6ULL,
+   0xE02191A206B67381ULL, 0xD89D9C78938CBF06ULL,
+   0x192C274933EBEFA9ULL, 0xFC43A78FB658588DULL,
+   0x0AAC88CB672DF292ULL, 0x9438D42D41576322ULL,
+   0x9E280F7ACF15E03DULL, 0x360638027C3E73A6ULL,
+   0x38E8D0184613138AULL, 0x1C42A9CBAF7F780BULL,
+   0x92AAFF6C6EF83B97ULL, 0xA24820C5B1AFFD0CULL,
+   0x007F077F17D5947BULL, 0xCE5BC54397D9DA19ULL,
+   0x69668D584122000CULL, 0x10D6FF74972DFE6EULL,
+   0xBE00F62183A059B3ULL, 0x21300BBE656F62FBULL,
+   0x2E9E8F46A8896C1BULL, 0x5ACEA62971A445D0ULL,
+   0xFA1F86C721786B7BULL, 0x52F206B8ADF7469FULL,
+   0x3EDF1A75C778FA12ULL, 0x6DA8D8437A2094DBULL,
+   0xCF71992813AC3CF6ULL, 0x73E3891F7F1F8483ULL,
+   0xB4B95DD6504172DEULL, 0xB2A42D2779A1913CULL,
+   0xEDA20BBF347B2D2CULL, 0x1A58DBDF09121BC0ULL,
+   0xA449AD0397D8D3E9ULL, 0x6DDEF22BF3B33D1AULL,
+   0x900531E667E5BD03ULL, 0x3D3BFF35E17A4C4FULL,
+   0x5B24ABA2A4748EC9ULL, 0x472B3E4CB7DE789AULL,
+   0x387F2D7562EDC5B8ULL, 0x4D8DBA363BFBC0D1ULL,
+   0x71CB5641B01E71CBULL, 0xE3473F3F6E29F7DFULL,
+   0xF6CD4B7F0B29BCF1ULL, 0xBF7D14283CF32AFAULL,
+   0x344B64D0346827C9ULL, 0xC5CDFCB6E4CBDE08ULL,
+   0xFE2E0182A44113EBULL, 0x2C37A67392484323ULL,
+   0xDE4EB7A3D7FAF60BULL, 0x63FDC9337580B7CCULL,
+   0x01DC40633E729595ULL, 0x611F3571E71DDC75ULL,
+   0xD167BFAFD957007EULL, 0x4496596F1F98CCA7ULL,
+   0x3DEE068929E64C26ULL, 0xD8704910F63651A0ULL,
+   0x7052A114BFA40F19ULL, 0x068C9EC569035234ULL,
+   0x75D0E766E74761B0ULL, 0x4D54CC207207EFF0ULL,
+   0xB44ECDE2670921E4ULL, 0x4ABC653EE802C8E6ULL,
+   0x2C550A2113600EC7ULL, 0x1A52C0DBB59F149FULL,
+   0xCFED03D023089DD6ULL, 0x119BAFE20E447EFAULL,
+   0x876A61333CE981E8ULL, 0xBC2320887EE00737ULL,
+   0x435BA1B2AD01C50AULL, 0xAE99BBFAD575A85CULL,
+   0xBB4F08E47B1D5DE8ULL, 0xA62B5F49FD8E1E69ULL,
+   0x1DA4B6952FE0907AULL, 0x336B84DE3F9CF22CULL,
+   0xDC813D3113F75991ULL, 0x00C134FB5F430471ULL,
+   0x397A98E6480B55D3ULL, 0x151F0E64084380B4ULL,
+   0xD9EB3E6982DC7300ULL, 0xD3C7DF607192F195ULL,
+   0xD2F2C3367BE12B83ULL, 0x2DDD067B514F4303ULL,
+   0xBD122835D5CD4E56ULL, 0xB0B3BD3A292B38EFULL,
+   0xB0D54E461ECE7BEEULL, 0x8641F1E424994A5BULL,
+   0xA0B38F9663E2C982ULL, 0x51D39199A0C7FA62ULL,
+   0x37A6AD754D82BC98ULL, 0xDF84EE4132223FC3ULL,
+   0x3C034CBAFA796D53ULL, 0xACDA62FC9EE3964CULL,
+   0x11923B8B5F14C86BULL, 0x45EF170AF53E1837ULL
+};
+
+// the lookups of a group are independent, only xor and multiply chain
+#define SBOX_ROUNDS(hash, table, p, len) \
+{ \
+   for( ; len >= 4; len -= 4, p += 4 ) { \
+      hash ^= table[p[0]]; hash *= 3; \
+      hash ^= table[p[1]]; hash *= 3; \
+      hash ^= table[p[2]]; hash *= 3; \
+      hash ^= table[p[3]]; hash *= 3; \
+   } \
+   for( ; len > 0; --len, ++p ) { \
+      hash ^= table[*p]; hash *= 3; \
+   } \
+}
+
+uint32_t calcHashValue_SBOX( const hash_ctx_t *ctx, buffer_t *b )
+{   
+   uint32_t       hash = ctx->seed ^ HASH_SEED_DEFAULT;
+   const uint8_t* p;
+   uint32_t       len, i;
+
+   if( 0 == b->count ) {
+      p   = b->ptr;
+      len = b->len;
+      SBOX_ROUNDS( hash, sbox, p, len );
+      return hash;
+   }
+   for( i = 0; i < b->count; ++i ) {
+      p   = b->seg[i].ptr;
+      len = b->seg[i].len;
+      SBOX_ROUNDS( hash, sbox, p, len );
    }
    return hash;
 }
 
+// same scheme on a 64 bit state, folded to 32 bit at the end
+uint32_t calcHashValue_SBOX64( const hash_ctx_t *ctx, buffer_t *b )
+{   
+   uint64_t       hash = ctx->seed ^ HASH_SEED_DEFAULT;
+   const uint8_t* p;
+   uint32_t       len, i;
+
+   if( 0 == b->count ) {
+      p   = b->ptr;
+      len = b->len;
+      SBOX_ROUNDS( hash, sbox64, p, len );
+      return (uint32_t) (hash >> 32) ^ (uint32_t) hash;
+   }
+   for( i = 0; i < b->count; ++i ) {
+      p   = b->seg[i].ptr;
+      len = b->seg[i].len;
+      SBOX_ROUNDS( hash, sbox64, p, len );
+   }
+   return (uint32_t) (hash >> 32) ^ (uint32_t) hash;
+}
 
 
-uint32_t calcHashValue_TWMXRSHash( buffer_t *b )
+
+uint32_t calcHashValue_TWMXRSHash( const hash_ctx_t *ctx, buffer_t *b )
 {
-   uint32_t result;
-   result = TWMXHash(b->ptr, b->len, initval);
+   uint32_t     result;
+   twmx_state_t state;
+   uint32_t     i;
+
+   if( 0 == b->count ) {
+      return TWMXHash(b->ptr, b->len, ctx->seed);
+   }
+   if( 1 == b->count ) {
+      return TWMXHash((uint8_t*)b->seg[0].ptr, b->seg[0].len, ctx->seed);
+   }
+
+   TWMXHash_init( &state, ctx->seed );
+   for( i = 0; i < b->count; ++i ) {
+      TWMXHash_update( &state, b->seg[i].ptr, b->seg[i].len );
+   }
+   result = TWMXHash_final( &state );
    return result;
 }
 
@@ -596,10 +1097,14 @@ void findHeaders( const uint8_t *packet, uint16_t packetLength, uint32_t *header
    int offs     = headerOffset[L_NET];
    int net_type = 0;
    int proto    = 0;
+   int next     = 0;
+   uint16_t frag = 0;
 
    // printf("IPv4 Pacet \n", headerOffset[L_NET]);
    headerOffset[L_TRANS]   = -1;  // the offset will be -1.
    headerOffset[L_PAYLOAD] = -1;
+   headerOffset[L_FRAG]    = -1;
+   layers[L_FRAG]          = F_NONE;
 
    // get the type of this layer from the IP version
    if ((packet[headerOffset[L_NET]] & 0xf0) == (6<<4)) {
@@ -621,26 +1126,51 @@ void findHeaders( const uint8_t *packet, uint16_t packetLength, uint32_t *header
          offs += ((packet[headerOffset[L_NET]] & 0x0F) << 2);  // IHL -> bits 4-7 schow length in 32 bits values
          proto = packet[headerOffset[L_NET] + 9];
          layers[L_NET] = N_IP;
+         // more fragments flag, fragment offset
+         frag = ntohs(*((uint16_t*) (packet + headerOffset[L_NET] + 6)));
+         if (frag & 0x3FFF) {
+            // the identification is at the same position as in
+            // the IPv6 fragment header
+            headerOffset[L_FRAG] = headerOffset[L_NET];
+            layers[L_FRAG]       = (frag & 0x1FFF) ? F_NEXT : F_FIRST;
+         }
          break;
       case 0x86DD:
          layers[L_NET] = N_IP6;
          // IPv6
          offs += IP6_HLEN;  // 40 byte IP6 Length
          proto = packet[headerOffset[L_NET] + 6];
-         // IPv6 skip options
-         // FIXME currenty ESP is not supported
+         // IPv6 skip extension headers; 'offs' is the start of the next
+         // header, its first byte the type of the header after it
+         // ESP encrypts the transport header; it ends the chain
          while (     (proto == IP6HDR_HOP)
                || (proto == IP6HDR_ROUTE)
                || (proto == IP6HDR_FRAG)
                || (proto == IP6HDR_AH)
-               || (proto == IP6HDR_DEST) )
+               || (proto == IP6HDR_DEST)
+               || (proto == IP6HDR_MOBILITY) )
          {
-            if (proto != IP6HDR_AH) {
-               offs += packet[headerOffset[L_NET] + offs + 1] * 8 + 8;
+            if (offs + 8 > packetLength) {
+               // truncated (snaplength); no transport header
+               layers[L_TRANS] = T_UNKNOWN;
+               return;
+            }
+            next = packet[offs];
+            if (proto == IP6HDR_FRAG) {
+               // fragment offset, more fragments flag
+               frag = ntohs(*((uint16_t*) (packet + offs + 2)));
+               if (frag & 0xFFF9) {
+                  headerOffset[L_FRAG] = offs;
+                  layers[L_FRAG]       = (frag & 0xFFF8) ? F_NEXT : F_FIRST;
+               }
+               // fixed length, the second byte is reserved
+               offs += 8;
+            } else if (proto != IP6HDR_AH) {
+               offs += packet[offs + 1] * 8 + 8;
             } else {
-               offs += packet[headerOffset[L_NET] + offs + 1] * 4 + 8;
+               offs += packet[offs + 1] * 4 + 8;
             }
-            proto = packet[headerOffset[L_NET] + offs];
+            proto = next;
          }
 
          break;
@@ -650,6 +1180,8 @@ void findHeaders( const uint8_t *packet, uint16_t packetLength, uint32_t *header
          return;
    }
 
+   // later fragments get a transport offset nevertheless, like in older
+   // versions (-g none); fragment_hash() takes it back for the other policies
    if (offs<packetLength) {
       headerOffset[L_TRANS] = offs;
    } else {
@@ -692,6 +1224,45 @@ void findHeaders( const uint8_t *packet, uint16_t packetLength, uint32_t *header
       return;
    }
 }
+
+/**
+ * the network layer only, for the selection functions on the ip header;
+ * falls back to findHeaders() for fragments, IPv6 extension headers and
+ * other versions. Returns 1 if all headers were located, 0 if the offsets
+ * above the network layer are not set.
+ */
+int findNetHeader( const uint8_t *packet, uint16_t packetLength, uint32_t *headerOffset, uint8_t *layers )
+{
+   const uint8_t *net = packet + headerOffset[L_NET];
+   uint8_t proto;
+
+   switch (net[0] & 0xf0) {
+      case (4<<4):
+         // more fragments flag, fragment offset
+         if (0 == (ntohs(*((uint16_t*) (net + 6))) & 0x3FFF)) {
+            layers[L_NET] = N_IP;
+            layers[L_FRAG] = F_NONE;
+            return 0;
+         }
+         break;
+      case (6<<4):
+         proto = net[6];
+         if (     (proto != IP6HDR_HOP)
+               && (proto != IP6HDR_ROUTE)
+               && (proto != IP6HDR_FRAG)
+               && (proto != IP6HDR_AH)
+               && (proto != IP6HDR_DEST)
+               && (proto != IP6HDR_MOBILITY) )
+         {
+            layers[L_NET] = N_IP6;
+            layers[L_FRAG] = F_NONE;
+            return 0;
+         }
+         break;
+   }
+   findHeaders( packet, packetLength, headerOffset, layers );
+   return 1;
+}
 //#endif // PFRING
 
 //
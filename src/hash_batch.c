@@ -0,0 +1,296 @@
+/*
+ * impd4e - a small network probe which allows to monitor and sample datagrams
+ * from the network based on hash-based packet selection.
+ *
+ * Copyright (c) 2011
+ *
+ * Fraunhofer FOKUS
+ * www.fokus.fraunhofer.de
+ *
+ * in cooperation with
+ *
+ * Technical University Berlin
+ * www.av.tu-berlin.de
+ *
+ * authors:
+ * Ramon Masek <ramon.masek@fokus.fraunhofer.de>
+ * Christian Henke <c.henke@tu-berlin.de>
+ * Carsten Schmoll <carsten.schmoll@fokus.fraunhofer.de>
+ *
+ * For questions/comments contact packettracking@fokus.fraunhofer.de
+ *
+ * This program is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software Foundation;
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * batch interface of the hash functions
+ *
+ * The hash inputs of a burst are grouped by length; each group is
+ * transposed into 32 bit words per lane and hashed with GCC vector
+ * extensions, so the same code runs on SSE2 (4 lanes), AVX2 (8 lanes) or
+ * AVX-512 (16 lanes). The instruction set is chosen at runtime on first
+ * use; the results are identical to the scalar hash functions in hash.c.
+ *
+ * Only BOB, OAAT and TWMX have lane kernels, and only inputs of
+ * HASH_BATCH_MIN_LEN to HASH_BATCH_MAX_LEN bytes use them; Hsieh and the
+ * short inputs are faster scalar.
+ */
+
+#include <string.h>
+
+#include "logger.h"
+#include "constants.h"
+
+#include "hash.h"
+#include "hash_batch.h"
+
+// -----------------------------------------------------------------------------
+// Structures, Typedefs
+// -----------------------------------------------------------------------------
+
+// words per lane: HASH_BATCH_MAX_LEN bytes plus zero padding for the tails
+#define BATCH_WORDS  (HASH_BATCH_MAX_LEN/4 + 4)
+
+enum { BATCH_BOB, BATCH_OAAT, BATCH_TWMX, BATCH_FUNCTIONS };
+
+typedef void (*lane_kernel_t)( const uint32_t *w, uint32_t len
+      , uint32_t seed, uint32_t *out );
+
+typedef struct batch_kernels_s {
+   uint32_t       lanes;
+   lane_kernel_t  hash[BATCH_FUNCTIONS];
+} batch_kernels_t;
+
+// -----------------------------------------------------------------------------
+// Lane kernels
+// -----------------------------------------------------------------------------
+
+#if defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__))
+#define HAVE_BATCH_KERNELS
+#endif
+
+#ifdef HAVE_BATCH_KERNELS
+
+// same as mix() in bobhash.c and twmx.c, on all lanes
+#define BATCH_BOB_MIX(a,b,c) \
+{ \
+  a -= b; a -= c; a ^= (c>>13); \
+  b -= c; b -= a; b ^= (a<<8); \
+  c -= a; c -= b; c ^= (b>>13); \
+  a -= b; a -= c; a ^= (c>>12);  \
+  b -= c; b -= a; b ^= (a<<16); \
+  c -= a; c -= b; c ^= (b>>5); \
+  a -= b; a -= c; a ^= (c>>3);  \
+  b -= c; b -= a; b ^= (a<<10); \
+  c -= a; c -= b; c ^= (b>>15); \
+}
+
+#define BATCH_TWMX_MIX(key) \
+{ \
+  key += ~(key << 15); \
+  key ^=  ((key & 0x7FFFFFFF) >> 10); \
+  key +=  (key << 3); \
+  key ^=  ((key & 0x7FFFFFFF) >> 6); \
+  key += ~(key << 11); \
+  key ^=  ((key & 0x7FFFFFFF) >> 16); \
+}
+
+// 4 lanes: SSE2 on x86, NEON/AltiVec elsewhere
+#define LANES        4
+#define LANE_TARGET
+#include "hash_batch_lanes.h"
+#undef LANES
+#undef LANE_TARGET
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_BATCH_X86
+
+#define LANES        8
+#define LANE_TARGET  __attribute__ ((target ("avx2")))
+#include "hash_batch_lanes.h"
+#undef LANES
+#undef LANE_TARGET
+
+#define LANES        16
+#define LANE_TARGET  __attribute__ ((target ("avx512f")))
+#include "hash_batch_lanes.h"
+#undef LANES
+#undef LANE_TARGET
+#endif
+
+#endif // HAVE_BATCH_KERNELS
+
+// -----------------------------------------------------------------------------
+// Variables
+// -----------------------------------------------------------------------------
+
+// widest kernels first, NULL terminated; set up on first use
+static const batch_kernels_t* kernels[4] = { NULL };
+static const char* isa = NULL;
+
+// -----------------------------------------------------------------------------
+// Prototypes
+// -----------------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+// Functions
+// -----------------------------------------------------------------------------
+
+static void batch_init() {
+   int k = 0;
+
+   isa = "scalar";
+#ifdef HAVE_BATCH_KERNELS
+#ifdef HAVE_BATCH_X86
+   __builtin_cpu_init();
+   if( __builtin_cpu_supports("avx512f") ) {
+      kernels[k++] = &lane_kernels_16;
+   }
+   if( __builtin_cpu_supports("avx2") ) {
+      kernels[k++] = &lane_kernels_8;
+   }
+   isa = (2 == k) ? "avx512f" : (1 == k) ? "avx2" : "sse2";
+#else
+   isa = "vector";
+#endif
+   kernels[k++] = &lane_kernels_4;
+#endif
+   kernels[k] = NULL;
+   LOGGER_debug( "batch hash kernels: %s", isa );
+}
+
+const char* hash_batch_isa() {
+   if( NULL == isa ) batch_init();
+   return isa;
+}
+
+// seed as the scalar hash function applies it
+static uint32_t batch_seed( int id, const hash_ctx_t* ctx ) {
+   return (BATCH_BOB == id || BATCH_TWMX == id)
+        ? ctx->seed : ctx->seed ^ HASH_SEED_DEFAULT;
+}
+
+static int batch_function( hashFunction f ) {
+   if( calcHashValue_BOB         == f ) return BATCH_BOB;
+   if( calcHashValue_OAAT        == f ) return BATCH_OAAT;
+   if( calcHashValue_TWMXRSHash  == f ) return BATCH_TWMX;
+   return -1;
+}
+
+int hash_batch_supported( hashFunction f ) {
+   return 0 <= batch_function( f );
+}
+
+// transposes 'lanes' inputs of length 'len' into little endian lane words
+static void batch_transpose( buffer_t* input[], uint32_t lanes, uint32_t len
+      , uint32_t *w )
+{
+   uint8_t  bytes[BATCH_WORDS*4];
+   uint32_t words = len/4 + 4;
+   uint32_t l, i;
+
+   for( l = 0; l < lanes; ++l ) {
+      buffer_t*  b     = input[l];
+      segment_t  whole = { b->ptr, len };
+      segment_t* seg   = (0 == b->count) ? &whole : b->seg;
+      uint32_t   count = (0 == b->count) ? 1 : b->count;
+      uint32_t   off   = 0;
+
+      // a constant size, so the compiler does not expand it into rep stos
+      memset( bytes, 0, sizeof(bytes) );
+      for( i = 0; i < count; ++i ) {
+         memcpy( bytes+off, seg[i].ptr, seg[i].len );
+         off += seg[i].len;
+      }
+
+      for( i = 0; i < words; ++i ) {
+         const uint8_t* k = bytes + 4*i;
+         w[i*lanes + l] = k[0] | ((uint32_t)k[1]<<8)
+                        | ((uint32_t)k[2]<<16) | ((uint32_t)k[3]<<24);
+      }
+   }
+}
+
+// hashes n inputs of length len; widest kernels first, the rest scalar
+static void batch_group( const hash_ctx_t* ctx, int id, uint32_t seed
+      , buffer_t* input[], uint32_t n, uint32_t len, uint32_t result[] )
+{
+   const batch_kernels_t** k = kernels;
+   uint32_t w[BATCH_WORDS*HASH_BATCH_MAX];
+   uint32_t i = 0;
+
+   while( i < n ) {
+      // widest kernel that can be filled
+      while( NULL != *k && (*k)->lanes > n-i ) ++k;
+      if( NULL == *k ) {
+         for( ; i < n; ++i ) {
+            result[i] = hash_value( ctx, input[i] );
+         }
+         break;
+      }
+
+      batch_transpose( input+i, (*k)->lanes, len, w );
+      (*k)->hash[id]( w, len, seed, result+i );
+      i += (*k)->lanes;
+   }
+}
+
+// up to HASH_BATCH_BURST inputs; the inputs of the same length share passes
+static void batch_burst( const hash_ctx_t* ctx, int id, uint32_t seed
+      , buffer_t* input[], uint32_t n, uint32_t result[] )
+{
+   buffer_t* group[HASH_BATCH_BURST];
+   uint32_t  pos[HASH_BATCH_BURST];
+   uint32_t  out[HASH_BATCH_BURST];
+   uint8_t   done[HASH_BATCH_BURST];
+   uint32_t  i, j, g;
+
+   memset( done, 0, n );
+   for( i = 0; i < n; ++i ) {
+      uint32_t len = input[i]->len;
+
+      if( done[i] ) {
+         continue;
+      }
+      if( 0 > id || HASH_BATCH_MIN_LEN > len || HASH_BATCH_MAX_LEN < len ) {
+         result[i] = hash_value( ctx, input[i] );
+         continue;
+      }
+
+      for( g = 0, j = i; j < n; ++j ) {
+         if( !done[j] && input[j]->len == len ) {
+            group[g] = input[j];
+            pos[g++] = j;
+            done[j]  = 1;
+         }
+      }
+      batch_group( ctx, id, seed, group, g, len, out );
+      for( j = 0; j < g; ++j ) {
+         result[pos[j]] = out[j];
+      }
+   }
+}
+
+void hash_batch( const hash_ctx_t* ctx, buffer_t* input[], uint32_t n, uint32_t result[] )
+{
+   int      id   = batch_function( ctx->function );
+   uint32_t seed = batch_seed( id, ctx );
+   uint32_t i;
+
+   if( NULL == isa ) batch_init();
+
+   for( i = 0; i < n; i += HASH_BATCH_BURST ) {
+      batch_burst( ctx, id, seed, input+i
+            , (n-i < HASH_BATCH_BURST) ? n-i : HASH_BATCH_BURST, result+i );
+   }
+}
@@ -61,6 +61,7 @@
 #include "logger.h"
 #include "helper.h"
 #include "constants.h"
+#include "tpacket_handler.h"
 
 #include "settings.h"
 
@@ -184,6 +185,12 @@ int get_file_desc( device_dev_t* pDevice ) {
       return pDevice->device_handle.socket;
       break;
 
+    #ifdef HAVE_TPACKET3
+   case TYPE_TPACKET:
+      return tpacket_fileno(pDevice);
+      break;
+    #endif
+
    default:
       return 0;
       break;
@@ -558,6 +565,12 @@ int set_filter(device_dev_t* pd, const char* bpf) {
    /* apply filter */
    struct bpf_program fp;
 
+   #ifdef HAVE_TPACKET3
+   if (TYPE_TPACKET == pd->device_type) {
+      return tpacket_set_filter(pd, bpf);
+   }
+   #endif
+
    if (bpf) {
       if (-1 == pcap_compile(pd->device_handle.pcap, &fp,
             bpf, 0, 0)) {
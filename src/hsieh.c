@@ -6,6 +6,8 @@
 
 #include  <inttypes.h>
 #include <stddef.h>     // "pstdint.h" /* Replaced with <stdint.h> if appropriate */
+#include <string.h>
+#include "hsieh.h"
 #undef get16bits
 #if (defined(__GNUC__) && defined(__i386__)) || defined(__WATCOMC__) \
   || defined(_MSC_VER) || defined (__BORLANDC__) || defined (__TURBOC__)
@@ -17,8 +19,8 @@
                        +(uint32_t)(((const uint8_t *)(d))[0]) )
 #endif
 
-uint32_t Hsieh_Hash(const char * data, uint16_t len) {
-uint32_t hash = len, tmp;
+uint32_t Hsieh_Hash(const char * data, uint16_t len, uint32_t seed) {
+uint32_t hash = len ^ seed, tmp;
 int rem;
 
     if (len <= 0 || data == NULL) return 0;
@@ -61,3 +63,78 @@ int rem;
 
     return hash;
 }
+
+/* incremental interface: Hsieh_Hash_init() takes the total key length,
+ * the pieces passed to Hsieh_Hash_update() have to add up to it */
+#define hsieh_block(hash, d) \
+{ \
+    uint32_t tmp; \
+    hash  += get16bits (d); \
+    tmp    = (get16bits ((d)+2) << 11) ^ hash; \
+    hash   = (hash << 16) ^ tmp; \
+    hash  += hash >> 11; \
+}
+
+void Hsieh_Hash_init(hsieh_state_t *state, uint16_t len, uint32_t seed) {
+    state->hash   = len ^ seed;
+    state->length = len;
+    state->fill   = 0;
+}
+
+void Hsieh_Hash_update(hsieh_state_t *state, const char *data, uint32_t len) {
+    uint32_t hash = state->hash;
+
+    /* complete a pending partial block */
+    if (0 != state->fill) {
+        uint32_t n = 4 - state->fill;
+        if (n > len) n = len;
+        memcpy(state->tail + state->fill, data, n);
+        state->fill += n;
+        data += n; len -= n;
+        if (4 > state->fill) return;
+        hsieh_block(hash, state->tail);
+        state->fill = 0;
+    }
+
+    for (; len >= 4; len -= 4) {
+        hsieh_block(hash, data);
+        data += 2*sizeof (uint16_t);
+    }
+
+    memcpy(state->tail, data, len);
+    state->fill = len;
+    state->hash = hash;
+}
+
+uint32_t Hsieh_Hash_final(hsieh_state_t *state) {
+    uint32_t hash = state->hash;
+    const char *data = state->tail;
+
+    if (0 == state->length) return 0;
+
+    /* Handle end cases */
+    switch (state->fill) {
+        case 3: hash += get16bits (data);
+                hash ^= hash << 16;
+                hash ^= data[sizeof (uint16_t)] << 18;
+                hash += hash >> 11;
+                break;
+        case 2: hash += get16bits (data);
+                hash ^= hash << 11;
+                hash += hash >> 17;
+                break;
+        case 1: hash += *data;
+                hash ^= hash << 10;
+                hash += hash >> 1;
+    }
+
+    /* Force "avalanching" of final 127 bits */
+    hash ^= hash << 3;
+    hash += hash >> 5;
+    hash ^= hash << 4;
+    hash += hash >> 17;
+    hash ^= hash << 25;
+    hash += hash >> 6;
+
+    return hash;
+}
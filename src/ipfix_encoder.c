@@ -0,0 +1,1101 @@
+/*
+ * impd4e - a small network probe which allows to monitor and sample datagrams
+ * from the network based on hash-based packet selection.
+ *
+ * Copyright (c) 2011
+ *
+ * Fraunhofer FOKUS
+ * www.fokus.fraunhofer.de
+ *
+ * in cooperation with
+ *
+ * Technical University Berlin
+ * www.av.tu-berlin.de
+ *
+ * authors:
+ * Ramon Masek <ramon.masek@fokus.fraunhofer.de>
+ * Christian Henke <c.henke@tu-berlin.de>
+ * Carsten Schmoll <carsten.schmoll@fokus.fraunhofer.de>
+ *
+ * For questions/comments contact packettracking@fokus.fraunhofer.de
+ *
+ * This program is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software Foundation;
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * native encoder for the packet id templates
+ *
+ * Records are written with a fixed layout straight into an MTU sized
+ * message buffer, instead of passing field arrays to ipfix_export_array().
+ * The templates are still defined with libipfix, but libipfix has no
+ * collectors: the encoder opens its own connection to each collector and
+ * sends the template sets of all templates first on every (re)connect.
+ * The records of the other templates (statistics, sync, location,
+ * selector report) go through ipfix_encode_array() and are sent to all
+ * collectors, so each collector sees one sequence number per observation
+ * domain in every distribution mode. For udp the template sets are resent
+ * by ipfix_encoder_send_templates() (RFC 7011, section 8.4).
+ *
+ * A message is sent as soon as the next record does not fit any more, so
+ * the messages are filled up to the configured size (path MTU).
+ *
+ * The encoder never sends on the thread which encodes: a finished message
+ * is copied into the bounded outbox of its collector(s), with the
+ * exporter lock held. If an outbox is full, the message is dropped and
+ * counted. The exporter thread takes the outboxes (ipfix_encoder_take(),
+ * with the lock) and sends them (ipfix_encoder_send()); so the main loop
+ * never blocks on a collector.
+ *
+ * Each collector has its own send queue. The messages are sent without
+ * blocking; what the socket does not take is queued, so a slow collector
+ * does not hold up the others. If a send fails, the connection is closed;
+ * it is reopened after COLLECTOR_RETRY_TIME seconds by the exporter.
+ * While a collector has no connection (fd < 0, or the connect is still
+ * pending), its messages go to the disk spool (if one is configured),
+ * as do the messages still queued when the connection closes and the
+ * messages which do not fit into a full queue. ipfix_encoder_replay()
+ * sends them once the collector is connected again and its queue is
+ * empty, i.e. after the template sets of the new connection.
+ *
+ * The messages are distributed among the collectors (-A): every
+ * collector gets every message, round robin per message, or the records
+ * are partitioned by packet id into a message buffer per collector.
+ */
+
+#include <stdlib.h>  // malloc
+#include <string.h>  // memcpy
+#include <errno.h>   // errno
+#include <time.h>    // time
+#include <stdio.h>   // snprintf
+#include <unistd.h>  // close
+#include <fcntl.h>
+#include <poll.h>
+#include <netdb.h>   // getaddrinfo
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+// Custom logger
+#include "logger.h"
+
+#include "ipfix.h"
+#include "ipfix_handler.h"
+#include "ipfix_encoder.h"
+#include "spool.h"
+#include "settings.h"
+
+// -----------------------------------------------------------------------------
+// Structures, Typedefs
+// -----------------------------------------------------------------------------
+
+typedef uint8_t* (*encode_func_t)( uint8_t* p, const pktid_record_t* r );
+
+/**
+ * precompiled layout of a template
+ */
+typedef struct record_layout {
+   uint16_t       set_id;   // template id used by libipfix
+   uint16_t       length;   // record length in bytes
+   encode_func_t  encode;
+} record_layout_t;
+
+typedef struct message_buffer {
+   uint8_t        data[IPFIX_MESSAGE_MAX];
+   uint8_t*       set;      // header of the current data set; NULL if none
+   uint16_t       set_id;
+   uint16_t       size;     // max message size
+   uint16_t       offset;   // fill level
+   uint32_t       nrecords; // data records
+} message_buffer_t;
+
+/**
+ * a collector and its connection; the queue holds whole messages, the
+ * first 'offset' bytes of them are already sent
+ */
+typedef struct collector_buffer {
+   const char*        host;
+   uint16_t           port;
+   int                proto;     // IPFIX_PROTO_TCP|UDP|SCTP
+   // encoding side; exporter lock held
+   uint32_t           seqno;     // records sent in this stream (rr, hash)
+   uint32_t           next_seqno;// sequence number of the next message
+   message_buffer_t   message;   // records of this collector (hash)
+   uint8_t*           outbox;    // finished messages
+   uint32_t           outboxed;  // bytes in the outbox
+   int                templates_due; // resend the template sets
+   uint64_t           lost;      // messages dropped, the outbox was full
+   collector_stats_t  shown;     // copy of stats, by ipfix_encoder_take()
+   int                shown_fd;  // copy of fd
+   // sending side; exporter thread only
+   int                fd;        // -1 if not connected
+   int                connected; // connect() completed
+   time_t             retry;     // next connection attempt
+   uint8_t*           batch;     // the outbox taken by the exporter
+   uint32_t           batched;
+   int                templates; // template sets to send
+   uint32_t           template_seqno;
+   uint8_t*           queue;
+   uint32_t           queued;    // bytes in the queue
+   uint32_t           offset;    // bytes of the queue already sent
+   int                dropping;  // the last message could not be delivered
+   collector_stats_t  stats;
+} collector_buffer_t;
+
+/**
+ * fields of a template; for the template sets
+ */
+typedef struct template_fields {
+   const export_fields_t*  fields;
+   int                     nfields;
+} template_fields_t;
+
+#define TARGET_ALL -1
+
+// -----------------------------------------------------------------------------
+// Global Variables
+// -----------------------------------------------------------------------------
+
+static record_layout_t    layouts[TEMPLATE_COUNT];
+static template_fields_t  template_fields[TEMPLATE_COUNT];
+static message_buffer_t   message = { .set = NULL, .size = IPFIX_MESSAGE_SIZE
+                                    , .offset = IPFIX_HEADER_SIZE };
+// records of ipfix_encode_array(); for all collectors
+static message_buffer_t   control = { .set = NULL, .size = IPFIX_MESSAGE_SIZE
+                                    , .offset = IPFIX_HEADER_SIZE };
+
+static collector_buffer_t collectors[MAX_COLLECTORS];
+static int                ncollectors  = 0;
+static distribution_t     distribution = DISTRIBUTE_ALL;
+static int                rr_next      = 0;
+
+// the template sets of all templates, as messages without header fields
+static uint8_t*           template_msgs = NULL;
+static uint32_t           template_len  = 0;
+
+// -----------------------------------------------------------------------------
+// Functions
+// -----------------------------------------------------------------------------
+
+static inline uint8_t* put_u8( uint8_t* p, uint8_t v ) {
+   *p = v;
+   return p + 1;
+}
+
+static inline uint8_t* put_u16( uint8_t* p, uint16_t v ) {
+   p[0] = v >> 8;
+   p[1] = v;
+   return p + 2;
+}
+
+static inline uint8_t* put_u32( uint8_t* p, uint32_t v ) {
+   p[0] = v >> 24;
+   p[1] = v >> 16;
+   p[2] = v >> 8;
+   p[3] = v;
+   return p + 4;
+}
+
+static inline uint8_t* put_u64( uint8_t* p, uint64_t v ) {
+   put_u32( p, v >> 32 );
+   put_u32( p + 4, v );
+   return p + 8;
+}
+
+static inline uint8_t* put_u24( uint8_t* p, uint32_t v ) {
+   p[0] = v >> 16;
+   p[1] = v >> 8;
+   p[2] = v;
+   return p + 3;
+}
+
+static inline uint8_t* put_ipa( uint8_t* p, const uint8_t* ipa ) {
+   memcpy( p, ipa, 4 );
+   return p + 4;
+}
+
+static inline uint8_t* put_ipa6( uint8_t* p, const uint8_t* ipa ) {
+   memcpy( p, ipa, 16 );
+   return p + 16;
+}
+
+// -----------------------------------------------------------------------------
+
+static uint8_t* encode_ts( uint8_t* p, const pktid_record_t* r ) {
+   p = put_u64( p, r->timestamp );
+   p = put_u32( p, r->hash_id );
+   return p;
+}
+
+static uint8_t* encode_min( uint8_t* p, const pktid_record_t* r ) {
+   p = put_u64( p, r->timestamp );
+   p = put_u32( p, r->hash_id );
+   p = put_u8 ( p, r->ttl );
+   return p;
+}
+
+static uint8_t* encode_ts_ttl_proto( uint8_t* p, const pktid_record_t* r ) {
+   p = put_u64( p, r->timestamp );
+   p = put_u32( p, r->hash_id );
+   p = put_u8 ( p, r->ttl );
+   p = put_u16( p, r->length );
+   p = put_u8 ( p, r->protocol );
+   p = put_u8 ( p, r->ip_version );
+   return p;
+}
+
+static uint8_t* encode_ts_ttl_proto_ip( uint8_t* p, const pktid_record_t* r ) {
+   p = put_u64( p, r->timestamp );
+   p = put_u32( p, r->hash_id );
+   p = put_u8 ( p, r->ttl );
+   p = put_u16( p, r->length );
+   p = put_u8 ( p, r->protocol );
+   p = put_u8 ( p, r->ip_version );
+   p = put_ipa( p, r->src_ipa );
+   p = put_u16( p, r->src_port );
+   p = put_ipa( p, r->dst_ipa );
+   p = put_u16( p, r->dst_port );
+   return p;
+}
+
+static uint8_t* encode_ts_ttl_proto_ip6( uint8_t* p, const pktid_record_t* r ) {
+   p = put_u64 ( p, r->timestamp );
+   p = put_u32 ( p, r->hash_id );
+   p = put_u8  ( p, r->ttl );
+   p = put_u16 ( p, r->length );
+   p = put_u8  ( p, r->protocol );
+   p = put_u8  ( p, r->ip_version );
+   p = put_ipa6( p, r->src_ipa );
+   p = put_u16 ( p, r->src_port );
+   p = put_ipa6( p, r->dst_ipa );
+   p = put_u16 ( p, r->dst_port );
+   return p;
+}
+
+static uint8_t* encode_ts_ttl_proto_ip_link( uint8_t* p, const pktid_record_t* r ) {
+   p = encode_ts_ttl_proto_ip( p, r );
+   p = put_u16( p, r->vlan_id );
+   p = put_u24( p, r->mpls_label );
+   p = put_u8 ( p, r->tunnel_type );
+   p = put_u32( p, r->tunnel_id );
+   return p;
+}
+
+static uint8_t* encode_ts_ttl_proto_ip6_link( uint8_t* p, const pktid_record_t* r ) {
+   p = encode_ts_ttl_proto_ip6( p, r );
+   p = put_u16( p, r->vlan_id );
+   p = put_u24( p, r->mpls_label );
+   p = put_u8 ( p, r->tunnel_type );
+   p = put_u32( p, r->tunnel_id );
+   return p;
+}
+
+static uint8_t* encode_flow( uint8_t* p, const flow_record_t* f ) {
+   p = put_u64( p, f->first / 1000 );
+   p = put_u64( p, f->last / 1000 );
+   if( N_IP6 == f->ip_version ) {
+      p = put_ipa6( p, f->src_ipa );
+      p = put_u16 ( p, f->src_port );
+      p = put_ipa6( p, f->dst_ipa );
+      p = put_u16 ( p, f->dst_port );
+   }
+   else {
+      p = put_ipa( p, f->src_ipa );
+      p = put_u16( p, f->src_port );
+      p = put_ipa( p, f->dst_ipa );
+      p = put_u16( p, f->dst_port );
+   }
+   p = put_u8 ( p, f->protocol );
+   p = put_u8 ( p, f->ip_version );
+   p = put_u64( p, f->packets );
+   p = put_u64( p, f->bytes );
+   p = put_u8 ( p, f->end_reason );
+   return p;
+}
+
+// -----------------------------------------------------------------------------
+
+static void set_layout( int template_id, encode_func_t encode, uint16_t length ) {
+   ipfix_template_t* t = get_template( template_id );
+
+   layouts[template_id].set_id = t->tid;
+   layouts[template_id].length = length;
+   layouts[template_id].encode = encode;
+}
+
+void ipfix_encoder_init() {
+   memset( layouts, 0, sizeof(layouts) );
+
+   set_layout( TS_ID,              encode_ts,              8+4 );
+   set_layout( MINT_ID,            encode_min,             8+4+1 );
+   set_layout( TS_TTL_PROTO_ID,    encode_ts_ttl_proto,    8+4+1+2+1+1 );
+   set_layout( TS_TTL_PROTO_IP_ID, encode_ts_ttl_proto_ip, 8+4+1+2+1+1+4+2+4+2 );
+   set_layout( TS_TTL_PROTO_IP6_ID, encode_ts_ttl_proto_ip6, 8+4+1+2+1+1+16+2+16+2 );
+   set_layout( TS_TTL_PROTO_IP_LINK_ID,  encode_ts_ttl_proto_ip_link,  8+4+1+2+1+1+4+2+4+2+2+3+1+4 );
+   set_layout( TS_TTL_PROTO_IP6_LINK_ID, encode_ts_ttl_proto_ip6_link, 8+4+1+2+1+1+16+2+16+2+2+3+1+4 );
+   // flow records are encoded by ipfix_encode_flow()
+   set_layout( FLOW_ID,            NULL,                   8+8+4+2+4+2+1+1+8+8+1 );
+   set_layout( FLOW6_ID,           NULL,                   8+8+16+2+16+2+1+1+8+8+1 );
+}
+
+// -----------------------------------------------------------------------------
+
+static inline uint16_t get_u16( const uint8_t* p ) {
+   return (p[0] << 8) | p[1];
+}
+
+static void message_reset( message_buffer_t* m ) {
+   m->set      = NULL;
+   m->offset   = IPFIX_HEADER_SIZE;
+   m->nrecords = 0;
+}
+
+static inline void close_set( message_buffer_t* m ) {
+   if( NULL != m->set ) {
+      put_u16( m->set + 2, (m->data + m->offset) - m->set );
+      m->set = NULL;
+   }
+}
+
+// start a data set, unless the current one has the same template
+static inline void open_set( message_buffer_t* m, uint16_t set_id ) {
+   if( NULL == m->set || set_id != m->set_id ) {
+      close_set( m );
+      m->set    = m->data + m->offset;
+      m->set_id = set_id;
+      put_u16( m->set, set_id );
+      m->offset += IPFIX_SET_HEADER_SIZE;
+   }
+}
+
+// header of a message of the given length
+static void message_header( uint8_t* p, uint16_t length, uint32_t seqno ) {
+   p = put_u16( p, IPFIX_VERSION );
+   p = put_u16( p, length );
+   p = put_u32( p, (uint32_t) time(NULL) );
+   p = put_u32( p, seqno );
+   p = put_u32( p, ipfix()->sourceid );
+}
+
+// -----------------------------------------------------------------------------
+
+/**
+ * close the connection; the queued messages go to the spool (a partially
+ * sent one as a whole), or they are lost
+ */
+static void collector_close( collector_buffer_t* c ) {
+   uint32_t i;
+
+   for( i = 0; i < c->queued; i += get_u16( c->queue + i + 2 ) ) {
+      if( spool_enabled() ) {
+         spool_append( c - collectors, c->queue + i, get_u16( c->queue + i + 2 ) );
+         c->stats.spooled++;
+      }
+      else {
+         c->stats.dropped++;
+      }
+   }
+   c->queued = 0;
+   c->offset = 0;
+
+   close( c->fd );
+   c->fd        = -1;
+   c->connected = 0;
+   c->retry     = time(NULL) + COLLECTOR_RETRY_TIME;
+}
+
+// template sets of all templates, in front of the data of a connection
+static void queue_templates( collector_buffer_t* c ) {
+   uint32_t i;
+
+   if( EXPORT_QUEUE_SIZE < c->queued + template_len ) {
+      return;
+   }
+   for( i = 0; i < template_len; i += get_u16( template_msgs + i + 2 ) ) {
+      uint16_t len = get_u16( template_msgs + i + 2 );
+
+      memcpy( c->queue + c->queued, template_msgs + i, len );
+      message_header( c->queue + c->queued, len, c->template_seqno );
+      c->queued += len;
+   }
+}
+
+static void collector_up( collector_buffer_t* c ) {
+   LOGGER_info( "collector %s:%d connected", c->host, c->port );
+   c->connected = 1;
+   c->dropping  = 0;
+   c->templates = 0;
+   queue_templates( c );
+}
+
+/**
+ * open a non-blocking connection to the collector; the connect of tcp and
+ * sctp completes later, see collector_ready()
+ */
+static void collector_connect( collector_buffer_t* c ) {
+   struct addrinfo hints, *res, *ai;
+   char port[8];
+   int rc;
+
+   c->retry = time(NULL) + COLLECTOR_RETRY_TIME;
+
+   memset( &hints, 0, sizeof(hints) );
+   hints.ai_family   = AF_UNSPEC;
+   hints.ai_socktype = (IPFIX_PROTO_UDP == c->proto) ? SOCK_DGRAM : SOCK_STREAM;
+   hints.ai_protocol = (IPFIX_PROTO_SCTP == c->proto) ? IPPROTO_SCTP : 0;
+   snprintf( port, sizeof(port), "%u", c->port );
+   if( 0 != (rc = getaddrinfo( c->host, port, &hints, &res )) ) {
+      LOGGER_warn( "collector %s:%d: %s", c->host, c->port, gai_strerror(rc) );
+      return;
+   }
+
+   for( ai = res; NULL != ai; ai = ai->ai_next ) {
+      c->fd = socket( ai->ai_family, ai->ai_socktype, ai->ai_protocol );
+      if( 0 > c->fd ) {
+         continue;
+      }
+      fcntl( c->fd, F_SETFL, fcntl( c->fd, F_GETFL ) | O_NONBLOCK );
+      if( 0 == connect( c->fd, ai->ai_addr, ai->ai_addrlen ) ) {
+         collector_up( c );
+         break;
+      }
+      if( EINPROGRESS == errno ) {
+         break;
+      }
+      close( c->fd );
+      c->fd = -1;
+   }
+   freeaddrinfo( res );
+}
+
+/**
+ * 1 if the collector takes data; opens the connection if it is due and
+ * completes a pending connect
+ */
+static int collector_ready( collector_buffer_t* c ) {
+   struct pollfd pfd;
+   socklen_t len = sizeof(int);
+   int err = 0;
+
+   if( 0 > c->fd ) {
+      if( time(NULL) < c->retry ) {
+         return 0;
+      }
+      collector_connect( c );
+      if( 0 > c->fd ) {
+         return 0;
+      }
+   }
+   if( c->connected ) {
+      return 1;
+   }
+
+   pfd.fd     = c->fd;
+   pfd.events = POLLOUT;
+   if( 0 == poll( &pfd, 1, 0 ) ) {
+      return 0;
+   }
+   if( 0 > getsockopt( c->fd, SOL_SOCKET, SO_ERROR, &err, &len ) || 0 != err ) {
+      LOGGER_warn( "cannot connect to collector %s:%d: %s"
+            , c->host, c->port, strerror(err ? err : errno) );
+      collector_close( c );
+      return 0;
+   }
+   collector_up( c );
+   return 1;
+}
+
+// -----------------------------------------------------------------------------
+
+/**
+ * send the queue without blocking; completely sent messages are removed.
+ * Returns -1 if the connection failed; it is closed then.
+ */
+static int queue_send( collector_buffer_t* c, int flags ) {
+   uint32_t done = 0; // completely sent messages
+   int rv = 0;
+
+   while( done < c->queued ) {
+      // one message per send; udp and sctp keep the message boundaries
+      uint32_t end = done + get_u16( c->queue + done + 2 );
+      ssize_t  n   = send( c->fd, c->queue + c->offset, end - c->offset
+                         , MSG_NOSIGNAL | flags );
+      if( 0 > n ) {
+         if( EINTR == errno ) continue;
+         if( EAGAIN == errno || EWOULDBLOCK == errno ) {
+            c->stats.blocked++;
+            break;
+         }
+         LOGGER_error( "send to collector %s:%d failed: %s"
+               , c->host, c->port, strerror(errno) );
+         rv = -1;
+         break;
+      }
+      c->offset += n;
+      c->stats.bytes += n;
+      if( c->offset == end ) {
+         done = end;
+         c->stats.messages++;
+      }
+   }
+
+   if( 0 < done ) {
+      memmove( c->queue, c->queue + done, c->queued - done );
+      c->queued -= done;
+      c->offset -= done;
+   }
+   if( 0 > rv ) {
+      collector_close( c );
+   }
+   return rv;
+}
+
+/**
+ * queue a message and send as much as the socket takes.
+ * Returns -1 if the collector is not connected or the queue is full.
+ */
+static int deliver( collector_buffer_t* c, const uint8_t* data, uint16_t len ) {
+   if( !collector_ready( c ) ) {
+      return -1;
+   }
+
+   if( EXPORT_QUEUE_SIZE < c->queued + len ) {
+      // make room first
+      queue_send( c, MSG_DONTWAIT );
+      if( EXPORT_QUEUE_SIZE < c->queued + len ) {
+         return -1;
+      }
+   }
+   memcpy( c->queue + c->queued, data, len );
+   c->queued += len;
+
+   queue_send( c, MSG_DONTWAIT );
+   return 0;
+}
+
+static void send_to( int index, const uint8_t* data, uint16_t len ) {
+   collector_buffer_t* c = &collectors[index];
+
+   if( 0 == deliver( c, data, len ) ) {
+      c->dropping = 0;
+      return;
+   }
+
+   if( spool_enabled() ) {
+      spool_append( index, data, len );
+      c->stats.spooled++;
+   }
+   else {
+      c->stats.dropped++;
+   }
+   if( !c->dropping ) {
+      c->dropping = 1;
+      LOGGER_warn( "collector %s:%d not reachable or too slow; messages are %s"
+            , c->host, c->port, spool_enabled() ? "spooled" : "dropped" );
+   }
+}
+
+// hand a finished message to the exporter thread
+static void outbox_append( collector_buffer_t* c, const uint8_t* data, uint16_t len ) {
+   if( EXPORT_QUEUE_SIZE < c->outboxed + len ) {
+      if( 0 == c->lost++ % 1000 ) {
+         LOGGER_warn( "collector %s:%d: exporter too slow, %llu messages dropped"
+               , c->host, c->port, (unsigned long long) c->lost );
+      }
+      return;
+   }
+   memcpy( c->outbox + c->outboxed, data, len );
+   c->outboxed += len;
+}
+
+/**
+ * queue the message for one collector or for all of them (TARGET_ALL);
+ * the exporter lock is held
+ */
+static void flush_to( message_buffer_t* m, int target ) {
+   int i;
+
+   if( IPFIX_HEADER_SIZE == m->offset ) {
+      return;
+   }
+   close_set( m );
+   message_header( m->data, m->offset, ipfix()->seqno );
+
+   if( DISTRIBUTE_ALL == distribution ) {
+      // the sequence number counts all data records of the observation domain
+      ipfix()->seqno += m->nrecords;
+   }
+
+   for( i = 0; i < ncollectors; ++i ) {
+      if( TARGET_ALL != target && i != target ) {
+         continue;
+      }
+      if( DISTRIBUTE_ALL != distribution ) {
+         // each collector only sees its part of the records
+         put_u32( m->data + 8, collectors[i].seqno );
+         collectors[i].seqno += m->nrecords;
+      }
+      collectors[i].next_seqno = (DISTRIBUTE_ALL == distribution)
+                               ? ipfix()->seqno : collectors[i].seqno;
+      outbox_append( &collectors[i], m->data, m->offset );
+   }
+
+   message_reset( m );
+}
+
+// the collector(s) of the next message of the shared buffer
+static int shared_target() {
+   if( DISTRIBUTE_ALL == distribution || 0 == ncollectors ) {
+      return TARGET_ALL;
+   }
+   rr_next = (rr_next + 1) % ncollectors;
+   return rr_next;
+}
+
+void ipfix_encoder_flush() {
+   int i;
+
+   flush_to( &control, TARGET_ALL );
+   flush_to( &message, shared_target() );
+   if( DISTRIBUTE_HASH == distribution ) {
+      for( i = 0; i < ncollectors; ++i ) {
+         flush_to( &collectors[i].message, i );
+      }
+   }
+}
+
+void ipfix_encoder_take() {
+   int i;
+
+   for( i = 0; i < ncollectors; ++i ) {
+      collector_buffer_t* c = &collectors[i];
+      uint8_t* p = c->batch;
+
+      // the batch of the last round is sent, queued or spooled
+      if( 0 == c->batched ) {
+         c->batch    = c->outbox;
+         c->batched  = c->outboxed;
+         c->outbox   = p;
+         c->outboxed = 0;
+      }
+
+      c->templates     |= c->templates_due;
+      c->templates_due  = 0;
+      c->template_seqno = c->next_seqno;
+
+      c->shown = c->stats;
+      c->shown.queued = c->queued - c->offset;
+      c->shown_fd = c->connected ? c->fd : -1;
+   }
+}
+
+void ipfix_encoder_send() {
+   int i;
+
+   for( i = 0; i < ncollectors; ++i ) {
+      collector_buffer_t* c = &collectors[i];
+      uint32_t k;
+
+      // also reconnects a collector which is due
+      if( collector_ready( c ) && c->templates ) {
+         queue_templates( c );
+      }
+      c->templates = 0;
+
+      for( k = 0; k < c->batched; k += get_u16( c->batch + k + 2 ) ) {
+         send_to( i, c->batch + k, get_u16( c->batch + k + 2 ) );
+      }
+      c->batched = 0;
+
+      if( c->connected && 0 < c->queued ) {
+         queue_send( c, MSG_DONTWAIT );
+      }
+   }
+}
+
+void ipfix_encoder_close() {
+   int i;
+
+   for( i = 0; i < ncollectors; ++i ) {
+      if( 0 <= collectors[i].fd ) {
+         collector_close( &collectors[i] );
+      }
+   }
+}
+
+int ipfix_encoder_poll( struct pollfd* fds, int* timeout ) {
+   time_t now = time(NULL);
+   int i, n = 0;
+
+   for( i = 0; i < ncollectors; ++i ) {
+      collector_buffer_t* c = &collectors[i];
+
+      if( 0 > c->fd ) {
+         // the next connection attempt
+         int ms = (c->retry > now) ? (c->retry - now) * 1000 : 0;
+         if( 0 > *timeout || ms < *timeout ) {
+            *timeout = ms;
+         }
+      }
+      else if( !c->connected || 0 < c->queued ) {
+         // connect completed or room for the queue
+         fds[n].fd     = c->fd;
+         fds[n].events = POLLOUT;
+         ++n;
+      }
+   }
+   return n;
+}
+
+int ipfix_encoder_queued() {
+   int i;
+
+   for( i = 0; i < ncollectors; ++i ) {
+      if( collectors[i].connected && 0 < collectors[i].queued ) {
+         return 1;
+      }
+   }
+   return 0;
+}
+
+// -----------------------------------------------------------------------------
+
+uint32_t ipfix_encoder_replay( uint32_t max_bytes ) {
+   const uint8_t* data;
+   uint8_t  index;
+   uint16_t len;
+   uint32_t bytes = 0;
+
+   if( 0 == spool_pending() ) {
+      return 0;
+   }
+
+   while( NULL != (data = spool_peek( &index, &len )) && bytes + len <= max_bytes ) {
+      collector_buffer_t* c;
+
+      if( ncollectors <= index ) {
+         // spooled for a collector which is not configured any more
+         spool_release();
+         continue;
+      }
+      c = &collectors[index];
+      // live messages first; replay only into an empty queue
+      if( !collector_ready( c ) || 0 < c->queued ) {
+         break;
+      }
+      if( 0 > deliver( c, data, len ) ) {
+         // still unreachable; the message stays in the spool
+         break;
+      }
+      spool_release();
+      c->stats.replayed++;
+      bytes += len;
+   }
+
+   if( 0 < bytes && 0 == spool_pending() ) {
+      LOGGER_info( "spool replayed" );
+   }
+   return bytes;
+}
+
+// -----------------------------------------------------------------------------
+
+/**
+ * reserve room for one record of the given layout, opening a new set if
+ * needed; the hash selects the collector in hash distribution mode
+ */
+static uint8_t* reserve_record( const record_layout_t* l, uint32_t hash ) {
+   message_buffer_t* m = &message;
+   int partitioned = (DISTRIBUTE_HASH == distribution && 0 < ncollectors);
+   int target = 0;
+   uint8_t* p;
+
+   // disjoint hash range per collector
+   if( partitioned ) {
+      target = ((uint64_t) hash * ncollectors) >> 32;
+      m = &collectors[target].message;
+   }
+
+   // a new set is needed if the template changes
+   uint16_t needed = l->length;
+   if( NULL == m->set || l->set_id != m->set_id ) {
+      needed += IPFIX_SET_HEADER_SIZE;
+   }
+   if( m->size < m->offset + needed ) {
+      flush_to( m, partitioned ? target : shared_target() );
+   }
+
+   open_set( m, l->set_id );
+
+   p = m->data + m->offset;
+   m->offset += l->length;
+   m->nrecords++;
+
+   return p;
+}
+
+int ipfix_encode_record( int template_id, const pktid_record_t* record ) {
+   const record_layout_t* l = &layouts[template_id];
+
+   if( NULL == l->encode ) {
+      LOGGER_error( "no record layout for template: %d", template_id );
+      return -1;
+   }
+
+   l->encode( reserve_record( l, record->hash_id ), record );
+
+   return 0;
+}
+
+int ipfix_encode_flow( const flow_record_t* flow, uint32_t hash ) {
+   const record_layout_t* l = &layouts[(N_IP6 == flow->ip_version) ? FLOW6_ID : FLOW_ID];
+
+   encode_flow( reserve_record( l, hash ), flow );
+   return 0;
+}
+
+/**
+ * the fields are encoded by the field types of libipfix, like
+ * ipfix_export_array() does; variable length fields get the length prefix
+ */
+int ipfix_encode_array( ipfix_template_t* t, int nfields, void** fields, uint16_t* lengths ) {
+   message_buffer_t* m = &control;
+   uint32_t length = 0;
+   uint8_t* p;
+   int i;
+
+   if( nfields != t->nfields ) {
+      LOGGER_error( "template %d has %d fields, not %d", t->tid, t->nfields, nfields );
+      return -1;
+   }
+   for( i = 0; i < nfields; ++i ) {
+      if( IPFIX_FT_VARLEN == t->fields[i].flength ) {
+         length += lengths[i] + ((255 > lengths[i]) ? 1 : 3);
+      }
+      else {
+         length += t->fields[i].flength;
+      }
+   }
+
+   if( m->size < m->offset + length + IPFIX_SET_HEADER_SIZE ) {
+      flush_to( m, TARGET_ALL );
+   }
+   if( m->size < m->offset + length + IPFIX_SET_HEADER_SIZE ) {
+      LOGGER_error( "record of template %d too long: %u", t->tid, length );
+      return -1;
+   }
+   open_set( m, t->tid );
+
+   p = m->data + m->offset;
+   for( i = 0; i < nfields; ++i ) {
+      if( IPFIX_FT_VARLEN == t->fields[i].flength ) {
+         if( 255 > lengths[i] ) {
+            p = put_u8( p, lengths[i] );
+         }
+         else {
+            p = put_u8 ( p, 255 );
+            p = put_u16( p, lengths[i] );
+         }
+         memcpy( p, fields[i], lengths[i] );
+         p += lengths[i];
+      }
+      else {
+         if( 0 > t->fields[i].elem->encode( fields[i], p, t->fields[i].flength ) ) {
+            LOGGER_error( "cannot encode field %d of template %d", i, t->tid );
+         }
+         p += t->fields[i].flength;
+      }
+   }
+   m->offset = p - m->data;
+   m->nrecords++;
+
+   return 0;
+}
+
+// -----------------------------------------------------------------------------
+
+void ipfix_encoder_set_collectors( struct options* options ) {
+   int i;
+
+   ipfix_encoder_flush();
+   distribution = options->distribution;
+
+   // in the order given on the command line; hash ranges depend on it
+   for( i = 0; i < options->number_collectors; ++i ) {
+      const collector_addr_t* a = &options->collectors[i];
+      collector_buffer_t* c = &collectors[ncollectors++];
+
+      memset( c, 0, sizeof(collector_buffer_t) );
+      c->host  = a->host;
+      c->port  = (0 != a->port) ? a->port : options->collectorPort;
+      c->proto = options->collectorProto;
+      // connected by the first message
+      c->fd    = -1;
+      c->message.size = message.size;
+      message_reset( &c->message );
+      c->shown_fd = -1;
+      c->outbox = malloc( EXPORT_QUEUE_SIZE );
+      c->batch  = malloc( EXPORT_QUEUE_SIZE );
+      c->queue  = malloc( EXPORT_QUEUE_SIZE );
+      if( NULL == c->outbox || NULL == c->batch || NULL == c->queue ) {
+         LOGGER_fatal( "cannot allocate collector queue: %s", strerror(errno));
+         exit(1);
+      }
+   }
+   LOGGER_info( "collectors: %d", ncollectors );
+}
+
+int ipfix_encoder_collector_stats( int index, const char** host, int* port
+      , collector_stats_t* stats ) {
+   collector_buffer_t* c;
+
+   if( index >= ncollectors ) {
+      return -1;
+   }
+   c = &collectors[index];
+   *host  = c->host;
+   *port  = c->port;
+   *stats = c->shown;
+   stats->dropped += c->lost;
+   stats->queued  += c->outboxed;
+   return 0;
+}
+
+int ipfix_encoder_collector_fd( int index ) {
+   if( index >= ncollectors ) {
+      return -1;
+   }
+   return collectors[index].shown_fd;
+}
+
+// -----------------------------------------------------------------------------
+
+void ipfix_encoder_add_template( int template_id, const export_fields_t* fields, int nfields ) {
+   template_fields[template_id].fields  = fields;
+   template_fields[template_id].nfields = nfields;
+}
+
+static uint16_t template_record_length( const template_fields_t* t ) {
+   uint16_t length = 4;
+   int i;
+
+   for( i = 0; i < t->nfields; ++i ) {
+      length += (0 == t->fields[i].eno) ? 4 : 8;
+   }
+   return length;
+}
+
+static void template_message_done( message_buffer_t* m ) {
+   if( IPFIX_HEADER_SIZE == m->offset ) {
+      return;
+   }
+   close_set( m );
+   // the other header fields are written when the message is queued
+   put_u16( m->data + 2, m->offset );
+   memcpy( template_msgs + template_len, m->data, m->offset );
+   template_len += m->offset;
+   message_reset( m );
+}
+
+/**
+ * encode the template sets of all templates into messages of the
+ * current message size, in their own messages
+ */
+static void build_templates() {
+   static message_buffer_t m;
+   uint32_t size = 0;
+   int i, k;
+
+   for( i = 0; i < TEMPLATE_COUNT; ++i ) {
+      if( NULL != template_fields[i].fields ) {
+         size += IPFIX_HEADER_SIZE + IPFIX_SET_HEADER_SIZE
+               + template_record_length( &template_fields[i] );
+      }
+   }
+   free( template_msgs );
+   if( NULL == (template_msgs = malloc( size )) ) {
+      LOGGER_fatal( "cannot allocate template sets: %s", strerror(errno));
+      exit(1);
+   }
+   template_len = 0;
+   m.size = message.size;
+   message_reset( &m );
+
+   for( i = 0; i < TEMPLATE_COUNT; ++i ) {
+      const template_fields_t* t = &template_fields[i];
+      uint16_t needed;
+      uint8_t* p;
+
+      if( NULL == t->fields ) {
+         continue;
+      }
+
+      needed = template_record_length( t );
+      if( NULL == m.set ) {
+         needed += IPFIX_SET_HEADER_SIZE;
+      }
+      if( m.size < m.offset + needed ) {
+         template_message_done( &m );
+      }
+      if( NULL == m.set ) {
+         m.set    = m.data + m.offset;
+         m.set_id = IPFIX_SETID_TEMPLATE;
+         put_u16( m.set, IPFIX_SETID_TEMPLATE );
+         m.offset += IPFIX_SET_HEADER_SIZE;
+      }
+
+      // template record header, field specifiers
+      p = m.data + m.offset;
+      p = put_u16( p, get_template(i)->tid );
+      p = put_u16( p, t->nfields );
+      for( k = 0; k < t->nfields; ++k ) {
+         const export_fields_t* f = &t->fields[k];
+         if( 0 == f->eno ) {
+            p = put_u16( p, f->ienum );
+            p = put_u16( p, f->length );
+         }
+         else {
+            p = put_u16( p, 0x8000 | f->ienum );
+            p = put_u16( p, f->length );
+            p = put_u32( p, f->eno );
+         }
+      }
+      m.offset = p - m.data;
+   }
+   template_message_done( &m );
+}
+
+void ipfix_encoder_set_message_size( uint16_t size ) {
+   int i;
+
+   if( IPFIX_HEADER_SIZE + IPFIX_SET_HEADER_SIZE + 64 > size ) {
+      LOGGER_warn( "ipfix message size too small: %u", size );
+      size = IPFIX_HEADER_SIZE + IPFIX_SET_HEADER_SIZE + 64;
+   }
+   ipfix_encoder_flush();
+   message.size = size;
+   control.size = size;
+   for( i = 0; i < ncollectors; ++i ) {
+      collectors[i].message.size = size;
+   }
+   build_templates();
+   LOGGER_info( "ipfix message size: %u", size );
+}
+
+void ipfix_encoder_send_templates() {
+   int i;
+
+   // queued by the exporter; new connections get them anyway
+   for( i = 0; i < ncollectors; ++i ) {
+      collectors[i].templates_due = 1;
+   }
+}
@@ -49,6 +49,7 @@
 
 #include "ipfix_handler.h"
 #include "ipfix_templates.h"
+#include "ipfix_encoder.h"
 
 // ----------------------------------------------------------------------------
 // ----------------------------------------------------------------------------
@@ -58,14 +59,31 @@
 // -----------------------------------------------------------------------------
 ipfix_t*          ipfix_handle = NULL;
 
+// probe internal information elements, see ipfix_templates.h
+ipfix_field_type_t ipfix_ft_impd4e[] = {
+    { IPFIX_ENO_FOKUS, IPFIX_FT_PT_EXPORT_RING_FILL, 4, IPFIX_CODING_UINT,
+      "pt_export_ring_fill", "PT packet id records waiting in the export ring" },
+    { IPFIX_ENO_FOKUS, IPFIX_FT_PT_TUNNEL_TYPE, 1, IPFIX_CODING_UINT,
+      "pt_tunnel_type", "PT tunnel of the packet: 1 ip-in-ip, 2 gre, 4 vxlan, 8 gtp-u" },
+    { IPFIX_ENO_FOKUS, IPFIX_FT_PT_TUNNEL_ID, 4, IPFIX_CODING_UINT,
+      "pt_tunnel_id", "PT tunnel id of the packet: gre key, vxlan vni, gtp-u teid" },
+    { 0, 0, -1, 0, NULL, NULL }
+};
+
    ipfix_template_t *ipfixtmpl_min;
    ipfix_template_t *ipfixtmpl_ts;
    ipfix_template_t *ipfixtmpl_ts_ttl;
    ipfix_template_t *ipfixtmpl_ts_ttl_ip;
+   ipfix_template_t *ipfixtmpl_flow;
+   ipfix_template_t *ipfixtmpl_ts_ttl_ip6;
+   ipfix_template_t *ipfixtmpl_flow6;
+   ipfix_template_t *ipfixtmpl_ts_ttl_ip_link;
+   ipfix_template_t *ipfixtmpl_ts_ttl_ip6_link;
    ipfix_template_t *ipfixtmpl_interface_stats;
    ipfix_template_t *ipfixtmpl_probe_stats;
    ipfix_template_t *ipfixtmpl_sync;
    ipfix_template_t *ipfixtmpl_location;
+   ipfix_template_t *ipfixtmpl_selector;
 
 //typedef enum template_id_u{
 //        LOCATION_ID = 0
@@ -90,12 +108,24 @@ ipfix_template_t  **templates[] = {
                     &ipfixtmpl_ts,
                     &ipfixtmpl_ts_ttl,
                     &ipfixtmpl_ts_ttl_ip,
+                    &ipfixtmpl_flow,
+                    &ipfixtmpl_ts_ttl_ip6,
+                    &ipfixtmpl_flow6,
+                    &ipfixtmpl_ts_ttl_ip_link,
+                    &ipfixtmpl_ts_ttl_ip6_link,
+                    &ipfixtmpl_selector,
                                  };
 
 // -----------------------------------------------------------------------------
 // Structures, Typedefs
 // -----------------------------------------------------------------------------
 
+// header sizes below the ipfix message
+#define IPV6_HEADER_SIZE  40
+#define UDP_HEADER_SIZE    8
+#define TCP_HEADER_SIZE   32 // including the timestamp option
+#define SCTP_HEADER_SIZE  28 // common header and DATA chunk header
+
 
 // -----------------------------------------------------------------------------
 // local Prototypes
@@ -115,6 +145,25 @@ ipfix_t* ipfix() {
 
 // -----------------------------------------------------------------------------
 
+/**
+ * the probe internal elements must not reuse a number of the FOKUS
+ * elements of the libipfix in use
+ */
+static int check_impd4e_elements() {
+   ipfix_field_type_t *p, *f;
+
+   for (p = ipfix_ft_impd4e; 0 != p->ftype; ++p) {
+      for (f = ipfix_ft_fokus; 0 != f->ftype; ++f) {
+         if (f->eno == p->eno && f->ftype == p->ftype) {
+            LOGGER_fatal( "IE %d (%s) is already the FOKUS IE %s", p->ftype
+                  , p->name, f->name);
+            return -1;
+         }
+      }
+   }
+   return 0;
+}
+
 void libipfix_init(uint32_t observation_id) {
    if( NULL == ipfix_handle ) {
       if (ipfix_init() < 0) {
@@ -126,6 +175,13 @@ void libipfix_init(uint32_t observation_id) {
          LOGGER_fatal( "cannot add FOKUS IEs: %s\n", strerror(errno));
          exit(EXIT_FAILURE);
       }
+      if (0 > check_impd4e_elements()) {
+         exit(EXIT_FAILURE);
+      }
+      if (ipfix_add_vendor_information_elements(ipfix_ft_impd4e) < 0) {
+         LOGGER_fatal( "cannot add probe IEs: %s\n", strerror(errno));
+         exit(EXIT_FAILURE);
+      }
 
       if (ipfix_open(&ipfix_handle, observation_id, IPFIX_VERSION) < 0) {
          LOGGER_fatal( "ipfix_open() failed: %s", strerror(errno));
@@ -160,6 +216,31 @@ void libipfix_register_templates() {
       LOGGER_fatal("template initialization failed: %s", strerror(errno));
       exit(EXIT_FAILURE);
    }
+   if (IPFIX_MAKE_TEMPLATE( ipfix(),
+           ipfixtmpl_flow, export_fields_flow) < 0) {
+      LOGGER_fatal("template initialization failed: %s", strerror(errno));
+      exit(EXIT_FAILURE);
+   }
+   if (IPFIX_MAKE_TEMPLATE( ipfix(),
+           ipfixtmpl_ts_ttl_ip6, export_fields_ts_ttl_proto_ip6) < 0) {
+      LOGGER_fatal("template initialization failed: %s", strerror(errno));
+      exit(EXIT_FAILURE);
+   }
+   if (IPFIX_MAKE_TEMPLATE( ipfix(),
+           ipfixtmpl_flow6, export_fields_flow6) < 0) {
+      LOGGER_fatal("template initialization failed: %s", strerror(errno));
+      exit(EXIT_FAILURE);
+   }
+   if (IPFIX_MAKE_TEMPLATE( ipfix(),
+           ipfixtmpl_ts_ttl_ip_link, export_fields_ts_ttl_proto_ip_link) < 0) {
+      LOGGER_fatal("template initialization failed: %s", strerror(errno));
+      exit(EXIT_FAILURE);
+   }
+   if (IPFIX_MAKE_TEMPLATE( ipfix(),
+           ipfixtmpl_ts_ttl_ip6_link, export_fields_ts_ttl_proto_ip6_link) < 0) {
+      LOGGER_fatal("template initialization failed: %s", strerror(errno));
+      exit(EXIT_FAILURE);
+   }
 
    if (IPFIX_MAKE_TEMPLATE( ipfix(),
             ipfixtmpl_interface_stats, export_fields_interface_stats) < 0) {
@@ -181,19 +262,74 @@ void libipfix_register_templates() {
       LOGGER_fatal("template initialization failed: %s", strerror(errno));
       exit(EXIT_FAILURE);
    }
+   if (IPFIX_MAKE_TEMPLATE( ipfix(),
+            ipfixtmpl_selector, export_fields_selector) < 0) {
+      LOGGER_fatal("template initialization failed: %s", strerror(errno));
+      exit(EXIT_FAILURE);
+   }
+
+   // record layouts of the packet id templates
+   ipfix_encoder_init();
+
+   // fields of all templates, for the template retransmission (udp)
+   #define ENCODER_ADD_TEMPLATE(id, fields) \
+      ipfix_encoder_add_template(id, fields, sizeof(fields) / sizeof(export_fields_t))
+   ENCODER_ADD_TEMPLATE( LOCATION_ID,        export_fields_location );
+   ENCODER_ADD_TEMPLATE( SYNC_ID,            export_fields_sync );
+   ENCODER_ADD_TEMPLATE( PROBE_STATS_ID,     export_fields_probe_stats );
+   ENCODER_ADD_TEMPLATE( INTF_STATS_ID,      export_fields_interface_stats );
+   ENCODER_ADD_TEMPLATE( MINT_ID,            export_fields_min );
+   ENCODER_ADD_TEMPLATE( TS_ID,              export_fields_ts );
+   ENCODER_ADD_TEMPLATE( TS_TTL_PROTO_ID,    export_fields_ts_ttl_proto );
+   ENCODER_ADD_TEMPLATE( TS_TTL_PROTO_IP_ID, export_fields_ts_ttl_proto_ip );
+   ENCODER_ADD_TEMPLATE( FLOW_ID,            export_fields_flow );
+   ENCODER_ADD_TEMPLATE( TS_TTL_PROTO_IP6_ID, export_fields_ts_ttl_proto_ip6 );
+   ENCODER_ADD_TEMPLATE( FLOW6_ID,           export_fields_flow6 );
+   ENCODER_ADD_TEMPLATE( TS_TTL_PROTO_IP_LINK_ID,  export_fields_ts_ttl_proto_ip_link );
+   ENCODER_ADD_TEMPLATE( TS_TTL_PROTO_IP6_LINK_ID, export_fields_ts_ttl_proto_ip6_link );
+   ENCODER_ADD_TEMPLATE( SELECTOR_ID,        export_fields_selector );
+   #undef ENCODER_ADD_TEMPLATE
    return;
 }
 
 // -----------------------------------------------------------------------------
 
 void libipfix_connect( options_t *options ) {
-   // add collector
+   // headers below the ipfix message; room for an IPv6 header
+   uint16_t overhead = IPV6_HEADER_SIZE;
+   int i;
+
+   switch (options->collectorProto) {
+   case IPFIX_PROTO_UDP:
+      overhead += UDP_HEADER_SIZE;
+      break;
+   case IPFIX_PROTO_SCTP:
+      overhead += SCTP_HEADER_SIZE;
+      break;
+   case IPFIX_PROTO_TCP:
+   default:
+      overhead += TCP_HEADER_SIZE;
+      break;
+   }
+
+   // add collectors
    // -------------------------------------------------------------------------
-   if (ipfix_add_collector( ipfix(),
-            options->collectorIP, options->collectorPort, IPFIX_PROTO_TCP) < 0) {
-      LOGGER_error("ipfix_add_collector(%s,%d) failed: %s",
-            options->collectorIP, options->collectorPort, strerror(errno));
+   if (0 == options->number_collectors) {
+      strcpy(options->collectors[0].host, "localhost");
+      options->collectors[0].port = 0;
+      options->number_collectors = 1;
    }
+   for (i = 0; i < options->number_collectors; ++i) {
+      collector_addr_t* c = &options->collectors[i];
+      if (0 == c->port) {
+         c->port = options->collectorPort;
+      }
+   }
+   // the encoder has its own connections; libipfix only keeps the templates
+   ipfix_encoder_set_collectors( options );
+
+   // a message of the encoder fits into one packet of the path
+   ipfix_encoder_set_message_size( options->path_mtu - overhead );
    return;
 }
 
@@ -309,15 +445,14 @@ ipfix_template_t* get_template( int template_id ) {
 // -----------------------------------------------------------------------------
 
 /**
- * This causes libipfix to send cached messages to
- * the registered collectors.
+ * This hands the buffered messages of the encoder to the exporter
+ * thread, which sends them to the collectors. Called with the exporter
+ * lock held.
  */
 void export_flush() {
     LOGGER_trace("ipfix flush export");
-	if (ipfix_export_flush(ipfix()) < 0) {
-		LOGGER_error("could not export ipfix-cache");
-		//         ipfix_reconnect();
-	}
+	// messages which cannot be sent are spooled by the exporter
+	ipfix_encoder_flush();
 	return;
 }
 
@@ -65,11 +65,18 @@
 #include "ev_handler.h" // -> #include <ev.h>
 
 #include "ipfix_handler.h"
-//#include "packet_handler.h"
+#include "packet_handler.h"
 #include "export_handler.h"
+#include "adaptive_sampling.h"
+#include "selection.h"
 #include "config_handler.h"
 #include "pcap_handler.h"
 #include "socket_handler.h"
+#include "tpacket_handler.h"
+#include "worker_handler.h"
+#include "exporter.h"
+#include "spool.h"
+#include "flow_cache.h"
 #include "netcon.h"
 
 #include "helper.h"
@@ -110,7 +117,15 @@ char* hashfunctionname[] = {
  */
 void impd4e_shutdown() {
    LOGGER_info("Shutting down..");
-   ipfix_export_flush( ipfix() );
+   #ifndef PFRING
+   pcap_replay_report();
+   #endif
+   #ifdef HAVE_PACKET_FANOUT
+   workers_stop();
+   #endif
+   // sends the buffered messages, spools the rest
+   exporter_stop();
+   spool_close();
    ipfix_close( ipfix() );
    ipfix_cleanup();
 }
@@ -151,6 +166,15 @@ void open_device(device_dev_t* if_device, options_t *options) {
       return;
    }
 
+   #ifdef HAVE_PACKET_FANOUT
+   if (1 < options->workers && (TYPE_PCAP == if_device->device_type
+         || TYPE_TPACKET == if_device->device_type)) {
+      open_workers(if_device, options);
+      gettimeofday(&(if_device->last_export_time), NULL);
+      return;
+   }
+   #endif
+
    switch (if_device->device_type) {
     #ifndef PFRING
    // file as interface to listen
@@ -174,6 +198,11 @@ void open_device(device_dev_t* if_device, options_t *options) {
       open_socket_unix(if_device, options);
       break;
     #endif
+   #ifdef HAVE_TPACKET3
+   case TYPE_TPACKET:
+      open_tpacket(if_device, options);
+      break;
+   #endif
    #ifdef PFRING
    case TYPE_PFRING:
       open_pfring(if_device, options);
@@ -259,11 +288,44 @@ int main(int argc, char *argv[]) {
    libipfix_register_templates();
    libipfix_connect( &g_options );
 
+   // keep the messages during collector outages
+   if( NULL != g_options.spool_file ) {
+      if( 0 > spool_open( g_options.spool_file, g_options.spool_size ) ) {
+         LOGGER_fatal( "cannot open spool: %s", g_options.spool_file );
+         exit(1);
+      }
+   }
+
+   // the flow cache is allocated if any device uses the flow template
+   {
+      int i, flows = (FLOW_ID == g_options.templateID);
+      for( i = 0; i < g_options.number_interfaces; ++i ) {
+         flows |= (FLOW_ID == if_devices[i].template_id);
+      }
+      if( flows && 0 > flow_cache_init( g_options.flow_cache_size
+            , g_options.flow_active_timeout, g_options.flow_idle_timeout ) ) {
+         exit(1);
+      }
+   }
+
+   // selection ranges of the devices without an own one
+   selection_publish_global();
+
+   // specialise the packet processing for the configuration
+   packet_path_configure();
+
+   // encode and send the packet id records in their own thread
+   exporter_start();
+
    /* ---- main event loop  ---- */
    event_loop_init( EV_DEFAULT ); // TODO: refactoring?
    config_handler_init( EV_DEFAULT );
    netcon_init( EV_DEFAULT_ "localhost", 5000 ); // TODO: ???
    export_handler_init( EV_DEFAULT );
+   adaptive_sampling_init( EV_DEFAULT );
+   #ifdef HAVE_PACKET_FANOUT
+   workers_start( EV_DEFAULT );
+   #endif
    event_loop_start( EV_DEFAULT ); // TODO: refactoring?
 
    // init event-loop
@@ -60,6 +60,7 @@
 
 #include "ev_handler.h"
 #include "ipfix_handler.h"
+#include "ipfix_encoder.h"
 
 #include "logger.h"
 
@@ -388,11 +389,10 @@ void netcon_sync_cleanup(){
  * Periodically checks ipfix export fd and reconnects it to netcon
  */
 void resync_timer_cb(EV_P_ ev_watcher *w, int revents) {
-   ipfix_collector_t *col;
+   int fd = ipfix_encoder_collector_fd(0);
 
-   col = ipfix()->collectors;
-   LOGGER_debug("collector_fd: %d", col->fd);
-   netcon_resync(EV_A_ col->fd);
+   LOGGER_debug("collector_fd: %d", fd);
+   netcon_resync(EV_A_ fd);
 }
 
 int netcon_resync( EV_P_ int fd ){
@@ -407,8 +407,9 @@ int netcon_resync( EV_P_ int fd ){
    if( fd< 0 ){
       for(ptr=&netcon.conn;*ptr!=NULL;ptr=&(*ptr)->next ){
          if((*ptr)->fd >0 ){
+            // the socket is closed by the encoder
             LOGGER_debug("cleaning: %d",(*ptr)->fd);
-            close((*ptr)->fd);
+            ev_io_stop(EV_A_ &(*ptr)->ev_read );
             (*ptr)->fd = -1;
          }
       }
@@ -34,9 +34,14 @@
 
 // system header files
 #include <errno.h>     // errno
+#include <stdlib.h>    // calloc
 #include <string.h>    // strerror
 #include <arpa/inet.h> // ntohs
+#include <time.h>      // clock_gettime
 #include <pcap.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h> // __rdtsc
+#endif
 //#include <ipfix.h>
 
 #ifdef PFRING
@@ -49,8 +54,16 @@
 
 #include "ev_handler.h"
 #include "ipfix_handler.h"
+#include "ipfix_encoder.h"
+#include "exporter.h"
+#include "worker_handler.h"
+#include "tunnel.h"
+#include "fragment_table.h"
+#include "selection.h"
+#include "selector.h"
 
 #include "hash.h"
+#include "hash_batch.h"
 
 //#include "helper.h"
 #include "settings.h" // g_options
@@ -82,6 +95,9 @@ void packet_watcher_cb(EV_P_ ev_watcher *w, int revents) {
         case TYPE_PCAP:
         case TYPE_SOCKET_INET:
         case TYPE_SOCKET_UNIX:
+#ifdef HAVE_TPACKET3
+        case TYPE_TPACKET:
+#endif
         {
             error_number = pcap_dev_ptr->dispatch(pcap_dev_ptr->dh
                     , PCAP_DISPATCH_PACKET_COUNT
@@ -133,7 +149,7 @@ void packet_watcher_cb(EV_P_ ev_watcher *w, int revents) {
 void packet_pfring_cb(u_char *user_args, const struct pfring_pkthdr *header,
         const u_char *packet) {
     device_dev_t* if_device = (device_dev_t*) user_args;
-    uint8_t layers[4] = {0};
+    uint8_t layers[LAYER_COUNT] = {0};
     uint32_t hash_result = 0;
     uint32_t copiedbytes = 0;
     uint8_t ttl = 0;
@@ -167,6 +183,7 @@ void packet_pfring_cb(u_char *user_args, const struct pfring_pkthdr *header,
 
     if_device->export_packet_count++;
     if_device->sampling_size++;
+    if_device->selected_total++;
 
     // bypassing export if disabled by cmd line
     if (g_options.export_pktid_interval <= 0) {
@@ -202,8 +219,7 @@ void packet_pfring_cb(u_char *user_args, const struct pfring_pkthdr *header,
             void* fields[] = {&timestamp, &hash_result, &ttl};
             uint16_t lengths[] = {8, 4, 1};
 
-            if (0 > ipfix_export_array(ipfix(),
-                    if_device->ipfixtmpl_min, 3, fields, lengths)) {
+            if (0 > ipfix_encode_array(if_device->ipfixtmpl_min, 3, fields, lengths)) {
                 LOGGER_fatal("ipfix_export() failed: %s", strerror(errno));
                 exit(1);
             }
@@ -215,8 +231,7 @@ void packet_pfring_cb(u_char *user_args, const struct pfring_pkthdr *header,
             void* fields[] = {&timestamp, &hash_result};
             uint16_t lengths[] = {8, 4};
 
-            if (0 > ipfix_export_array(ipfix(),
-                    if_device->ipfixtmpl_ts, 2, fields, lengths)) {
+            if (0 > ipfix_encode_array(if_device->ipfixtmpl_ts, 2, fields, lengths)) {
                 LOGGER_fatal("ipfix_export() failed: %s", strerror(errno));
                 exit(1);
             }
@@ -246,8 +261,7 @@ void packet_pfring_cb(u_char *user_args, const struct pfring_pkthdr *header,
                 &layers[L_NET]};
             uint16_t lengths[6] = {8, 4, 1, 2, 1, 1};
 
-            if (0 > ipfix_export_array(ipfix(),
-                    if_device->ipfixtmpl_ts_ttl, 6, fields, lengths)) {
+            if (0 > ipfix_encode_array(if_device->ipfixtmpl_ts_ttl, 6, fields, lengths)) {
                 LOGGER_fatal("ipfix_export() failed: %s", strerror(errno));
                 exit(1);
             }
@@ -346,21 +360,29 @@ inline uint16_t get_ip_length(packet_t *p, uint32_t offset, netProt_t nettype) {
     }
 }
 
+// source address; the destination address follows it (get_ipa_length())
 inline uint8_t* get_ipa(packet_t *p, uint32_t offset, netProt_t nettype) {
-    static uint32_t unknown_ipa = 0;
+    static uint8_t unknown_ipa[32] = {0};
     switch (nettype) {
         case N_IP:
         {
             return p->ptr + offset + 12;
         }
         case N_IP6:
+        {
+            return p->ptr + offset + 8;
+        }
         default:
         {
-            return (uint8_t*) &unknown_ipa;
+            return unknown_ipa;
         }
     }
 }
 
+inline uint8_t get_ipa_length(netProt_t nettype) {
+    return (N_IP6 == nettype) ? 16 : 4;
+}
+
 inline uint16_t get_port(packet_t *p, uint32_t offset, transProt_t transtype) {
     switch (transtype) {
         case T_UDP:
@@ -376,22 +398,92 @@ inline uint16_t get_port(packet_t *p, uint32_t offset, transProt_t transtype) {
     }
 }
 
+#define ETHERTYPE_VLAN    0x8100
+#define ETHERTYPE_QINQ    0x88A8
+#define ETHERTYPE_QINQ_9100 0x9100
+#define ETHERTYPE_MPLS    0x8847
+#define ETHERTYPE_MPLS_MC 0x8848
+
+// network layer behind the bottom MPLS label; there is no type field
+static inline uint16_t get_mpls_payload_type(packet_t *packet, uint32_t offset) {
+    if (offset >= packet->len) {
+        return 0;
+    }
+    switch (packet->ptr[offset] & 0xf0) {
+        case 0x40: return 0x0800;
+        case 0x60: return 0x86DD;
+    }
+    return 0;
+}
+
+/**
+ * Peel off the VLAN tags (802.1Q, 802.1ad) and MPLS labels behind the
+ * type field at 'offset'; at most LINK_MAX_TAGS. Sets the network header
+ * offset, the outer VLAN id and the top MPLS label of the packet info; a
+ * tag the NIC stripped (rx_vlan_id) is the outer one and stays.
+ * returns the type of the network layer; 0 if truncated
+ */
+static inline uint16_t get_tagged_nettype(packet_t *packet, packet_info_t *info,
+        uint32_t offset) {
+    uint16_t type;
+    int n, vlans = 0, labels = 0;
+
+    if (offset + 2 > packet->len) {
+        return 0;
+    }
+    type = ntohs(*((uint16_t*) (&packet->ptr[offset])));
+    offset += 2;
+
+    for (n = 0; n < LINK_MAX_TAGS; ++n) {
+        if (ETHERTYPE_VLAN == type || ETHERTYPE_QINQ == type || ETHERTYPE_QINQ_9100 == type) {
+            if (offset + 4 > packet->len) {
+                return 0;
+            }
+            if (0 == vlans++ && 0 == info->vlan_id) {
+                info->vlan_id = ntohs(*((uint16_t*) (&packet->ptr[offset]))) & 0x0fff;
+            }
+            type = ntohs(*((uint16_t*) (&packet->ptr[offset + 2])));
+            offset += 4;
+        } else if (ETHERTYPE_MPLS == type || ETHERTYPE_MPLS_MC == type) {
+            uint32_t entry;
+            if (offset + 4 > packet->len) {
+                return 0;
+            }
+            entry = ntohl(*((uint32_t*) (&packet->ptr[offset])));
+            if (0 == labels++) {
+                info->mpls_label = entry >> 8;
+            }
+            offset += 4;
+            // bottom of stack
+            if (entry & 0x100) {
+                type = get_mpls_payload_type(packet, offset);
+                break;
+            }
+        } else {
+            break;
+        }
+    }
+    info->link_offset = offset;
+    return type;
+}
+
 // return the packet protocol beyond the link layer (defined by rfc )
 // !! the raw packet is expected (include link layer)
+// the network header offset is set in the packet info
 // return 0 if unknown
 
-inline uint16_t get_nettype(packet_t *packet, int linktype) {
+static inline uint16_t get_nettype(packet_t *packet, packet_info_t *info, int linktype) {
     switch (linktype) {
         case DLT_EN10MB: // 14 octets
             // Ethernet
-            return ntohs(*((uint16_t*) (&packet->ptr[12])));
+            return get_tagged_nettype(packet, info, 12);
             break;
         case DLT_ATM_RFC1483: // 8 octets
-            return ntohs(*((uint16_t*) (&packet->ptr[6])));
+            return get_tagged_nettype(packet, info, 6);
             break;
         case DLT_LINUX_SLL: // 16 octets
             // TODO: either the first 2 octets or the last 2 octets
-            return ntohs(*((uint16_t*) (&packet->ptr[14])));
+            return get_tagged_nettype(packet, info, 14);
             break;
         case DLT_RAW:
             break;
@@ -480,39 +572,209 @@ void handle_default_packet(packet_t *packet, packet_info_t *packet_info) {
     LOGGER_info("packet type: 0x%04X (not supported)", packet_info->nettype);
 }
 
-void handle_ip_packet(packet_t *packet, packet_info_t *packet_info) {
+// cost of every 2^n-th packet is measured
+#define PATH_COST_SAMPLE_MASK 0x3F
+
+// headers a selection function uses (see selection_headers())
+#define HEADERS_NONE 0
+#define HEADERS_NET  1 // network layer only
+#define HEADERS_ALL  2
+
+#if defined(__x86_64__) || defined(__i386__)
+#define path_clock() __rdtsc()
+#else
+static inline uint64_t path_clock() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#endif
+
+/**
+ * Hash id of a fragment (-g); the hash input holds the invariant fields
+ * afterwards, so the packet id is the same for all fragments of a datagram.
+ *  - invariant: hash addresses, protocol and fragment id
+ *  - table: the first fragment is selected as usual and keeps its hash id
+ *    in the fragment table of the device; later fragments look it up and
+ *    fall back to the invariant hash if the first one was not seen
+ */
+static inline uint32_t fragment_hash(packet_t *packet, packet_info_t *packet_info,
+        buffer_t *buffer, selectionFunction select, hashFunction hash,
+        uint32_t offsets[], uint8_t layers[]) {
+    device_dev_t *device = packet_info->device;
+    uint32_t now = packet_info->ts.tv_sec;
     uint32_t hash_id = 0;
-    uint32_t pkt_id = 0;
+    uint32_t key = 0;
+
+    // the payload of a later fragment is no transport header; no ports
+    if (F_NEXT == layers[L_FRAG]) {
+        offsets[L_TRANS]   = -1;
+        offsets[L_PAYLOAD] = -1;
+    }
+
+    copyFields_Fragment(packet, buffer, offsets, layers);
+    key = hash(&g_options.hash_function, buffer);
+
+    if (FRAGMENTS_TABLE != g_options.fragment_policy || device->fragments_failed) {
+        return key;
+    }
+
+    if (NULL == device->fragments) {
+        device->fragments = fragment_table_new(g_options.fragment_table_size);
+        if (NULL == device->fragments) {
+            // this capture thread only; the options are not ours to change
+            LOGGER_error("fragment table: out of memory; using invariant hash");
+            device->fragments_failed = 1;
+            return key;
+        }
+    }
+
+    if (F_FIRST == layers[L_FRAG]) {
+        buffer_t invariant = *buffer;
+
+        buffer->len = 0;
+        buffer->count = 0;
+        select(packet, buffer, offsets, layers);
+        hash_id = key;
+        if (0 != buffer->len) {
+            hash_id = hash(&g_options.hash_function, buffer);
+            fragment_table_put(device->fragments, key, hash_id, now);
+        }
+        *buffer = invariant;
+        return hash_id;
+    }
+
+    if (fragment_table_get(device->fragments, key, now, &hash_id)) {
+        return hash_id;
+    }
+    return key;
+}
 
-    uint32_t offsets[4] = {0}; // layer offsets for: link, net, transport, payload
-    uint8_t layers[4] = {0}; // layer protocol types for: link, net, transport, payload
+/**
+ * state of a packet in the ip packet path between the selection of the
+ * hash input and the selection decision; the hash is computed in between,
+ * for a burst by hash_batch() (see handle_ip_burst())
+ */
+typedef struct ip_path_state {
+    uint32_t  offsets[LAYER_COUNT]; // layer offsets for: link, net, transport, payload, fragment id
+    uint8_t   layers[LAYER_COUNT];  // layer protocol types for: link, net, transport, payload, fragment
+    int       parsed;               // all headers located
+    buffer_t *buffer;               // hash input
+    uint32_t  hash_id;
+    int       sample;               // cost is measured
+    uint64_t  start;
+} ip_path_state_t;
+
+// result of ip_packet_select()
+enum {
+    IP_PATH_DONE = 0, // not selected or no hash input
+    IP_PATH_HASH,     // hash input in state->buffer
+    IP_PATH_HASHED    // hash id in state->hash_id (fragments)
+};
 
-    LOGGER_trace(" ");
+/**
+ * The ip packet path of all ip packet handlers. The selection function,
+ * the hash function and the template are parameters; the specialised
+ * handlers below pass constants, so the calls are direct and the template
+ * switch folds away. t_id -1 means the export of packet ids is disabled.
+ *
+ * The path has two tiers:
+ *  1. every packet: a count-, time-based or random selector (-U) decides
+ *     first; otherwise locate the headers the selection function needs
+ *     (headers, see selection_headers()), select the fields, hash, compare
+ *     with the range
+ *  2. selected packets: locate all headers if not done yet and the template
+ *     needs them, write the record to the export ring
+ * The cost of both is sampled into device->path.
+ *
+ * Tier 1 is split at the hash: ip_packet_select() selects the hash input,
+ * ip_packet_finish() takes the decision and runs tier 2.
+ *
+ * The debug output is only compiled into the generic handler (trace != 0).
+ */
+static inline __attribute__((always_inline))
+int ip_packet_select(packet_t *packet, packet_info_t *packet_info,
+        ip_path_state_t *state, selectionFunction select, int headers,
+        hashFunction hash, int trace) {
+    device_dev_t *device = packet_info->device;
+    int fragment = 0;
+
+    memset(state->offsets, 0, sizeof(state->offsets));
+    memset(state->layers, 0, sizeof(state->layers));
+    state->parsed = 0;
+    state->sample = (0 == (device->path.selection_packets & PATH_COST_SAMPLE_MASK));
+    state->start  = 0;
+
+    if (trace) LOGGER_trace(" ");
+
+    // --- tier 1: selection decision ---
+    if (state->sample) state->start = path_clock();
+    device->path.selection_packets++;
+
+    // the systematic and random selectors do not need the packet
+    if (SELECTOR_HASH != g_options.selector
+            && !selector_match(device, packet_info)) {
+        device->packets_dropped++;
+        if (state->sample) device->path.selection_cycles += path_clock() - state->start;
+        if (state->sample) device->path.selection_samples++;
+        return IP_PATH_DONE;
+    }
 
     // reset hash buffer
-    packet_info->device->hash_buffer.len = 0;
+    state->buffer->len = 0;
+    state->buffer->count = 0;
+
+    // find headers of the IP STACK; the network layer only, if that is
+    // all the selection function uses
+    if (HEADERS_ALL == headers) {
+        findHeaders(packet->ptr, packet->len, state->offsets, state->layers);
+        state->parsed = 1;
+    } else if (HEADERS_NET == headers) {
+        state->parsed = findNetHeader(packet->ptr, packet->len,
+                state->offsets, state->layers);
+    }
 
-    // find headers of the IP STACK
-    findHeaders(packet->ptr, packet->len, offsets, layers);
+    // fragments are selected by fragment_hash()
+    fragment = headers && F_NONE != state->layers[L_FRAG] &&
+            FRAGMENTS_NONE != g_options.fragment_policy;
 
     // selection of viable fields of the packet - depend on the selection function choosen
     // locate protocolsections of ip-stack --> findHeaders() in hash.c
-    g_options.selection_function(packet,
-            &packet_info->device->hash_buffer,
-            offsets, layers);
+    if (fragment) {
+        state->hash_id = fragment_hash(packet, packet_info, state->buffer,
+                select, hash, state->offsets, state->layers);
+    } else {
+        select(packet, state->buffer, state->offsets, state->layers);
+    }
 
-    if (0) print_array(packet_info->device->hash_buffer.ptr, packet_info->device->hash_buffer.len);
+    if (0) {
+        buffer_flatten(state->buffer);
+        print_array(state->buffer->ptr, state->buffer->len);
+    }
 
-    if (0 == packet_info->device->hash_buffer.len) {
-        LOGGER_trace("Warning: packet does not contain Selection");
-        return;
+    if (0 == state->buffer->len) {
+        if (trace) LOGGER_trace("Warning: packet does not contain Selection");
+        if (state->sample) device->path.selection_cycles += path_clock() - state->start;
+        if (state->sample) device->path.selection_samples++;
+        return IP_PATH_DONE;
     }
 
-    // hash the chosen packet data
-    hash_id = g_options.hash_function(&packet_info->device->hash_buffer);
-    if( LOGGER_LEVEL_DEBUG == logger_get_level() ) {
-        uint8_t*  b = packet_info->device->hash_buffer.ptr;
-        uint32_t bl = packet_info->device->hash_buffer.len;
+    return fragment ? IP_PATH_HASHED : IP_PATH_HASH;
+}
+
+static inline __attribute__((always_inline))
+void ip_packet_finish(packet_t *packet, packet_info_t *packet_info,
+        ip_path_state_t *state, uint32_t t_id, int trace) {
+    device_dev_t *device = packet_info->device;
+    uint32_t hash_id = state->hash_id;
+    uint32_t *offsets = state->offsets;
+    uint8_t *layers = state->layers;
+    uint64_t start = state->start;
+
+    if (trace && LOGGER_LEVEL_DEBUG == logger_get_level()) {
+        buffer_flatten(state->buffer);
+        uint8_t*  b = state->buffer->ptr;
+        uint32_t bl = state->buffer->len;
         // create null terminated string
         char str_buffer[3*bl];
         char* p = str_buffer;
@@ -524,141 +786,437 @@ void handle_ip_packet(packet_t *packet, packet_info_t *packet_info) {
         LOGGER_debug("hash id: 0x%08X (%u) (%s)", hash_id, hash_id, str_buffer);
     }
 
-    // hash id must be in the chosen selection range to count
-    if ((g_options.sel_range_min <= hash_id) &&
-            (g_options.sel_range_max >= hash_id)) {
-        packet_info->device->export_packet_count++;
-        packet_info->device->sampling_size++;
+    if (state->sample) {
+        uint64_t now = path_clock();
+        device->path.selection_cycles += now - start;
+        device->path.selection_samples++;
+        start = now;
+    }
+
+    // hash id must be in the selection ranges of the device to count
+    if (SELECTOR_HASH == g_options.selector
+            && !selection_match(__atomic_load_n(&device->selection, __ATOMIC_ACQUIRE),
+            hash_id)) {
+        // count dropped packets
+        device->packets_dropped++;
+        if (trace) LOGGER_debug("packets dropped: %u\n", device->packets_dropped);
+        return;
+    }
+
+    device->sampling_size++;
+    device->selected_total++;
+
+    // bypassing export if disabled by cmd line
+    if (-1 == t_id) {
+        return;
+    }
+
+    // --- tier 2: export of the selected packet ---
+    device->path.export_packets++;
+
+    // the record is written straight into the ring of the exporter;
+    // dropped if the exporter does not keep up
+    pktid_record_t *record = export_ring_slot(device->ring);
+    if (NULL == record) {
+        return;
+    }
+
+    // the timestamp template needs no header fields
+    if (!state->parsed && TS_ID != t_id) {
+        findHeaders(packet->ptr, packet->len, offsets, layers);
+    }
+
+    uint32_t record_id = t_id;
+    switch (t_id) {
+        case TS_TTL_PROTO_IP_LINK_ID:
+        {
+            record->vlan_id     = packet_info->vlan_id;
+            record->mpls_label  = packet_info->mpls_label;
+            record->tunnel_type = packet_info->tunnel_type;
+            record->tunnel_id   = packet_info->tunnel_id;
+        }
+        // no break; common fields
+        case FLOW_ID:
+        case TS_TTL_PROTO_IP_ID:
+        {
+            // the addresses are copied straight from the packet into the ring
+            uint8_t *ipa = get_ipa(packet, offsets[L_NET], layers[L_NET]);
+            uint8_t ipa_len = get_ipa_length(layers[L_NET]);
+
+            // later fragments have no transport header
+            if (-1 != offsets[L_TRANS]) {
+                record->src_port = get_port(packet, offsets[L_TRANS], layers[L_TRANS]);
+                record->dst_port = get_port(packet, offsets[L_TRANS] + 2, layers[L_TRANS]);
+            } else {
+                record->src_port = 0;
+                record->dst_port = 0;
+            }
+            memcpy(record->src_ipa, ipa, ipa_len);
+            memcpy(record->dst_ipa, ipa + ipa_len, ipa_len);
 
-        // bypassing export if disabled by cmd line
-        if (g_options.export_pktid_interval <= 0) {
+            // IPv6 variant of the template; the flow cache decides per flow
+            if (N_IP6 == layers[L_NET] && TS_TTL_PROTO_IP_ID == t_id) {
+                record_id = TS_TTL_PROTO_IP6_ID;
+            }
+            if (N_IP6 == layers[L_NET] && TS_TTL_PROTO_IP_LINK_ID == t_id) {
+                record_id = TS_TTL_PROTO_IP6_LINK_ID;
+            }
+        }
+        // no break; common fields
+        case TS_TTL_PROTO_ID:
+        {
+            record->length     = get_ip_length(packet, offsets[L_NET], layers[L_NET]);
+            record->protocol   = layers[L_TRANS];
+            record->ip_version = layers[L_NET];
+        }
+        // no break; common fields
+        case MINT_ID:
+        {
+            record->ttl = get_ttl(packet, offsets[L_NET], layers[L_NET]);
+        }
+        // no break; common fields
+        case TS_ID:
+        {
+            record->timestamp = get_timestamp(packet_info->ts);
+            record->hash_id   = hash_id;
+            break;
+        }
+
+        default:
+            LOGGER_info("!!!no template specified!!!");
+            return;
+    } // switch (options.templateID)
+
+    // pass the record to the exporter thread
+    record->template_id = record_id;
+    export_ring_commit(device->ring);
+
+    // reset dropped packet, if a packet was processed
+    device->packets_dropped = 0;
+
+    if (state->sample) {
+        device->path.export_cycles += path_clock() - start;
+        device->path.export_samples++;
+    }
+}
+
+static inline __attribute__((always_inline))
+void ip_packet_path(packet_t *packet, packet_info_t *packet_info,
+        selectionFunction select, int headers, hashFunction hash,
+        uint32_t t_id, int trace) {
+    ip_path_state_t state;
+
+    state.buffer = &packet_info->device->hash_buffer;
+    switch (ip_packet_select(packet, packet_info, &state, select, headers,
+            hash, trace)) {
+        case IP_PATH_DONE:
             return;
+        case IP_PATH_HASH:
+            // hash the chosen packet data
+            state.hash_id = hash(&g_options.hash_function, state.buffer);
+            break;
+    }
+    ip_packet_finish(packet, packet_info, &state, t_id, trace);
+}
+
+/**
+ * headers the selection function uses; the others are located in the
+ * second tier only, if the template needs them
+ */
+static int selection_headers(selectionFunction select) {
+    if (copyFields_Raw == select || copyFields_Last == select ||
+            copyFields_Link == select || copyFields_Net == select) {
+        return HEADERS_NONE;
+    }
+    if (copyFields_Only_Net == select || copyFields_Packet == select) {
+        return HEADERS_NET;
+    }
+    return HEADERS_ALL;
+}
+
+/**
+ * selection functions with a fixed length hash input per ip version, so
+ * the inputs of a burst group by length; the other inputs vary with the
+ * packet and the burst stage costs more than the lanes save
+ */
+static int selection_batched(selectionFunction select) {
+    return copyFields_Only_Net == select || copyFields_U_TCP_and_Net == select;
+}
+
+// template of the device; -1 if the export of packet ids is disabled
+static uint32_t ip_packet_template(device_dev_t *device) {
+    uint32_t t_id = __atomic_load_n(&device->template_id, __ATOMIC_ACQUIRE);
+
+    if (g_options.export_pktid_interval <= 0) {
+        return -1;
+    }
+    return (-1 == t_id) ? g_options.templateID : t_id;
+}
+
+/**
+ * Generic handler; resolves the configuration for every packet and
+ * produces the debug output. Used for combinations without a specialised
+ * handler and if the log level is debug or above.
+ */
+void handle_ip_packet(packet_t *packet, packet_info_t *packet_info) {
+    ip_packet_path(packet, packet_info,
+            g_options.selection_function,
+            selection_headers(g_options.selection_function),
+            g_options.hash_function.function,
+            ip_packet_template(packet_info->device), 1);
+}
+
+// -----------------------------------------------------------------------------
+// specialised ip packet handlers
+// -----------------------------------------------------------------------------
+
+// X(name, selection function, headers; see selection_headers())
+#define IP_PATH_SELECTIONS(X, ...) \
+    X(rec,     copyFields_Rec,           HEADERS_ALL,  __VA_ARGS__) \
+    X(ip,      copyFields_Only_Net,      HEADERS_NET,  __VA_ARGS__) \
+    X(iptp,    copyFields_U_TCP_and_Net, HEADERS_ALL,  __VA_ARGS__) \
+    X(packet,  copyFields_Packet,        HEADERS_NET,  __VA_ARGS__) \
+    X(raw,     copyFields_Raw,           HEADERS_NONE, __VA_ARGS__) \
+    X(last,    copyFields_Last,          HEADERS_NONE, __VA_ARGS__) \
+    X(link,    copyFields_Link,          HEADERS_NONE, __VA_ARGS__) \
+    X(net,     copyFields_Net,           HEADERS_NONE, __VA_ARGS__) \
+    X(trans,   copyFields_Trans,         HEADERS_ALL,  __VA_ARGS__) \
+    X(payload, copyFields_Payload,       HEADERS_ALL,  __VA_ARGS__)
+
+// X(name, hash function)
+#define IP_PATH_HASHES(X, ...) \
+    X(bob,    calcHashValue_BOB,        __VA_ARGS__) \
+    X(twmx,   calcHashValue_TWMXRSHash, __VA_ARGS__) \
+    X(hsieh,  calcHashValue_Hsieh,      __VA_ARGS__) \
+    X(oaat,   calcHashValue_OAAT,       __VA_ARGS__) \
+    X(sbox,   calcHashValue_SBOX,       __VA_ARGS__) \
+    X(sbox64, calcHashValue_SBOX64,     __VA_ARGS__)
+
+// X(name, template id)
+#define IP_PATH_TEMPLATES(X, ...) \
+    X(none, -1,                 __VA_ARGS__) \
+    X(mint, MINT_ID,            __VA_ARGS__) \
+    X(ts,   TS_ID,              __VA_ARGS__) \
+    X(lp,   TS_TTL_PROTO_ID,    __VA_ARGS__) \
+    X(ls,   TS_TTL_PROTO_IP_ID, __VA_ARGS__) \
+    X(flow, FLOW_ID,            __VA_ARGS__) \
+    X(lsl,  TS_TTL_PROTO_IP_LINK_ID, __VA_ARGS__)
+
+// the lists are expanded inside out: template, hash, selection
+#define IP_PATH_DEFINE(t, tid, h, hf, s, sf, sh) \
+    static void handle_ip_##s##_##h##_##t(packet_t *packet, packet_info_t *packet_info) { \
+        ip_packet_path(packet, packet_info, sf, sh, hf, tid, 0); \
+    }
+#define IP_PATH_ENTRY(t, tid, h, hf, s, sf, sh) \
+    { sf, hf, tid, handle_ip_##s##_##h##_##t },
+
+#define IP_PATH_HASH(h, hf, X, s, sf, sh)  IP_PATH_TEMPLATES(X, h, hf, s, sf, sh)
+#define IP_PATH_SELECTION(s, sf, sh, X)    IP_PATH_HASHES(IP_PATH_HASH, X, s, sf, sh)
+
+IP_PATH_SELECTIONS(IP_PATH_SELECTION, IP_PATH_DEFINE)
+
+static const struct {
+    selectionFunction select;
+    hashFunction      hash;
+    uint32_t          t_id;
+    ip_handler_t      handler;
+} ip_handlers[] = {
+    IP_PATH_SELECTIONS(IP_PATH_SELECTION, IP_PATH_ENTRY)
+};
+
+// -----------------------------------------------------------------------------
+// burst stage (-F <function>:batch)
+// -----------------------------------------------------------------------------
+
+/**
+ * ip packets of a tpacket block or a socket batch; the hash inputs point
+ * into the capture buffer, which is kept until packet_burst_end()
+ */
+typedef struct packet_burst_s {
+    int             active;  // between packet_burst_begin() and _end()
+    int             headers; // see selection_headers()
+    uint32_t        count;
+    packet_t        packet[HASH_BATCH_BURST];
+    packet_info_t   info[HASH_BATCH_BURST];
+    ip_path_state_t state[HASH_BATCH_BURST];
+    int             status[HASH_BATCH_BURST]; // result of ip_packet_select()
+    buffer_t        buffer[HASH_BATCH_BURST];
+} packet_burst_t;
+
+// hash the queued packets together, then decide and export in order
+static void packet_burst_flush(device_dev_t *device) {
+    packet_burst_t *burst = device->burst;
+    uint32_t t_id = ip_packet_template(device);
+    buffer_t *input[HASH_BATCH_BURST];
+    uint32_t hash_id[HASH_BATCH_BURST];
+    uint32_t i, n = 0;
+
+    for (i = 0; i < burst->count; ++i) {
+        if (IP_PATH_HASH == burst->status[i]) {
+            input[n++] = burst->state[i].buffer;
         }
+    }
+    hash_batch(&g_options.hash_function, input, n, hash_id);
 
-        // in case we want to use the hashID as packet ID
-        if (g_options.hashAsPacketID) {
-            pkt_id = hash_id;
-        } else {
-            pkt_id = g_options.pktid_function(&packet_info->device->hash_buffer);
+    for (i = 0, n = 0; i < burst->count; ++i) {
+        ip_path_state_t *state = &burst->state[i];
+
+        if (IP_PATH_HASH == burst->status[i]) {
+            state->hash_id = hash_id[n++];
         }
+        // the sampled cost is that of the packet, not of the wait
+        if (state->sample) state->start = path_clock() - state->start;
+        ip_packet_finish(&burst->packet[i], &burst->info[i], state, t_id, 0);
+    }
+    burst->count = 0;
+}
 
-        uint32_t          t_id = packet_info->device->template_id;
+/**
+ * Burst stage; installed in front of the specialised handler if batch
+ * hashing is on, the hash function has lane kernels and the selection
+ * function a fixed length input (see selection_batched()). Between
+ * packet_burst_begin() and packet_burst_end() the hash input of each
+ * packet is selected and queued; the packets are hashed by hash_batch()
+ * when the burst is full or ends. Otherwise the packet goes straight to
+ * the specialised handler.
+ */
+static void handle_ip_burst(packet_t *packet, packet_info_t *packet_info) {
+    device_dev_t *device = packet_info->device;
+    packet_burst_t *burst = device->burst;
+    ip_path_state_t *state;
 
-        t_id = (-1 == t_id) ? g_options.templateID : t_id;
+    if (NULL == burst || !burst->active) {
+        ip_handler_t handler = __atomic_load_n(&device->ip_single_handler,
+                __ATOMIC_ACQUIRE);
 
-        ipfix_template_t  *template = get_template( t_id );
-        int               size = template->nfields;
-        void              *fields[size];
-        uint16_t          lengths[size];
+        handler(packet, packet_info);
+        return;
+    }
 
-        uint8_t ttl = 0;
-        uint64_t timestamp = 0;
-        uint16_t length = 0; // dummy for TS_TTL_PROTO template id
-        uint16_t src_port = 0;
-        uint16_t dst_port = 0;
-        uint8_t *src_ipa = 0;
-        uint8_t *dst_ipa = 0;
+    state = &burst->state[burst->count];
+    state->buffer = &burst->buffer[burst->count];
+    burst->status[burst->count] = ip_packet_select(packet, packet_info,
+            state, g_options.selection_function, burst->headers,
+            g_options.hash_function.function, 0);
+    if (IP_PATH_DONE == burst->status[burst->count]) {
+        return;
+    }
 
-        switch (t_id) {
-            case TS_ID:
-            {
-                timestamp = get_timestamp(packet_info->ts);
+    if (state->sample) state->start = path_clock() - state->start;
+    burst->packet[burst->count] = *packet;
+    burst->info[burst->count]   = *packet_info;
+    if (HASH_BATCH_BURST == ++burst->count) {
+        packet_burst_flush(device);
+    }
+}
 
-                int index = 0;
-                index += set_value(&fields[index], &lengths[index], &timestamp, 8);
-                index += set_value(&fields[index], &lengths[index], &hash_id, 4);
-                break;
-            }
+void packet_burst_begin(device_dev_t *device) {
+    packet_burst_t *burst = device->burst;
+    uint32_t i;
 
-            case MINT_ID:
-            {
-                timestamp = get_timestamp(packet_info->ts);
-                ttl = get_ttl(packet, offsets[L_NET], layers[L_NET]);
+    // nothing to do unless the burst stage is installed
+    if (handle_ip_burst != __atomic_load_n(&device->ip_handler, __ATOMIC_ACQUIRE) &&
+            handle_ip_burst != __atomic_load_n(&device->ip_inner_handler, __ATOMIC_ACQUIRE)) {
+        return;
+    }
 
-                int index = 0;
-                index += set_value(&fields[index], &lengths[index], &timestamp, 8);
-                index += set_value(&fields[index], &lengths[index], &hash_id, 4);
-                index += set_value(&fields[index], &lengths[index], &ttl, 1);
-                break;
+    // one burst per capture thread; the workers have their own device
+    if (NULL == burst) {
+        burst = (packet_burst_t*) calloc(1, sizeof(packet_burst_t));
+        if (NULL == burst) {
+            LOGGER_error("burst: out of memory; hashing per packet");
+            return;
+        }
+        for (i = 0; i < HASH_BATCH_BURST; ++i) {
+            burst->buffer[i].size = g_options.snapLength;
+            burst->buffer[i].ptr  = calloc(g_options.snapLength, sizeof(uint8_t));
+            if (NULL == burst->buffer[i].ptr) {
+                LOGGER_error("burst: out of memory; hashing per packet");
+                while (i--) free(burst->buffer[i].ptr);
+                free(burst);
+                return;
             }
+        }
+        device->burst = burst;
+    }
+    burst->headers = selection_headers(g_options.selection_function);
+    burst->active  = 1;
+}
 
-            case TS_TTL_PROTO_ID:
-            {
-                timestamp = get_timestamp(packet_info->ts);
-                ttl = get_ttl(packet, offsets[L_NET], layers[L_NET]);
-                length = get_ip_length(packet, offsets[L_NET], layers[L_NET]);
-
-                int index = 0;
-                index += set_value(&fields[index], &lengths[index], &timestamp, 8);
-                index += set_value(&fields[index], &lengths[index], &hash_id, 4);
-                index += set_value(&fields[index], &lengths[index], &ttl, 1);
-                index += set_value(&fields[index], &lengths[index], &length, 2);
-                index += set_value(&fields[index], &lengths[index], &layers[L_TRANS], 1);
-                index += set_value(&fields[index], &lengths[index], &layers[L_NET], 1);
-                break;
-            }
+void packet_burst_end(device_dev_t *device) {
+    packet_burst_t *burst = device->burst;
 
-            case TS_TTL_PROTO_IP_ID:
-            {
-                timestamp = get_timestamp(packet_info->ts);
-                ttl = get_ttl(packet, offsets[L_NET], layers[L_NET]);
-                length = get_ip_length(packet, offsets[L_NET], layers[L_NET]);
-                src_port = get_port(packet, offsets[L_TRANS], layers[L_TRANS]);
-                dst_port = get_port(packet, offsets[L_TRANS] + 2, layers[L_TRANS]);
-                src_ipa = get_ipa(packet, offsets[L_NET], layers[L_NET]);
-                dst_ipa = get_ipa(packet, offsets[L_NET] + 4, layers[L_NET]);
-
-                int index = 0;
-                index += set_value(&fields[index], &lengths[index], &timestamp, 8);
-                index += set_value(&fields[index], &lengths[index], &hash_id, 4);
-                index += set_value(&fields[index], &lengths[index], &ttl, 1);
-                index += set_value(&fields[index], &lengths[index], &length, 2);
-                index += set_value(&fields[index], &lengths[index], &layers[L_TRANS], 1);
-                index += set_value(&fields[index], &lengths[index], &layers[L_NET], 1);
-                index += set_value(&fields[index], &lengths[index], src_ipa, 4);
-                index += set_value(&fields[index], &lengths[index], &src_port, 2);
-                index += set_value(&fields[index], &lengths[index], dst_ipa, 4);
-                index += set_value(&fields[index], &lengths[index], &dst_port, 2);
-                break;
-            }
+    if (NULL == burst || !burst->active) {
+        return;
+    }
+    if (0 < burst->count) {
+        packet_burst_flush(device);
+    }
+    burst->active = 0;
+}
 
-            default:
-                LOGGER_info("!!!no template specified!!!");
-                return;
-        } // switch (options.templateID)
+/**
+ * Decapsulation stage (-E); only installed if tunnel types are given, so
+ * it costs nothing otherwise. The inner packet (or the packet itself, if
+ * it is no tunnel) is passed to the handler of the configuration.
+ */
+static void handle_ip_tunnel(packet_t *packet, packet_info_t *packet_info) {
+    packet_t inner = *packet;
+    ip_handler_t inner_handler = __atomic_load_n(
+            &packet_info->device->ip_inner_handler, __ATOMIC_ACQUIRE);
 
-        //LOGGER_debug( "%d", size);
-        //int i = 0;
-        //for( i = 0; i < size; ++i ) {
-        //   LOGGER_debug( "%p: %d: %d", fields[i], lengths[i], *( (int*)fields[i]));
-        //}
+    tunnel_decapsulate(&inner, packet_info, g_options.decapsulation);
+    inner_handler(&inner, packet_info);
+}
 
-        // send ipfix packet
-        if (0 > ipfix_export_array(ipfix(), template, size, fields, lengths)) {
-            LOGGER_fatal("ipfix_export() failed: %s", strerror(errno));
+/**
+ * Select the ip packet handler of each device matching the current
+ * configuration; has to be called again whenever the selection function,
+ * the hash function or the template changes.
+ */
+void packet_path_configure() {
+    int i, k;
+
+    for (i = 0; i < g_options.number_interfaces; ++i) {
+        device_dev_t *device = &if_devices[i];
+        uint32_t t_id = ip_packet_template(device);
+
+        device->ip_handler = handle_ip_packet;
+        if (LOGGER_LEVEL_DEBUG > logger_get_level()) {
+            for (k = 0; k < sizeof(ip_handlers) / sizeof(ip_handlers[0]); ++k) {
+                if (ip_handlers[k].select == g_options.selection_function &&
+                        ip_handlers[k].hash == g_options.hash_function.function &&
+                        ip_handlers[k].t_id == t_id) {
+                    device->ip_handler = ip_handlers[k].handler;
+                    break;
+                }
+            }
         }
-
-        // flush ipfix storage if max packetcount is reached
-        if (packet_info->device->export_packet_count >= g_options.export_packet_count) {
-            //todo: export_flush_device( packet_info->device );
-            packet_info->device->export_packet_count = 0;
-            export_flush();
+        LOGGER_debug("%s: %s ip packet handler", device->device_name,
+                (handle_ip_packet == device->ip_handler) ? "generic" : "specialised");
+
+        // the generic handler stays per packet, it produces the debug output
+        device->ip_single_handler = device->ip_handler;
+        if (g_options.hash_batch && handle_ip_packet != device->ip_handler &&
+                hash_batch_supported(g_options.hash_function.function) &&
+                selection_batched(g_options.selection_function)) {
+            device->ip_handler = handle_ip_burst;
         }
 
-        // reset dropped packet, if a packet was processed
-        packet_info->device->packets_dropped = 0;
+        if (0 != g_options.decapsulation) {
+            device->ip_inner_handler = device->ip_handler;
+            device->ip_handler       = handle_ip_tunnel;
+        }
 
-    } // if (hash in selection range)
-    else {
-        // count dropped packets
-        packet_info->device->packets_dropped++;
-        LOGGER_debug("packets dropped: %u\n", packet_info->device->packets_dropped);
+        workers_sync(device);
     }
 }
 
 void handle_packet(u_char *user_args, const struct pcap_pkthdr *header, const u_char * packet) {
     packet_t pkt = {(uint8_t*) packet, header->caplen};
     packet_info_t info = {header->ts, header->len, (device_dev_t*) user_args};
+    info.link_offset = info.device->pkt_offset;
+    info.vlan_id     = info.device->rx_vlan_id;
 
     LOGGER_trace("Enter");
 
@@ -671,8 +1229,11 @@ void handle_packet(u_char *user_args, const struct pcap_pkthdr *header, const u_
     switch (info.device->device_type) {
         case TYPE_PCAP:
         case TYPE_PCAP_FILE:
+#ifdef HAVE_TPACKET3
+        case TYPE_TPACKET:
+#endif
             // get packet type from link layer header
-            info.nettype = get_nettype(&pkt, info.device->link_type);
+            info.nettype = get_nettype(&pkt, &info, info.device->link_type);
             break;
 
         case TYPE_SOCKET_UNIX:
@@ -687,7 +1248,7 @@ void handle_packet(u_char *user_args, const struct pcap_pkthdr *header, const u_
     LOGGER_trace("nettype: 0x%04X", info.nettype);
 
     // apply net offset - skip link layer header for further processing
-    apply_offset(&pkt, info.device->pkt_offset);
+    apply_offset(&pkt, info.link_offset);
 
     // apply user offset
     apply_offset(&pkt, g_options.offset);
@@ -698,8 +1259,11 @@ void handle_packet(u_char *user_args, const struct pcap_pkthdr *header, const u_
     if (0x0800 == info.nettype || // IPv4
         0x86DD == info.nettype) // IPv6
     {
+        ip_handler_t handler = __atomic_load_n(&info.device->ip_handler
+                , __ATOMIC_ACQUIRE);
+
         if (0) print_ip4(pkt.ptr, pkt.len);
-        handle_ip_packet(&pkt, &info);
+        handler(&pkt, &info);
         //LOGGER_trace( "drop" );
     } else {
         handle_default_packet(&pkt, &info);
@@ -35,6 +35,7 @@
 
 // system header files
 #include <stdlib.h>
+#include <stdio.h>
 
 #ifndef PFRING
 #include <pcap.h>
@@ -52,6 +53,26 @@
 #include "logger.h"
 
 
+#ifndef PFRING
+/**
+ * replay state of a pcap file
+ */
+typedef struct replay_s {
+   device_dev_t*        device;
+   ev_timer*            timer;    // paced mode only
+   struct pcap_pkthdr*  hdr;      // pending packet; paced mode only
+   const u_char*        data;
+   struct timeval       ts_first; // trace time of the first packet
+   ev_tstamp            start;    // wall clock time of the first packet
+   ev_tstamp            stop;     // wall clock time at end of file
+   uint64_t             packets;
+} replay_t;
+
+static replay_t replays[MAX_INTERFACES];
+static int      replay_count = 0;
+#endif
+
+
 #ifndef PFRING
 void determineLinkType(device_dev_t* pcap_device) {
    pcap_device->link_type = pcap_datalink(pcap_device->device_handle.pcap);
@@ -89,6 +110,112 @@ int pcap_dispatch_wrapper(dh_t dh, int cnt, pcap_handler ph, u_char* ua) {
    return 0;
 }
 
+/**
+ * end of a pcap file replay is reached; log the achieved packet rate
+ */
+static void replay_finish(replay_t* r) {
+   r->stop = ev_time();
+   LOGGER_info("replay of '%s' finished: %llu packets (%.0f pkt/s)"
+         , r->device->device_name, (unsigned long long) r->packets
+         , (r->stop > r->start) ? r->packets / (r->stop - r->start) : 0);
+}
+
+/**
+ * replay mode 'fast'; called whenever the event loop is idle and
+ * dispatches a whole batch of packets of the pcap file
+ */
+void replay_fast_cb(EV_P_ ev_watcher *w, int revents) {
+   replay_t* r = (replay_t*) w->data;
+   int n = 0;
+
+   if (0 == r->start) {
+      r->start = ev_time();
+   }
+
+   n = pcap_dispatch( r->device->dh.pcap, PCAP_REPLAY_PACKET_COUNT
+         , handle_packet, (u_char*) r->device );
+   if (0 < n) {
+      r->packets += n;
+      return;
+   }
+
+   if (0 > n) {
+      LOGGER_error("Error DeviceNo   %s: %s", r->device->device_name
+            , pcap_geterr(r->device->dh.pcap));
+   }
+   // end of file (or error) reached
+   event_deregister_idle( EV_A_ (ev_idle*) w );
+   replay_finish(r);
+}
+
+/**
+ * replay mode 'pace'; replays the packets at the trace timestamps
+ * scaled by the replay speed. The timer is re-armed for the next
+ * packet which is not yet due.
+ */
+void replay_paced_cb(EV_P_ ev_watcher *w, int revents) {
+   replay_t* r = (replay_t*) w->data;
+   int i;
+
+   for (i = 0; i < PCAP_REPLAY_PACKET_COUNT; ++i) {
+      // fetch next packet if nothing is pending
+      if (NULL == r->data) {
+         int rv = pcap_next_ex( r->device->dh.pcap, &r->hdr, &r->data );
+         if (1 != rv) {
+            if (-1 == rv) {
+               LOGGER_error("Error DeviceNo   %s: %s", r->device->device_name
+                     , pcap_geterr(r->device->dh.pcap));
+            }
+            // end of file (or error) reached; one shot timer is not restarted
+            r->data = NULL;
+            replay_finish(r);
+            return;
+         }
+         if (0 == r->packets) {
+            r->ts_first = r->hdr->ts;
+            r->start    = ev_time();
+         }
+      }
+
+      // delay until packet is due
+      double offset = (r->hdr->ts.tv_sec - r->ts_first.tv_sec)
+                    + (r->hdr->ts.tv_usec - r->ts_first.tv_usec) / 1000000.0;
+      double delay  = r->start + offset / g_options.replay_speed - ev_time();
+      if (0 < delay) {
+         ev_timer_set( r->timer, delay, 0. );
+         ev_timer_start( EV_A_ r->timer );
+         return;
+      }
+
+      handle_packet( (u_char*) r->device, r->hdr, r->data );
+      r->data = NULL;
+      ++r->packets;
+   }
+
+   // batch exhausted; continue with the next loop iteration
+   ev_timer_set( r->timer, 0., 0. );
+   ev_timer_start( EV_A_ r->timer );
+}
+
+/**
+ * print the achieved packet rate of all pcap file replays
+ */
+void pcap_replay_report() {
+   int i;
+   for (i = 0; i < replay_count; ++i) {
+      replay_t* r = &replays[i];
+      ev_tstamp stop = (0 == r->stop) ? ev_time() : r->stop;
+      double duration = (0 == r->start) ? 0 : stop - r->start;
+
+      fprintf( stderr, "replay %s: %llu packets in %.3f s (%.0f pkt/s)%s\n"
+            , r->device->device_name
+            , (unsigned long long) r->packets
+            , duration
+            , (0 < duration) ? r->packets / duration : 0
+            , (0 == r->stop) ? " (incomplete)" : "" );
+   }
+}
+
 void open_pcap_file(device_dev_t* if_dev, options_t *options) {
 
    // todo: parameter check
@@ -113,17 +240,47 @@ void open_pcap_file(device_dev_t* if_dev, options_t *options) {
    int fd = get_file_desc(if_dev);
    LOGGER_debug("File Descriptor: %d", fd);
 
+   replay_t* r = &replays[replay_count++];
+   r->device = if_dev;
+
    /* storing a reference of packet device to
     be passed via watcher on a packet event so
     we know which device to read the packet from */
-   LOGGER_info("register event timer: read pcap file (%s)", if_dev->device_name);
-   ev_watcher* watcher = event_register_timer(EV_DEFAULT_ packet_watcher_cb, 1);
-   watcher->data = (device_dev_t *) if_dev;
+   switch (options->replay_mode) {
+   case REPLAY_FAST: {
+      LOGGER_info("register event idle: replay pcap file (%s)", if_dev->device_name);
+      ev_watcher* watcher = event_register_idle(EV_DEFAULT_ replay_fast_cb);
+      watcher->data = (replay_t *) r;
+      break;
+   }
+
+   case REPLAY_PACED: {
+      LOGGER_info("register event timer: replay pcap file (%s) at speed %.2f"
+            , if_dev->device_name, options->replay_speed);
+      // one shot timer; re-armed by the callback
+      ev_watcher* watcher = event_register_timer(EV_DEFAULT_ replay_paced_cb, 0);
+      watcher->data = (replay_t *) r;
+      r->timer = (ev_timer*) watcher;
+      break;
+   }
+
+   case REPLAY_TIMER:
+   default: {
+      LOGGER_info("register event timer: read pcap file (%s)", if_dev->device_name);
+      ev_watcher* watcher = event_register_timer(EV_DEFAULT_ packet_watcher_cb, 1);
+      watcher->data = (device_dev_t *) if_dev;
+      break;
+   }
+   }
 
    return;
 }
 
-void open_pcap(device_dev_t* if_dev, options_t *options) {
+/**
+ * open a live capture; the caller is responsible to register
+ * the file descriptor at an event loop
+ */
+void open_pcap_capture(device_dev_t* if_dev, options_t *options) {
 
    pcap_t * pcap = NULL;
    pcap = pcap_open_live(if_dev->device_name,
@@ -160,6 +317,11 @@ void open_pcap(device_dev_t* if_dev, options_t *options) {
    LOGGER_debug("Register io handling for interface: %s", if_dev->device_name);
 
    setNONBlocking(if_dev);
+}
+
+void open_pcap(device_dev_t* if_dev, options_t *options) {
+
+   open_pcap_capture(if_dev, options);
 
    int fd = get_file_desc(if_dev);
    LOGGER_debug("File Descriptor: %d", fd);
@@ -0,0 +1,223 @@
+/*
+ * impd4e - a small network probe which allows to monitor and sample datagrams
+ * from the network based on hash-based packet selection.
+ *
+ * Copyright (c) 2011
+ *
+ * Fraunhofer FOKUS
+ * www.fokus.fraunhofer.de
+ *
+ * in cooperation with
+ *
+ * Technical University Berlin
+ * www.av.tu-berlin.de
+ *
+ * authors:
+ * Ramon Masek <ramon.masek@fokus.fraunhofer.de>
+ * Christian Henke <c.henke@tu-berlin.de>
+ * Carsten Schmoll <carsten.schmoll@fokus.fraunhofer.de>
+ *
+ * For questions/comments contact packettracking@fokus.fraunhofer.de
+ *
+ * This program is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software Foundation;
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * selection ranges
+ *
+ * Each device selects the packets whose hash id lies in one of up to
+ * SELECTION_RANGES disjoint ranges; e.g. different ratios per interface,
+ * or stratified ranges for partitioned correlators. Without an own
+ * selection (-H, -m, -M, -r with @<interface>) a device follows the
+ * global one.
+ *
+ * The capture threads read the active set of a device without a lock; the
+ * main thread fills the other set of the device and switches the pointer.
+ * The other set is only refilled after the workers stopped using it
+ * (workers_sync() ends with workers_quiesce()); without workers the main
+ * thread captures itself.
+ */
+
+#include <stdlib.h>  // strtoul
+#include <string.h>  // memset, strcmp
+
+#include "selection.h"
+
+#include "worker_handler.h"
+#include "settings.h" // g_options
+#include "logger.h"
+
+// -----------------------------------------------------------------------------
+// Functions
+// -----------------------------------------------------------------------------
+
+static inline void set_bucket( uint64_t* map, uint32_t b ) {
+   map[b >> 6] |= 1ull << (b & 63);
+}
+
+/** bitmaps of the top 8 hash bits from the ranges */
+static void selection_build( selection_t* s ) {
+   uint32_t i, b;
+
+   memset( s->full,    0, sizeof(s->full) );
+   memset( s->partial, 0, sizeof(s->partial) );
+
+   for( i = 0; i < s->count; ++i ) {
+      uint32_t min = s->min[i];
+      uint32_t max = s->min[i] + s->span[i];
+
+      for( b = (min >> 24); b <= (max >> 24); ++b ) {
+         uint32_t first = b << 24;
+         uint32_t last  = first | 0xFFFFFF;
+
+         if( min <= first && last <= max ) {
+            set_bucket( s->full, b );
+         }
+         else {
+            set_bucket( s->partial, b );
+         }
+      }
+   }
+}
+
+void selection_clear( selection_t* s ) {
+   memset( s, 0, sizeof(*s) );
+}
+
+int selection_add( selection_t* s, uint32_t min, uint32_t max ) {
+   uint32_t lo[SELECTION_RANGES+1];
+   uint32_t hi[SELECTION_RANGES+1];
+   uint32_t i, n = 0, m = 1;
+   int      added = 0;
+
+   if( max < min ) {
+      return -1;
+   }
+
+   // insert sorted by the lower bound
+   for( i = 0; i < s->count; ++i ) {
+      if( !added && min < s->min[i] ) {
+         lo[n] = min;
+         hi[n++] = max;
+         added = 1;
+      }
+      lo[n] = s->min[i];
+      hi[n++] = s->min[i] + s->span[i];
+   }
+   if( !added ) {
+      lo[n] = min;
+      hi[n++] = max;
+   }
+
+   // merge overlapping and adjacent ranges
+   for( i = 1; i < n; ++i ) {
+      if( lo[i] <= hi[m-1] || lo[i] - 1 == hi[m-1] ) {
+         if( hi[i] > hi[m-1] ) {
+            hi[m-1] = hi[i];
+         }
+      }
+      else {
+         lo[m] = lo[i];
+         hi[m++] = hi[i];
+      }
+   }
+
+   if( SELECTION_RANGES < m ) {
+      return -1;
+   }
+   for( i = 0; i < m; ++i ) {
+      s->min[i]  = lo[i];
+      s->span[i] = hi[i] - lo[i];
+   }
+   s->count = m;
+   selection_build( s );
+   return 0;
+}
+
+int selection_parse( selection_t* s, const char* arg ) {
+   const char* p = arg;
+   char*       next = NULL;
+
+   selection_clear( s );
+   do {
+      uint32_t min, max;
+
+      min = strtoul( p, &next, 0 );
+      if( next == p || '-' != *next ) {
+         return -1;
+      }
+      p = next + 1;
+      max = strtoul( p, &next, 0 );
+      if( next == p || 0 > selection_add(s, min, max) ) {
+         return -1;
+      }
+      p = next + 1;
+   } while( ',' == *next );
+
+   return ('\0' == *next || '@' == *next)? 0 : -1;
+}
+
+double selection_ratio( const selection_t* s ) {
+   double   sum = 0;
+   uint32_t i;
+
+   for( i = 0; i < s->count; ++i ) {
+      sum += (double) s->span[i] + 1;
+   }
+   return sum * 100 / ((double) UINT32_MAX + 1);
+}
+
+void selection_publish( device_dev_t* dev, const selection_t* s ) {
+   selection_t* next = (dev->selection == &dev->sel_sets[0])
+         ? &dev->sel_sets[1] : &dev->sel_sets[0];
+
+   // 'next' was active up to the last publish; workers_sync() waited
+   // for the workers to leave it
+   *next = *s;
+   __atomic_store_n( &dev->selection, next, __ATOMIC_SEQ_CST );
+   workers_sync( dev );
+
+   LOGGER_debug( "%s: selection of %.4f%% in %u range(s)"
+         , dev->device_name, selection_ratio(s), s->count );
+}
+
+void selection_publish_global() {
+   selection_t s;
+   int i;
+
+   if( 0 < g_options.selection.count ) {
+      s = g_options.selection;
+   }
+   else {
+      selection_clear( &s );
+      selection_add( &s, g_options.sel_range_min, g_options.sel_range_max );
+   }
+
+   for( i = 0; i < g_options.number_interfaces; ++i ) {
+      if( !if_devices[i].sel_local ) {
+         selection_publish( &if_devices[i], &s );
+      }
+   }
+}
+
+device_dev_t* selection_device( const char* name ) {
+   int i;
+
+   for( i = 0; i < g_options.number_interfaces; ++i ) {
+      if( 0 == strcmp(name, if_devices[i].device_name) ) {
+         return &if_devices[i];
+      }
+   }
+   return NULL;
+}
@@ -0,0 +1,139 @@
+/*
+ * impd4e - a small network probe which allows to monitor and sample datagrams
+ * from the network based on hash-based packet selection.
+ *
+ * Copyright (c) 2011
+ *
+ * Fraunhofer FOKUS
+ * www.fokus.fraunhofer.de
+ *
+ * in cooperation with
+ *
+ * Technical University Berlin
+ * www.av.tu-berlin.de
+ *
+ * authors:
+ * Ramon Masek <ramon.masek@fokus.fraunhofer.de>
+ * Christian Henke <c.henke@tu-berlin.de>
+ * Carsten Schmoll <carsten.schmoll@fokus.fraunhofer.de>
+ *
+ * For questions/comments contact packettracking@fokus.fraunhofer.de
+ *
+ * This program is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software Foundation;
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * packet selectors
+ *
+ * Besides the hash-based selection, the probe has the systematic
+ * count-based and time-based and the random n-out-of-N selectors of
+ * RFC 5475. They decide before any header is parsed or hashed; only the
+ * selected packets are hashed for the packet id. The parameters are
+ * reported with the PSAMP selector template (export_data_selector()).
+ */
+
+#include <stdlib.h>  // strtoul
+#include <strings.h> // strcasecmp, strncasecmp
+#include <time.h>    // time
+#include <unistd.h>  // getpid
+
+#include "selector.h"
+
+#include "hash.h"     // calcHashValue_BOB
+#include "logger.h"
+
+// -----------------------------------------------------------------------------
+// Functions
+// -----------------------------------------------------------------------------
+
+/** "<a>" or "<a>:<b>" after the selector name; number of values, -1 on error */
+static int parse_values( const char* arg, uint32_t* a, uint32_t* b ) {
+   char* next = NULL;
+
+   *a = strtoul( arg, &next, 0 );
+   if( next == arg ) {
+      return -1;
+   }
+   if( '\0' == *next ) {
+      return 1;
+   }
+   if( ':' != *next ) {
+      return -1;
+   }
+   arg = next + 1;
+   *b = strtoul( arg, &next, 0 );
+   return (next == arg || '\0' != *next)? -1 : 2;
+}
+
+int selector_parse( options_t* options, const char* arg ) {
+   uint32_t a = 0, b = 0;
+   int      n = 0;
+
+   if( 0 == strcasecmp(arg, "hash") ) {
+      options->selector = SELECTOR_HASH;
+      return 0;
+   }
+
+   if( 0 == strncasecmp(arg, "count:", 6) ) {
+      // 1-in-N or <interval> of <interval>+<space>
+      n = parse_values( arg+6, &a, &b );
+      if( 1 == n && 0 < a ) {
+         b = a - 1;
+         a = 1;
+      }
+      options->selector = SELECTOR_COUNT;
+   }
+   else if( 0 == strncasecmp(arg, "time:", 5) ) {
+      n = parse_values( arg+5, &a, &b );
+      options->selector = SELECTOR_TIME;
+   }
+   else if( 0 == strncasecmp(arg, "random:", 7) ) {
+      // n of N; the period is N
+      n = parse_values( arg+7, &a, &b );
+      if( 2 == n && a <= b ) {
+         b -= a;
+      }
+      else {
+         n = -1;
+      }
+      options->selector = SELECTOR_RANDOM;
+   }
+
+   if( 0 >= n || 0 == a || UINT32_MAX - a < b ) {
+      LOGGER_fatal( "Invalid selector (hash|count:<N>|count:<interval>:<space>"
+            "|time:<interval>:<space>|random:<n>:<N>): %s", arg );
+      options->selector = SELECTOR_HASH;
+      return -1;
+   }
+   options->selector_interval = a;
+   options->selector_period   = a + b;
+   LOGGER_info( "selector %s: %u of %u", arg, a, a + b );
+   return 0;
+}
+
+void selector_init_device( device_dev_t* dev ) {
+   dev->selector_position = 0;
+   dev->selector_chosen   = 0;
+   // different for each device and worker; never 0
+   dev->selector_random   = ((uint32_t) (uintptr_t) dev ^ getpid() ^ time(NULL)) | 1;
+}
+
+uint16_t selector_algorithm() {
+   // hash-based filtering has a code for BOB only
+   if( SELECTOR_HASH == g_options.selector
+         && calcHashValue_BOB != g_options.hash_function.function ) {
+      return 0;
+   }
+   return g_options.selector;
+}
@@ -68,8 +68,15 @@
 #include "logger.h"
 #include "settings.h"
 #include "hash.h"
+#include "hash_batch.h"
 #include "helper.h"
 #include "ipfix_handler.h"
+#include "packet_handler.h"
+#include "exporter.h"
+#include "flow_cache.h"
+#include "tunnel.h"
+#include "selection.h"
+#include "selector.h"
 
 #ifdef PFRING
 #include "pfring_filter.h"
@@ -125,75 +132,185 @@ options_t* getOptions() {
 // =============================================================================
 
 /**
- * Set sampling ratio, returns -1 in case of failure.
+ * Selection range addressed by "<value>[@<interface>]": the own range of the
+ * interface or the global one. Returns -1 if the interface is unknown.
+ */
+static int selection_target(options_t *options, char* s,
+      device_dev_t** dev, uint32_t** min, uint32_t** max) {
+  char* at = strchr(s, '@');
+
+  *dev = NULL;
+  *min = &options->sel_range_min;
+  *max = &options->sel_range_max;
+  if (NULL != at) {
+    *dev = selection_device(at+1);
+    if (NULL == *dev) {
+      LOGGER_error("selection: unknown interface: %s", at+1);
+      return -1;
+    }
+    if (!(*dev)->sel_local) {
+      (*dev)->sel_range_min = options->sel_range_min;
+      (*dev)->sel_range_max = options->sel_range_max;
+    }
+    *min = &(*dev)->sel_range_min;
+    *max = &(*dev)->sel_range_max;
+  }
+  return 0;
+}
+
+/**
+ * Hand a changed selection range to the capture: to the interface, or to
+ * all interfaces without an own selection (dev == NULL).
+ */
+static void selection_changed(options_t *options, device_dev_t* dev) {
+  selection_t s;
+
+  if (NULL == dev) {
+    selection_clear(&options->selection);
+    selection_publish_global();
+    return;
+  }
+  selection_clear(&s);
+  selection_add(&s, dev->sel_range_min, dev->sel_range_max);
+  dev->sel_local = 1;
+  selection_publish(dev, &s);
+}
+
+// =============================================================================
+
+/**
+ * Set selection range lower bound "<value>[@<interface>]",
+ * returns -1 in case of failure.
  */
 int set_sampling_lowerbound(options_t *options, char* s) {
+  device_dev_t* dev;
+  uint32_t *min, *max;
+
+  if (0 > selection_target(options, s, &dev, &min, &max)) {
+    return -1;
+  }
+
   errno = 0;
   long long int value = strtoll(s, NULL, 0);
 
   if ( UINT32_MAX < value )
   {
     LOGGER_warn("selection range minimum 'out of range (UINT32_MAX)' used to be (uint32_t)");
-    options->sel_range_min = UINT32_MAX;
+    *min = UINT32_MAX;
   }
   else if ( 0 > value )
   {
     LOGGER_warn("selection range minimum 'out of range (ZERO)' used to be (uint32_t)");
-    options->sel_range_min = 0;
+    *min = 0;
   }
   else
   {
-    options->sel_range_min = (uint32_t) value;
+    *min = (uint32_t) value;
   }
-  LOGGER_debug("selection range (lowerbound): %#08x (%d)", options->sel_range_min, options->sel_range_min);
+  LOGGER_debug("selection range (lowerbound): %#08x (%d)", *min, *min);
 
   // check if upper bound is greater than lowerbound
-  if(options->sel_range_max < options->sel_range_min)
+  if(*max < *min)
   {
     LOGGER_warn( "lower bound (%#08x) > upper bound (%#08x); adjust upper bound"
-               , options->sel_range_min
-          , options->sel_range_max );
-    options->sel_range_max = options->sel_range_min;
+               , *min
+          , *max );
+    *max = *min;
   }
 
-  return options->sel_range_min;
+  selection_changed(options, dev);
+  return *min;
 }
 
 // =============================================================================
 
 /**
- * Set sampling ratio, returns -1 in case of failure.
+ * Set selection range upper bound "<value>[@<interface>]",
+ * returns -1 in case of failure.
  */
 int set_sampling_upperbound(options_t *options, char* s) {
+  device_dev_t* dev;
+  uint32_t *min, *max;
+
+  if (0 > selection_target(options, s, &dev, &min, &max)) {
+    return -1;
+  }
+
   errno = 0;
   long long int value = strtoll(s, NULL, 0);
 
   if ( UINT32_MAX < value )
   {
     LOGGER_warn("selection range maximum 'out of range (UINT32_MAX)' used to be (uint32_t)");
-    options->sel_range_max = UINT32_MAX;
+    *max = UINT32_MAX;
   }
   else if ( 0 > value )
   {
     LOGGER_warn("selection range maximum 'out of range (ZERO)' used to be (uint32_t)");
-    options->sel_range_max = 0;
+    *max = 0;
   }
   else
   {
-    options->sel_range_max = (uint32_t) value;
+    *max = (uint32_t) value;
   }
-  LOGGER_debug("selection range (uppperbound): %#08x (%d)", options->sel_range_max, options->sel_range_max);
+  LOGGER_debug("selection range (uppperbound): %#08x (%d)", *max, *max);
 
   // check if upper bound is greater than lowerbound
-  if(options->sel_range_max < options->sel_range_min)
+  if(*max < *min)
   {
     LOGGER_warn( "lower bound (%#08x) > upper bound (%#08x); adjust lower bound"
-               , options->sel_range_min
-          , options->sel_range_max );
-    options->sel_range_min = options->sel_range_max;
+               , *min
+          , *max );
+    *min = *max;
+  }
+
+  selection_changed(options, dev);
+  return *max;
+}
+
+// =============================================================================
+
+/**
+ * Set several disjoint selection ranges
+ * "<min>-<max>[,<min>-<max>...][@<interface>]", returns -1 in case of failure.
+ */
+int set_selection_ranges(options_t *options, char* s) {
+  device_dev_t* dev;
+  uint32_t *min, *max;
+  selection_t sel;
+
+  if (0 > selection_target(options, s, &dev, &min, &max)) {
+    return -1;
+  }
+  if (0 > selection_parse(&sel, s)) {
+    LOGGER_error("invalid selection ranges (at most %d): %s", SELECTION_RANGES, s);
+    return -1;
   }
 
-  return options->sel_range_max;
+  if (NULL == dev) {
+    options->selection = sel;
+    selection_publish_global();
+  }
+  else {
+    dev->sel_local = 1;
+    selection_publish(dev, &sel);
+  }
+  return 0;
+}
+
+// =============================================================================
+
+/**
+ * Set seed of the selection and the packet id hash function
+ */
+uint32_t set_hash_seed(options_t *options, char* s) {
+  uint32_t seed = (uint32_t) strtoul(s, NULL, 0);
+
+  options->hash_function.seed  = seed;
+  options->pktid_function.seed = seed;
+  LOGGER_info("hash seed: %#08x", seed);
+
+  return seed;
 }
 
 // =============================================================================
@@ -202,22 +319,30 @@ int set_sampling_upperbound(options_t *options, char* s) {
  * Set sampling ratio, returns -1 in case of failure.
  */
 int set_sampling_ratio(options_t *options, char* value) {
+   device_dev_t* dev;
+   uint32_t *min, *max;
+
+   if (0 > selection_target(options, value, &dev, &min, &max)) {
+      return -1;
+   }
+
    double sampling_ratio = strtod( value, NULL);
    LOGGER_debug("sampling ratio: %lf", sampling_ratio);
    /*
     * for the sampling ratio we do not like values at the edge, therefore we use values beginning at the 10% slice.
     */
-   options->sel_range_min = 0x19999999;
-   options->sel_range_max = (double) UINT32_MAX / 100 * sampling_ratio;
+   *min = 0x19999999;
+   *max = (double) UINT32_MAX / 100 * sampling_ratio;
 
-   if (UINT32_MAX - options->sel_range_max > options->sel_range_min) {
-      options->sel_range_min = 0x19999999;
-      options->sel_range_max += options->sel_range_min;
+   if (UINT32_MAX - *max > *min) {
+      *min = 0x19999999;
+      *max += *min;
    } else {
       /* more than 90% therefore use also values from first 10% slice */
-      options->sel_range_min = UINT32_MAX - options->sel_range_max;
-      options->sel_range_max = UINT32_MAX;
+      *min = UINT32_MAX - *max;
+      *max = UINT32_MAX;
    }
+   selection_changed(options, dev);
    return 0;
 }
 
@@ -236,6 +361,8 @@ int parse_template(char *arg_string) {
                    , { TS_TTL_RROTO_NAME, TS_TTL_PROTO_ID }
                    , { TS_TTL_RROTO_IP_NAME, TS_TTL_PROTO_IP_ID }
                    , { TS_NAME, TS_ID }
+                   , { FLOW_NAME, FLOW_ID }
+                   , { TS_TTL_PROTO_IP_LINK_NAME, TS_TTL_PROTO_IP_LINK_ID }
                    };
 
    // remove any leading whitespaces
@@ -287,30 +414,44 @@ void parseSelFunction(char *arg_string, options_t *options) {
 // =============================================================================
 
 /**
- * Parse command line hash function
+ * Find hash function by name, returns NULL for unknown names
  */
-hashFunction parseFunction(char *arg_string) {
+hashFunction lookupFunction(char *arg_string) {
    int k;
-   int j = 0;
+   int j = -1;
+   // the last matching prefix wins; SBOX64 has to follow SBOX
    struct hashfunction {
       char *hstring;
       hashFunction function;
    } hashfunctions[] = { { HASH_FUNCTION_BOB, calcHashValue_BOB }
                   , { HASH_FUNCTION_TWMX, calcHashValue_TWMXRSHash }
                   , { HASH_FUNCTION_HSIEH, calcHashValue_Hsieh }
-                  , { HASH_FUNCTION_OAAT, calcHashValue_OAAT } };
+                  , { HASH_FUNCTION_OAAT, calcHashValue_OAAT }
+                  , { HASH_FUNCTION_SBOX, calcHashValue_SBOX }
+                  , { HASH_FUNCTION_SBOX64, calcHashValue_SBOX64 } };
 
    for (k = 0; k < (sizeof(hashfunctions) / sizeof(struct hashfunction)); k++) {
       if (strncasecmp(arg_string, hashfunctions[k].hstring
             , strlen(hashfunctions[k].hstring)) == 0)
       {
          j = k;
-         LOGGER_info("using %s as hashFunction", hashfunctions[k].hstring);
       }
    }
+   if (-1 == j) {
+      return NULL;
+   }
+   LOGGER_info("using %s as hashFunction", hashfunctions[j].hstring);
    return hashfunctions[j].function;
 }
 
+/**
+ * Parse command line hash function, falls back to BOB
+ */
+hashFunction parseFunction(char *arg_string) {
+   hashFunction f = lookupFunction(arg_string);
+   return (NULL == f) ? calcHashValue_BOB : f;
+}
+
 // =============================================================================
 /**
  * Print out command usage
@@ -353,6 +494,10 @@ void print_help() {
 			"\t f - plain text file;              -i f:data.txt\n"
 			"\t s - inet udp socket (AF_INET);    -i s:192.168.0.42:4711\n"
 			"\t u - unix domain socket (AF_UNIX); -i u:/tmp/socket.AF_UNIX\n"
+			#ifdef HAVE_TPACKET3
+			"\t t - ethernet adapter using a memory mapped packet socket (TPACKET_V3);\n"
+			"\t                                   -i t:eth0\n"
+			#endif
 			#else
 			"   -i  <r>:<interface>    interface(s) to listen on. It can be used multiple times.\n"
 			"\t r - ethernet adapter using pfring;-i r:eth0\n"
@@ -368,24 +513,55 @@ void print_help() {
 			"\t\t\t\t  filtering policy (valid for all filters).\n"
 			"\t\t\t\t  It can be used multiple times.\n"
             #endif // PFRING
-			"   -C  <Collector IP>             an IPFIX collector address\n"
+			"   -A  <distribution>             distribution of the packet ids among the collectors:\n"
+			"                                  \"all\"  - every collector gets every message\n"
+			"                                  \"rr\"   - round robin per message\n"
+			"                                  \"hash\" - by packet id; disjoint hash range per collector\n"
+			"                                  Default: \"all\"\n"
+			"   -b  <min>:<max>[:<interval>[:<cpu>]]\n"
+			"                                  adaptive selection ratio in %% (like -r); halved on\n"
+			"                                  kernel drops, full export rings or more than <cpu> %%\n"
+			"                                  CPU per capture thread, doubled when quiet again;\n"
+			"                                  decided every <interval> sec (Default: 5.0:90)\n"
+			"   -C  <Collector IP>[:<port>]    IPFIX collector address(es), comma separated;\n"
+			"                                  may be given several times\n"
 			"                                  Default: localhost\n"
 			"   -d <probe name>                a probe name\n"
 			"                                  Default: <hostname>\n"
 			"   -D <location name>             a location name\n"
+			"   -E  <tunnels>                  decapsulate tunnels before the selection; comma\n"
+			"                                  separated: \"ipip\", \"gre\", \"vxlan\", \"gtp\", \"all\"\n"
+			"                                  the inner packet is hashed and exported\n"
 			"   -e  <export packet count>      size of export buffer after which packets\n"
 						"                                  are flushed (per device)\n"
 			#ifndef PFRING
 			"   -f  <bpf>                      Berkeley Packet Filter expression (e.g. tcp udp icmp)\n"
 			"\n"
            #endif
-			"   -F  <hash_function>            hash function to use:\n"
-			"                                  \"BOB\", \"OAAT\", \"TWMX\", \"HSIEH\"\n"
+			"   -F  <hash_function>[:batch]    hash function to use:\n"
+			"                                  \"BOB\", \"OAAT\", \"TWMX\", \"HSIEH\", \"SBOX\", \"SBOX64\"\n"
+			"                                  \"batch\": hash the packets of a tpacket block or a\n"
+			"                                  socket batch (-i t:, -i s:, -i u:) together in SIMD\n"
+			"                                  lanes; BOB, OAAT and TWMX with the selection \"IP\"\n"
+			"                                  or \"IP+TP\", the same hash values\n"
+			"\n"
+			"   -g  <fragments>                selection of IP fragments:\n"
+			"                                  \"invariant\": hash addresses, protocol and fragment id\n"
+			"                                  \"table[:<entries>]\": later fragments take the decision\n"
+			"                                  of the first one (Default entries: 1024)\n"
+			"                                  \"none\": hash the selected fields like any packet\n"
+			"                                  \"invariant\" and \"table\" change the packet ids of\n"
+			"                                  fragments; probes must use the same policy\n"
+			"                                  Default: none\n"
 			"\n"
 			"   -G  <interval>                 location export interval in seconds. \n"
 			"                                  Use -G 0 for exporting once at startup.\n"
 			"                                  Default: 60.0 \n"
 			"\n"
+			"   -H  <min>-<max>[,<min>-<max>...][@<interface>]\n"
+			"                                  disjoint selection ranges (hex|int), at most 8;\n"
+			"                                  e.g. stratified ranges for partitioned correlators\n"
+			"\n"
 			"   -I  <interval>                 pktid export interval in sec. (Default: 3.0)\n"
 			"                                  Use -I 0 for disabling this export.\n"
 			"\n"
@@ -395,6 +571,10 @@ void print_help() {
 			"   -K  <interval>                 interface stats export interval in sec (Default: 10.0). \n"
 			"                                  Use -K 0 for disabling this export.\n"
 			"\n"
+			"   -k  <seed>                     seed of the hash functions (hex|int), all probes\n"
+			"                                  selecting the same packets need the same seed\n"
+			"                                  Default: 0x32545\n"
+			"\n"
 			"   -l <latitude>                  geo location (double): latitude\n"
 			"   -l <lat>:<long>:<interval>     short form\n"
 			"   -L <longitude>                 geo location (double): longitude\n"
@@ -402,6 +582,8 @@ void print_help() {
 			"\n"
 			"   -m  <minimum selection range>  integer - do not use in conjunction with -r \n"
 			"   -M  <maximum selection range>  integer - do not use in conjunction with -r \n"
+			"                                  -m, -M, -r, -H: <value>@<interface> sets an own\n"
+			"                                  selection of the interface (after its -i)\n"
 			"\n"
 			"   -N  <snaplength>               max capturing size in bytes (Default: 80) \n"
 			"\n"
@@ -412,12 +594,45 @@ void print_help() {
 			"                                  used for tunneled or crooked packets\n"
 			"                                  !!! the offset is applied after the link layer (e.g. ethernet header)\n"
 			"   -p  <hash function>            use different hash_function for packetID generation:\n"
-			"                                  \"BOB\", \"OAAT\", \"TWMX\", \"HSIEH\" \n"
+			"                                  \"BOB\", \"OAAT\", \"TWMX\", \"HSIEH\", \"SBOX\", \"SBOX64\" \n"
 			"\n"
 			"   -P  <Collector Port>           an IPFIX Collector Port\n"
 			"                                  Default: 4739\n"
+			"   -x  <transport>                transport to the collector: \"tcp\", \"udp\", \"sctp\"\n"
+			"                                  Default: \"tcp\"\n"
+			"   -Y  <interval>                 template retransmission interval in sec (udp only)\n"
+			"                                  Default: 60.0\n"
+			"   -Z  <mtu>                      path MTU to the collector; ipfix messages are\n"
+			"                                  packed up to one packet of this size\n"
+			"                                  Default: 1500\n"
+			"   -q  <file>                     spool file; messages which cannot be sent are\n"
+			"                                  spooled and replayed when the collector is back\n"
+			"   -Q  <size>                     spool size in MB (Default: 64)\n"
+			"   -B  <rate>                     spool replay rate in kB/s (Default: 1000)\n"
 			"   -r  <sampling ratio>           in %% (double)\n"
 			"\n"
+			#ifndef PFRING
+			"   -R  <replay mode>              replay mode for pcap files (-i p:<file>)\n"
+			"                                  \"fast\"          - as fast as possible\n"
+			"                                  \"pace[:<speed>]\" - at the trace timestamps;\n"
+			"                                                    speed is a multiplier (e.g. pace:2.5)\n"
+			"                                  \"timer\"         - %d packets per second\n"
+			"                                  Default: \"timer\"\n"
+			"\n"
+			#endif
+			#ifdef HAVE_TPACKET3
+			"   -T  <ring>[:<block>[:<timeout>]] ring setup for memory mapped capture (-i t:<interface>)\n"
+			"                                  ring size in MiB, block size in KiB, block timeout in ms\n"
+			"                                  Default: %d:%d:%d\n"
+			"\n"
+			#endif
+			#ifdef HAVE_PACKET_FANOUT
+			"   -W  <n>[:<mode>]               n capture workers (threads) per interface (-i i: or -i t:)\n"
+			"                                  packets are distributed by a PACKET_FANOUT group\n"
+			"                                  mode: \"hash\" - by flow hash; \"cpu\" - by receiving cpu\n"
+			"                                  Default: 1:hash\n"
+			"\n"
+			#endif
 			"   -s  <selection function>       which parts of the packet used for hashing (presets)\n"
 			"                                  either: \"IP+TP\", \"IP\", \"REC8\", \"PACKET\"\n"
 			"                                  Default: \"IP+TP\"\n"
@@ -435,9 +650,22 @@ void print_help() {
 			"                                    < and > have to be escaped \n"
 			"                                  Example: RAW20,34-45,14+4,4\n"
 			"\n"
-			"   -t  <template>                 either \"min\" or \"lp\" or \"ts\" or \"ls\"\n"
+			"   -t  <template>                 either \"min\" or \"lp\" or \"ts\" or \"ls\" or \"lsl\" or \"flow\"\n"
+			"                                  \"lsl\" adds the VLAN id and the top MPLS label to \"ls\"\n"
+			"                                  \"flow\" aggregates the selected packets to flows\n"
+			"                                  \"ls\", \"lsl\" and \"flow\" use IPv6 templates for IPv6\n"
 			"                                  Default: \"min\"\n"
+			"   -w  <entries>                  flow cache size (Default: 65536)\n"
+			"   -j  <timeout>                  flow active timeout in sec (Default: 120.0)\n"
+			"   -z  <timeout>                  flow idle timeout in sec (Default: 15.0)\n"
 			"   -u                             use only one oid from the first interface \n"
+			"   -U  <selector>                 packet selector; no hashing for unselected packets:\n"
+			"                                  \"hash\"                       - hash range (-m, -M, -r, -H)\n"
+			"                                  \"count:<N>\"                  - every N-th packet\n"
+			"                                  \"count:<interval>:<space>\"   - systematic by count\n"
+			"                                  \"time:<interval>:<space>\"    - systematic by time (usec)\n"
+			"                                  \"random:<n>:<N>\"             - n out of every N packets\n"
+			"                                  Default: \"hash\"\n"
 			"\n"
 			"   -v[expression]                 verbose-level; use multiple times to increase output \n"
 			"                                  filter by function names in comma-separated list at a certain \n"
@@ -454,7 +682,14 @@ void print_help() {
 			"\n"
 			"EXAMPLES for usage: \n"
 			"sudo impd4e -i i:eth0 -C 172.20.0.1 -r 1 -t min \n"
-			"sudo impd4e -i i:lo   -C 172.20.0.1 -o <id> -S 20,34-45\n");
+			"sudo impd4e -i i:lo   -C 172.20.0.1 -o <id> -S 20,34-45\n"
+			#ifndef PFRING
+			, PCAP_DISPATCH_PACKET_COUNT
+			#endif
+			#ifdef HAVE_TPACKET3
+			, TPACKET_RING_SIZE/(1024*1024), TPACKET_BLOCK_SIZE/1024, TPACKET_BLOCK_TIMEOUT
+			#endif
+			);
 
 	#ifdef PFRING
 		printf("Possible PF_RING filter keywords include: ");
@@ -523,11 +758,138 @@ int opt_c( char* arg, options_t* options ) {
    return 0;
 }
 
+/**
+ * collector list: <host>[:<port>][,<host>[:<port>]]...
+ * IPv6 addresses with a port are written as [<addr>]:<port>;
+ * may be given several times
+ */
 int opt_C( char* arg, options_t* options ) {
-   strcpy(options->collectorIP, arg);
+   char* tok;
+
+   for( tok = strtok(arg, ","); NULL != tok; tok = strtok(NULL, ",") ) {
+      collector_addr_t* c = &options->collectors[options->number_collectors];
+      char* port = NULL;
+
+      if( MAX_COLLECTORS == options->number_collectors ) {
+         LOGGER_fatal( "specify at most %d collectors with -C", MAX_COLLECTORS);
+         return -1;
+      }
+
+      if( '[' == tok[0] ) {
+         char* end = strchr(tok, ']');
+         if( NULL == end ) {
+            LOGGER_fatal( "Invalid collector address: %s", tok);
+            return -1;
+         }
+         *end = '\0';
+         ++tok;
+         if( ':' == end[1] ) {
+            port = end + 2;
+         }
+      }
+      else if( NULL != (port = strchr(tok, ':')) && NULL == strchr(port+1, ':') ) {
+         *port++ = '\0';
+      }
+      else {
+         // plain IPv6 address
+         port = NULL;
+      }
+
+      snprintf(c->host, sizeof(c->host), "%s", tok);
+      c->port = 0;
+      if( NULL != port && 0 >= (c->port = atoi(port)) ) {
+         LOGGER_fatal( "Invalid collector port: %s", port);
+         return -1;
+      }
+      ++options->number_collectors;
+   }
+   return 0;
+}
+
+int opt_A( char* arg, options_t* options ) {
+   if( 0 == strcasecmp(arg, "all") ) {
+      options->distribution = DISTRIBUTE_ALL;
+   }
+   else if( 0 == strcasecmp(arg, "rr") ) {
+      options->distribution = DISTRIBUTE_RR;
+   }
+   else if( 0 == strcasecmp(arg, "hash") ) {
+      options->distribution = DISTRIBUTE_HASH;
+   }
+   else {
+      LOGGER_fatal( "Invalid distribution (all|rr|hash): %s", arg);
+      return -1;
+   }
+   return 0;
+}
+
+int opt_E( char* arg, options_t* options ) {
+   int types = tunnel_parse_types(arg);
+
+   if( 0 > types ) {
+      LOGGER_fatal( "Invalid tunnel types (ipip,gre,vxlan,gtp,all): %s", arg);
+      return -1;
+   }
+   options->decapsulation = types;
+   return 0;
+}
+
+int opt_g( char* arg, options_t* options ) {
+   if( 0 == strcasecmp(arg, "none") ) {
+      options->fragment_policy = FRAGMENTS_NONE;
+   }
+   else if( 0 == strcasecmp(arg, "invariant") ) {
+      options->fragment_policy = FRAGMENTS_INVARIANT;
+   }
+   else if( 0 == strncasecmp(arg, "table", 5) && ('\0' == arg[5] || ':' == arg[5]) ) {
+      options->fragment_policy = FRAGMENTS_TABLE;
+      if( ':' == arg[5] ) {
+         char* end = NULL;
+         uint32_t size = strtoul(arg+6, &end, 0);
+         if( 0 == size || '\0' != *end ) {
+            LOGGER_fatal( "Invalid fragment table size: %s", arg+6);
+            return -1;
+         }
+         options->fragment_table_size = size;
+      }
+   }
+   else {
+      LOGGER_fatal( "Invalid fragment selection (none|invariant|table[:<entries>]): %s", arg);
+      return -1;
+   }
    return 0;
 }
 
+int opt_b( char* arg, options_t* options ) {
+   char*  next = NULL;
+   double min  = strtod(arg, &next);
+   double max  = 0;
+
+   if( ':' != *next ) {
+      LOGGER_fatal( "Invalid adaptive sampling (<min>:<max>[:<interval>[:<cpu>]]): %s", arg);
+      return -1;
+   }
+   max = strtod(next+1, &next);
+   if( ':' == *next ) {
+      options->adaptive_interval = strtod(next+1, &next);
+      if( ':' == *next ) {
+         options->adaptive_cpu_limit = strtod(next+1, &next);
+      }
+   }
+   if( '\0' != *next || 0 >= min || min > max || 100 < max
+         || 0 >= options->adaptive_interval || 0 >= options->adaptive_cpu_limit ) {
+      LOGGER_fatal( "Invalid adaptive sampling (<min>:<max>[:<interval>[:<cpu>]]): %s", arg);
+      return -1;
+   }
+   options->adaptive_min_ratio = min;
+   options->adaptive_max_ratio = max;
+   return 0;
+}
+
+int opt_U( char* arg, options_t* options ) {
+   return selector_parse( options, arg );
+}
+
 int opt_e( char* arg, options_t* options ) {
    options->export_packet_count = atoi(arg);
    return 0;
@@ -576,6 +938,11 @@ int opt_i( char* arg, options_t* options ) {
          case 'u': // unix domain socket
             if_devices[if_idx].device_type = TYPE_SOCKET_UNIX;
             break;
+         #ifdef HAVE_TPACKET3
+         case 't': // memory mapped packet socket
+            if_devices[if_idx].device_type = TYPE_TPACKET;
+            break;
+         #endif
          #ifdef PFRING
          case 'r': // use pfring instead of libpcap
             if_devices[if_idx].device_type = TYPE_PFRING;
@@ -657,18 +1024,140 @@ int opt_6( char* arg, options_t* options ) {
    return 0;
 }
 
+// interface of "<value>@<interface>" given with -i before?
+static int selection_interface_known( char* arg ) {
+   char* at = strchr(arg, '@');
+
+   if( NULL != at && NULL == selection_device(at+1) ) {
+      LOGGER_fatal( "unknown interface (give -i first): %s", at+1);
+      return 0;
+   }
+   return 1;
+}
+
 int opt_m( char* arg, options_t* options ) {
+   if( !selection_interface_known(arg) ) {
+      return -1;
+   }
    set_sampling_lowerbound(options, arg);
    return 0;
 }
 
 int opt_M( char* arg, options_t* options ) {
+   if( !selection_interface_known(arg) ) {
+      return -1;
+   }
    set_sampling_upperbound(options, arg);
    return 0;
 }
 
 int opt_r( char* arg, options_t* options ) {
-   set_sampling_ratio(options, arg);
+   return set_sampling_ratio(options, arg);
+}
+
+int opt_H( char* arg, options_t* options ) {
+   return set_selection_ranges(options, arg);
+}
+
+int opt_R( char* arg, options_t* options ) {
+   // remove any leading whitespaces
+   while( isspace(*arg) ) ++arg;
+
+   if( 0 == strncasecmp(arg, "fast", 4) ) {
+      options->replay_mode = REPLAY_FAST;
+   }
+   else if( 0 == strncasecmp(arg, "pace", 4) ) {
+      options->replay_mode  = REPLAY_PACED;
+      options->replay_speed = 1.0;
+      if( ':' == arg[4] ) {
+         options->replay_speed = atof(arg+5);
+         if( 0 >= options->replay_speed ) {
+            LOGGER_fatal( "Invalid replay speed: %s", arg+5);
+            return -1;
+         }
+      }
+   }
+   else if( 0 == strncasecmp(arg, "timer", 5) ) {
+      options->replay_mode = REPLAY_TIMER;
+   }
+   else {
+      LOGGER_fatal( "unknown replay mode: %s", arg);
+      return -1;
+   }
+   return 0;
+}
+
+int opt_T( char* arg, options_t* options ) {
+   #ifdef HAVE_TPACKET3
+   char* next = NULL;
+   unsigned long ring_mib  = 0;
+   unsigned long block_kib = options->tpacket_block_size / 1024;
+
+   // <ring MiB>[:<block KiB>[:<timeout ms>]]
+   ring_mib = strtoul(arg, &next, 10);
+   if( ':' == *next ) {
+      block_kib = strtoul(next+1, &next, 10);
+      if( ':' == *next ) {
+         options->tpacket_block_timeout = strtoul(next+1, &next, 10);
+      }
+   }
+   if( '\0' != *next && !isspace(*next) ) {
+      LOGGER_fatal( "Invalid tpacket ring specification: %s", arg);
+      return -1;
+   }
+
+   // the sizes are kept in bytes (uint32_t)
+   if( UINT32_MAX / (1024*1024) < ring_mib || UINT32_MAX / 1024 < block_kib ) {
+      LOGGER_fatal( "tpacket ring/block size too large (max %u MiB): %s"
+            , UINT32_MAX / (1024*1024), arg);
+      return -1;
+   }
+   options->tpacket_ring_size  = ring_mib * 1024 * 1024;
+   options->tpacket_block_size = block_kib * 1024;
+
+   // the block size has to be a multiple of the page size
+   // and the ring has to hold at least one block
+   long page_size = sysconf(_SC_PAGESIZE);
+   if( 0 == options->tpacket_block_size
+      || 0 != options->tpacket_block_size % page_size
+      || options->tpacket_ring_size < options->tpacket_block_size )
+   {
+      LOGGER_fatal( "Invalid tpacket ring/block size: %s", arg);
+      return -1;
+   }
+   #else
+   LOGGER_warn( "tpacket capture not supported: ignoring -T %s", arg);
+   #endif
+   return 0;
+}
+
+int opt_W( char* arg, options_t* options ) {
+   #ifdef HAVE_PACKET_FANOUT
+   char* next = NULL;
+   long  workers = strtol(arg, &next, 10);
+
+   if( 1 > workers || MAX_WORKERS < workers ) {
+      LOGGER_fatal( "Invalid number of workers (1-%d): %s", MAX_WORKERS, arg);
+      return -1;
+   }
+   options->workers = workers;
+
+   if( ':' == *next ) {
+      ++next;
+      if( 0 == strncasecmp(next, "hash", 4) ) {
+         options->fanout_mode = FANOUT_HASH;
+      }
+      else if( 0 == strncasecmp(next, "cpu", 3) ) {
+         options->fanout_mode = FANOUT_CPU;
+      }
+      else {
+         LOGGER_fatal( "unknown fanout mode: %s", next);
+         return -1;
+      }
+   }
+   #else
+   LOGGER_warn( "capture workers not supported: ignoring -W %s", arg);
+   #endif
    return 0;
 }
 
@@ -681,16 +1170,34 @@ inline int opt_s( char* arg, options_t* options ) {
 }
 
 int opt_F( char* arg, options_t* options ) {
-   options->hash_function = parseFunction(arg);
+   char* batch = strchr(arg, ':');
+
+   options->hash_function.function = parseFunction(arg);
+   options->hash_batch = 0;
+   if( NULL != batch ) {
+      if( 0 != strcasecmp(batch+1, "batch") ) {
+         LOGGER_fatal( "Invalid -F argument (<function>[:batch]): %s", arg);
+         return -1;
+      }
+      if( !hash_batch_supported(options->hash_function.function) ) {
+         LOGGER_warn( "no batch hashing for %s; hashing per packet", arg);
+      }
+      options->hash_batch = 1;
+   }
    return 0;
 }
 
 int opt_p( char* arg, options_t* options ) {
-   options->pktid_function = parseFunction(arg);
+   options->pktid_function.function = parseFunction(arg);
    options->hashAsPacketID = 0;
    return 0;
 }
 
+int opt_k( char* arg, options_t* options ) {
+   set_hash_seed(options, arg);
+   return 0;
+}
+
 int opt_P( char* arg, options_t* options ) {
    if ((options->collectorPort = atoi(arg)) < 0) {
       LOGGER_fatal( "Invalid -P argument!");
@@ -699,6 +1206,99 @@ int opt_P( char* arg, options_t* options ) {
    return 0;
 }
 
+int opt_x( char* arg, options_t* options ) {
+   if( 0 == strcasecmp(arg, "tcp") ) {
+      options->collectorProto = IPFIX_PROTO_TCP;
+   }
+   else if( 0 == strcasecmp(arg, "udp") ) {
+      options->collectorProto = IPFIX_PROTO_UDP;
+   }
+   else if( 0 == strcasecmp(arg, "sctp") ) {
+      options->collectorProto = IPFIX_PROTO_SCTP;
+   }
+   else {
+      LOGGER_fatal( "Invalid ipfix transport (tcp|udp|sctp): %s", arg);
+      return -1;
+   }
+   return 0;
+}
+
+int opt_Y( char* arg, options_t* options ) {
+   options->template_refresh_interval = atof(arg);
+   return 0;
+}
+
+int opt_Z( char* arg, options_t* options ) {
+   long mtu = strtol(arg, NULL, 0);
+
+   if( 576 > mtu || 65535 < mtu ) {
+      LOGGER_fatal( "Invalid path MTU (576-65535): %s", arg);
+      return -1;
+   }
+   options->path_mtu = mtu;
+   return 0;
+}
+
+int opt_q( char* arg, options_t* options ) {
+   options->spool_file = arg;
+   return 0;
+}
+
+int opt_Q( char* arg, options_t* options ) {
+   long size = strtol(arg, NULL, 0);
+
+   if( 1 > size ) {
+      LOGGER_fatal( "Invalid spool size (MB): %s", arg);
+      return -1;
+   }
+   options->spool_size = (uint64_t) size * 1024 * 1024;
+   return 0;
+}
+
+int opt_B( char* arg, options_t* options ) {
+   long rate = strtol(arg, NULL, 0);
+
+   if( 1 > rate || 4*1024*1024 < rate ) {
+      LOGGER_fatal( "Invalid spool replay rate (kB/s): %s", arg);
+      return -1;
+   }
+   options->spool_rate = rate * 1024;
+   return 0;
+}
+
+int opt_w( char* arg, options_t* options ) {
+   long size = strtol(arg, NULL, 0);
+
+   if( FLOW_CACHE_WAYS > size || (1L << 30) < size ) {
+      LOGGER_fatal( "Invalid flow cache size (%d-%ld): %s", FLOW_CACHE_WAYS, 1L << 30, arg);
+      return -1;
+   }
+   options->flow_cache_size = size;
+   return 0;
+}
+
+int opt_j( char* arg, options_t* options ) {
+   double timeout = atof(arg);
+
+   if( 0 >= timeout ) {
+      LOGGER_fatal( "Invalid flow active timeout: %s", arg);
+      return -1;
+   }
+   options->flow_active_timeout = timeout;
+   return 0;
+}
+
+int opt_z( char* arg, options_t* options ) {
+   double timeout = atof(arg);
+
+   if( 0 >= timeout ) {
+      LOGGER_fatal( "Invalid flow idle timeout: %s", arg);
+      return -1;
+   }
+   options->flow_idle_timeout = timeout;
+   return 0;
+}
+
 int opt_v( char* arg, options_t* options ) {
    if( (NULL != arg) && (isdigit(*arg)) ) {
       options->verbosity = atoi(arg);
@@ -793,7 +1393,8 @@ int opt_X( char* arg, options_t* options ) {
    b.ptr = (uint8_t*) arg;
    b.len = strlen(arg);
    b.size = b.len;
-   int hash = options->hash_function(&b);
+   b.count = 0;
+   int hash = hash_value(&options->hash_function, &b);
    printf( "hash=%04x for '%s'\n", hash, b.ptr);
 
    exit(0);
@@ -817,6 +1418,10 @@ struct config_map_t cfg_opt_list[] = {
 	{ '4',""  , &opt_4, "capture.ipv4"                   },
 	{ '6',""  , &opt_6, "capture.ipv6"                   },
 	{ 'O',":" , &opt_O, "capture.offset"                 },
+	{ 'R',":" , &opt_R, "capture.replay"                 },
+	{ 'T',":" , &opt_T, "capture.tpacket"                },
+	{ 'W',":" , &opt_W, "capture.workers"                },
+	{ 'E',":" , &opt_E, "capture.decapsulate"            },
 	{ 'f',":" , &opt_f, "filter.bpfilter"                },
 	{ 'N',":" , &opt_N, "filter.snaplength"              },
 	{ 'I',":" , &opt_I, "interval.data_export"           },
@@ -826,16 +1431,31 @@ struct config_map_t cfg_opt_list[] = {
 	{ 'm',":" , &opt_m, "selection.min_hash_range"       },
 	{ 'M',":" , &opt_M, "selection.max_hash_range"       },
 	{ 'r',":" , &opt_r, "selection.hash_selection_ratio" },
+	{ 'H',":" , &opt_H, "selection.ranges"               },
 	{ 's',":" , &opt_s, "selection.selection_preset"     },
 	{ 'S',":" , &opt_S, "selection.selection_parts"      },
 	{ 'F',":" , &opt_F, "selection.hash_function"        },
 	{ 'p',":" , &opt_p, "selection.pktid_function"       },
+	{ 'g',":" , &opt_g, "selection.fragments"            },
+	{ 'b',":" , &opt_b, "selection.adaptive"             },
+	{ 'U',":" , &opt_U, "selection.selector"             },
+	{ 'k',":" , &opt_k, "selection.hash_seed"            },
 	{ 'o',":" , &opt_o, "ipfix.observation_domain_id"    },
 	{ 'u',""  , &opt_u, "ipfix.one_odid"                 },
 	{ 'C',":" , &opt_C, "ipfix.collector_ip_address"     },
 	{ 'P',":" , &opt_P, "ipfix.collector_port"           },
+	{ 'A',":" , &opt_A, "ipfix.distribution"             },
 	{ 'e',":" , &opt_e, "ipfix.export_flush_count"       },
+	{ 'x',":" , &opt_x, "ipfix.transport"                },
+	{ 'Z',":" , &opt_Z, "ipfix.path_mtu"                 },
+	{ 'Y',":" , &opt_Y, "ipfix.template_refresh"         },
+	{ 'q',":" , &opt_q, "ipfix.spool_file"               },
+	{ 'Q',":" , &opt_Q, "ipfix.spool_size"               },
+	{ 'B',":" , &opt_B, "ipfix.spool_rate"               },
 	{ 't',":" , &opt_t, "template.used_template"         },
+	{ 'w',":" , &opt_w, "flow.cache_size"                },
+	{ 'j',":" , &opt_j, "flow.active_timeout"            },
+	{ 'z',":" , &opt_z, "flow.idle_timeout"              },
 	{ 'd',":" , &opt_d, "geotags.probe_name"             },
 	{ 'D',":" , &opt_D, "geotags.location_name"          },
 	{ 'l',":" , &opt_l, "geotags.latitude"               },
@@ -1371,8 +1991,8 @@ void parse_cmdline(int argc, char **argv) {
          /* ignore config file parameter in this second pass over args */
          break;
       case 'C':
-         /* collector port */
-         strcpy(options->collectorIP, optarg);
+         /* collector address */
+         opt_C(optarg, options);
          break;
       case 'e': /* export flush count */
          options->export_packet_count = atoi(optarg);
@@ -1468,10 +2088,10 @@ void parse_cmdline(int argc, char **argv) {
           parseSelFunction(optarg, options);
           break;
        case 'F':
-          options->hash_function = parseFunction(optarg);
+          options->hash_function.function = parseFunction(optarg);
           break;
        case 'p':
-          options->pktid_function = parseFunction(optarg);
+          options->pktid_function.function = parseFunction(optarg);
           options->hashAsPacketID = 0;
           break;
        case 'P':
@@ -1568,13 +2188,45 @@ void set_defaults_options(options_t *options) {
 	options->bpf                 = NULL;
 	options->templateID          = MINT_ID;
 	options->collectorPort       = 4739;
-	strcpy(options->collectorIP, "localhost");
+	options->number_collectors   = 0; // localhost if none is given
+	options->distribution        = DISTRIBUTE_ALL;
+	options->collectorProto      = IPFIX_PROTO_TCP;
+	options->path_mtu            = 1500;
+	options->template_refresh_interval = 60.0;
+	options->spool_file          = NULL;
+	options->spool_size          = 64*1024*1024;
+	options->spool_rate          = 1000*1024;
+	options->decapsulation       = TUNNEL_NONE;
+	options->fragment_policy     = FRAGMENTS_NONE;
+	options->fragment_table_size = FRAGMENT_TABLE_SIZE;
+	options->adaptive_min_ratio  = 0;
+	options->adaptive_max_ratio  = 0;
+	options->adaptive_interval   = ADAPTIVE_INTERVAL;
+	options->adaptive_cpu_limit  = ADAPTIVE_CPU_LIMIT;
+	options->selector            = SELECTOR_HASH;
+	options->selector_interval   = 0;
+	options->selector_period     = 0;
+	options->flow_cache_size     = 65536;
+	options->flow_active_timeout = 120.0;
+	options->flow_idle_timeout   = 15.0;
 	options->observationDomainID = 0;
-	options->hash_function       = calcHashValue_BOB;
+	options->hash_function.function  = calcHashValue_BOB;
+	options->hash_function.seed      = HASH_SEED_DEFAULT;
+	options->hash_batch              = 0;
+	options->pktid_function.function = calcHashValue_BOB;
+	options->pktid_function.seed     = HASH_SEED_DEFAULT;
 	options->selection_function  = copyFields_U_TCP_and_Net;
-	options->sel_range_min       = 0x19999999; // (2^32 / 10)
-	options->sel_range_max       = 0x33333333; // (2^32 / 5)
+	options->sel_range_min       = SEL_RANGE_MIN_DEFAULT;
+	options->sel_range_max       = SEL_RANGE_MAX_DEFAULT;
+	selection_clear( &options->selection );
 	options->snapLength          = 80;
+	options->replay_mode         = REPLAY_TIMER;
+	options->replay_speed        = 1.0;
+	options->tpacket_ring_size     = TPACKET_RING_SIZE;
+	options->tpacket_block_size    = TPACKET_BLOCK_SIZE;
+	options->tpacket_block_timeout = TPACKET_BLOCK_TIMEOUT;
+	options->workers               = 1;
+	options->fanout_mode           = FANOUT_HASH;
 
 	options->s_probe_name     = NULL; // will be set to host name if not given by cmd line
 	options->s_location_name  = "unknown";
@@ -1607,8 +2259,29 @@ void set_defaults_device(device_dev_t* dev) {
    dev->hash_buffer.size = g_options.snapLength;
    dev->hash_buffer.ptr  = calloc( g_options.snapLength, sizeof(uint8_t) );
    dev->hash_buffer.len  = 0;
+   dev->hash_buffer.count = 0;
 
    dev->template_id      = -1;
+   dev->ip_handler       = handle_ip_packet;
+   dev->ip_single_handler = handle_ip_packet;
+   dev->burst            = NULL;
+   memset( &dev->path, 0, sizeof(dev->path) );
+   dev->ring             = export_ring_new();
+   dev->workers          = NULL;
+   dev->fragments        = NULL;
+   dev->fragments_failed = 0;
+
+   // follows the global selection; see selection_publish_global()
+   dev->sel_range_min    = g_options.sel_range_min;
+   dev->sel_range_max    = g_options.sel_range_max;
+   dev->sel_local        = 0;
+   selection_clear( &dev->sel_sets[0] );
+   selection_clear( &dev->sel_sets[1] );
+   dev->selection        = &dev->sel_sets[0];
+   dev->sel_epoch        = 0;
+
+   dev->selected_total   = 0;
+   selector_init_device( dev );
 }
 
 
@@ -34,6 +34,9 @@
 
 
 // system header files
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // recvmmsg()
+#endif
 #include <stddef.h> // size_t
 #include <stdlib.h>
 #include <string.h>
@@ -48,6 +51,7 @@
 #include <sys/un.h>
 #include <sys/ioctl.h>
 #include <sys/times.h>
+#include <sys/time.h>   // gettimeofday
 
 #include <netinet/in.h>
 #include <netinet/in.h>
@@ -68,6 +72,60 @@
 #include "logger.h"
 
 
+// ----------------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+
+/**
+ * preallocated receive buffers for batched socket reads
+ */
+struct socket_batch_s {
+   int              fd;
+   int              flags;      // recvmmsg() flags
+   bool             stream;     // a zero length read means shutdown
+   uint32_t         snaplen;
+   size_t           control_size;
+   uint8_t*         buffer;     // SOCKET_BATCH_SIZE * snaplen
+   uint8_t*         control;    // SOCKET_BATCH_SIZE * control_size
+   struct iovec     iov[SOCKET_BATCH_SIZE];
+   struct mmsghdr   msgs[SOCKET_BATCH_SIZE];
+};
+
+static struct socket_batch_s* create_batch( int fd, bool stream, uint32_t snaplen ) {
+   struct socket_batch_s* b = NULL;
+   int i;
+
+   b = (struct socket_batch_s*) calloc(1, sizeof(struct socket_batch_s));
+   b->fd           = fd;
+   b->stream       = stream;
+   // report the original datagram length even if it is truncated
+   b->flags        = stream ? 0 : MSG_TRUNC;
+   b->snaplen      = snaplen;
+   b->control_size = CMSG_SPACE(sizeof(struct timespec));
+   b->buffer       = (uint8_t*) malloc(SOCKET_BATCH_SIZE * snaplen);
+   b->control      = (uint8_t*) malloc(SOCKET_BATCH_SIZE * b->control_size);
+
+   for (i = 0; i < SOCKET_BATCH_SIZE; ++i) {
+      b->iov[i].iov_base = b->buffer + i * snaplen;
+      b->iov[i].iov_len  = snaplen;
+      b->msgs[i].msg_hdr.msg_iov        = &b->iov[i];
+      b->msgs[i].msg_hdr.msg_iovlen     = 1;
+      b->msgs[i].msg_hdr.msg_control    = b->control + i * b->control_size;
+      b->msgs[i].msg_hdr.msg_controllen = b->control_size;
+   }
+
+   if (!stream) {
+      int on = 1;
+      if (0 > setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on))) {
+         LOGGER_warn("SO_TIMESTAMPNS not available: %s", strerror(errno));
+      }
+   }
+
+   return b;
+}
+
+// ----------------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+
 #ifndef PFRING
 
 // ----------------------------------------------------------------------------
@@ -252,7 +310,7 @@ void open_socket_inet(device_dev_t* if_device, options_t *options) {
       }
 
       if_device->device_handle.socket = socket;
-      if_device->dh.fd = socket;
+      if_device->dh.socket = create_batch(socket, false, options->snapLength);
       if_device->dispatch = socket_dispatch_inet;
 
       // send 'hello' TODO: for test only
@@ -313,7 +371,7 @@ void open_socket_unix(device_dev_t* if_device, options_t *options) {
    }
 
    if_device->device_handle.socket = s;
-   if_device->dh.fd = s;
+   if_device->dh.socket = create_batch(s, true, options->snapLength);
    if_device->dispatch = socket_dispatch_unix;
 
    // TODO: some rework is still needed
@@ -339,25 +397,35 @@ void open_socket_unix(device_dev_t* if_device, options_t *options) {
 // ----------------------------------------------------------------------------
 // ----------------------------------------------------------------------------
 
-int socket_dispatch_inet(dh_t dh, int max_packets, pcap_handler packet_handler, u_char* user_args)
+/**
+ * receive up to SOCKET_BATCH_SIZE datagrams with a single recvmmsg() call;
+ * the original length is returned via MSG_TRUNC (datagram sockets) and the
+ * kernel receive timestamp via SO_TIMESTAMPNS. The remaining messages of the
+ * last batch might exceed max_packets.
+ */
+static int socket_dispatch_batch(struct socket_batch_s* b, int max_packets
+      , pcap_handler packet_handler, u_char* user_args)
 {
-   LOGGER_trace("Enter");
-
-   int      socket = dh.fd;
-   int      i;
+   device_dev_t* device = (device_dev_t*) user_args;
    int32_t  nPackets = 0;
-   uint8_t  buffer[g_options.snapLength];
-
+   int      i;
+   int      n;
    struct pcap_pkthdr hdr;
+   struct timeval     now = {0, 0};
 
-   for ( i = 0
-         ; i < max_packets || 0 == max_packets || -1 == max_packets
-         ; ++i)
-   {
-      // peek socket buffer to get hole message length
-      switch(hdr.len = recv(socket, NULL, 0, MSG_PEEK|MSG_TRUNC)) {
+   LOGGER_trace("Enter");
+
+   do {
+      // the kernel updates the message headers; reset them
+      for (i = 0; i < SOCKET_BATCH_SIZE; ++i) {
+         b->msgs[i].msg_hdr.msg_controllen = b->control_size;
+         b->msgs[i].msg_hdr.msg_flags      = 0;
+      }
+
+      n = recvmmsg(b->fd, b->msgs, SOCKET_BATCH_SIZE, b->flags, NULL);
+      switch (n) {
          case 0: {
-                    perror("socket: recv(); connection shutdown");
+                    perror("socket: recvmmsg(); connection shutdown");
                     return -1;
                  }
 
@@ -366,7 +434,7 @@ int socket_dispatch_inet(dh_t dh, int max_packets, pcap_handler packet_handler,
                         return nPackets;
                      }
                      else {
-                        perror("socket: recv()");
+                        perror("socket: recvmmsg()");
                         return -1;
                      }
                   }
@@ -376,110 +444,67 @@ int socket_dispatch_inet(dh_t dh, int max_packets, pcap_handler packet_handler,
          // further processing
       }
 
-      // recv is blocking; until connection is closed
-      // TODO: check handling
-      // recv is enough here, because we are just interested of the packet
-      // we will not send anything back
-      switch(hdr.caplen = recv(socket, buffer, sizeof(buffer), 0)) {
-         case 0:
-         {
-            perror("socket: recv(); connection shutdown");
+      // fallback if the socket does not provide timestamps (AF_UNIX)
+      now.tv_sec = 0;
+
+      // the messages are not received into again until the burst is hashed
+      packet_burst_begin(device);
+      for (i = 0; i < n; ++i) {
+         struct msghdr*  msg = &b->msgs[i].msg_hdr;
+         struct cmsghdr* cmsg;
+
+         hdr.len    = b->msgs[i].msg_len;
+         hdr.caplen = (hdr.len < b->snaplen) ? hdr.len : b->snaplen;
+
+         if (0 == hdr.len && b->stream) {
+            packet_burst_end(device);
+            perror("socket: recvmmsg(); connection shutdown");
             return -1;
          }
 
-         case -1:
-         {
-            if (EAGAIN == errno || EWOULDBLOCK == errno) {
-                return nPackets;
+         // get timestamp
+         hdr.ts.tv_sec = 0;
+         for (cmsg = CMSG_FIRSTHDR(msg); NULL != cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+            if (SOL_SOCKET == cmsg->cmsg_level && SCM_TIMESTAMPNS == cmsg->cmsg_type) {
+               struct timespec* ts = (struct timespec*) CMSG_DATA(cmsg);
+               hdr.ts.tv_sec  = ts->tv_sec;
+               hdr.ts.tv_usec = ts->tv_nsec / 1000;
+               break;
             }
-            else {
-               perror("socket: recv()");
-               return -1;
+         }
+         if (0 == hdr.ts.tv_sec) {
+            if (0 == now.tv_sec) {
+               gettimeofday(&now, NULL);
             }
+            hdr.ts = now;
          }
 
-         //default:
-         // everything is all right
-         // futher processing
-      }
-
+         LOGGER_trace("bytes received: (%d)", hdr.len);
+         LOGGER_trace("bytes captured: (%d)", hdr.caplen);
 
-      LOGGER_info("bytes received: (%d)", hdr.len);
-      LOGGER_info("bytes captured: (%d)", hdr.caplen);
-      if( LOGGER_LEVEL_DEBUG <= logger_get_level() ){
-         int i = 0;
-         for( i=0; i < hdr.caplen; ++i ) {
-            LOGGER_debug( "%02x ", buffer[i]);
-         }
+         // be aware of the type casts need
+         packet_handler(user_args, &hdr, msg->msg_iov->iov_base);
       }
-
-      // get timestamp
-      gettimeofday(&hdr.ts, NULL);
-
-      // print received data
-      // be aware of the type casts need
-      packet_handler(user_args, &hdr, buffer);
-      ++nPackets;
-   }
+      packet_burst_end(device);
+      nPackets += n;
+   } while (SOCKET_BATCH_SIZE == n && (nPackets < max_packets || 0 >= max_packets));
 
    LOGGER_trace("Return");
    return nPackets;
 }
 
+int socket_dispatch_inet(dh_t dh, int max_packets, pcap_handler packet_handler, u_char* user_args)
+{
+   return socket_dispatch_batch(dh.socket, max_packets, packet_handler, user_args);
+}
+
 // ----------------------------------------------------------------------------
 // ----------------------------------------------------------------------------
 
 #ifndef PFRING
 int socket_dispatch_unix(dh_t dh, int max_packets, pcap_handler packet_handler, u_char* user_args)
 {
-   LOGGER_trace("Enter");
-
-   int      socket = dh.fd;
-   int32_t  i;
-   int32_t  nPackets = 0;
-   uint8_t  buffer[g_options.snapLength];
-
-   struct pcap_pkthdr hdr;
-
-   for ( i = 0
-         ; i < max_packets || 0 == max_packets || -1 == max_packets
-         ; ++i)
-   {
-      // recv is blocking; until connection is closed
-      switch(hdr.caplen = recv(socket, buffer, sizeof(buffer), 0)) {
-         case 0: {
-                    perror("socket: recv(); connection shutdown");
-                    return -1;
-                 }
-
-         case -1: {
-                     if (EAGAIN == errno || EWOULDBLOCK == errno) {
-                        return nPackets;
-                     }
-                     else {
-                        perror("socket: recv()");
-                        return -1;
-                     }
-                  }
-
-         //default:
-         // everything is all right
-         // futher processing
-      } // switch(recv())
-
-      // get timestamp
-      gettimeofday(&hdr.ts, NULL);
-
-      hdr.len = hdr.caplen;
-
-      // print received data
-      // be aware of the type casts need
-      packet_handler(user_args, &hdr, buffer);
-      ++nPackets;
-   }
-
-   LOGGER_trace("Return");
-   return nPackets;
+   return socket_dispatch_batch(dh.socket, max_packets, packet_handler, user_args);
 }
 #endif
 
@@ -0,0 +1,276 @@
+/*
+ * impd4e - a small network probe which allows to monitor and sample datagrams
+ * from the network based on hash-based packet selection.
+ *
+ * Copyright (c) 2011
+ *
+ * Fraunhofer FOKUS
+ * www.fokus.fraunhofer.de
+ *
+ * in cooperation with
+ *
+ * Technical University Berlin
+ * www.av.tu-berlin.de
+ *
+ * authors:
+ * Ramon Masek <ramon.masek@fokus.fraunhofer.de>
+ * Christian Henke <c.henke@tu-berlin.de>
+ * Carsten Schmoll <carsten.schmoll@fokus.fraunhofer.de>
+ *
+ * For questions/comments contact packettracking@fokus.fraunhofer.de
+ *
+ * This program is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software Foundation;
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * disk spool for ipfix messages
+ *
+ * Messages which could not be sent to the collector are appended to a
+ * size bounded ring in a memory mapped file. If the ring is full, the
+ * oldest messages are overwritten. The exporter thread replays the ring
+ * in order once the collector is reachable again.
+ *
+ * The ring survives a restart of the probe: the read and write offsets
+ * are kept in the header page of the file. Each message is stored behind
+ * a small entry header (length, collector) and may wrap at the end of the
+ * data area.
+ *
+ * All functions are called by the exporter thread only.
+ */
+
+#include <stdlib.h>  // NULL
+#include <string.h>  // memcpy, strerror
+#include <errno.h>   // errno
+#include <fcntl.h>   // open
+#include <unistd.h>  // ftruncate, close
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Custom logger
+#include "logger.h"
+
+#include "ipfix_encoder.h"  // IPFIX_MESSAGE_MAX
+#include "spool.h"
+
+// -----------------------------------------------------------------------------
+// Structures, Typedefs
+// -----------------------------------------------------------------------------
+
+#define SPOOL_MAGIC   0x69706673 /* "ipfs" */
+#define SPOOL_VERSION 2
+
+/**
+ * header page of the spool file; the offsets only grow, the position in
+ * the data area is the offset modulo size
+ */
+typedef struct spool_header {
+   uint32_t magic;
+   uint32_t version;
+   uint64_t size;      // data area in bytes
+   uint64_t head;      // write offset
+   uint64_t tail;      // read offset
+   uint64_t messages;  // messages in the spool
+   uint64_t dropped;   // messages overwritten because the spool was full
+} spool_header_t;
+
+/**
+ * entry header in front of each message
+ */
+typedef struct spool_entry {
+   uint16_t length;    // message length
+   uint8_t  collector; // index of the collector the message is for
+   uint8_t  reserved;
+} spool_entry_t;
+
+// -----------------------------------------------------------------------------
+// Global Variables
+// -----------------------------------------------------------------------------
+
+static spool_header_t* header = NULL;
+static uint8_t*        data   = NULL;
+static size_t          mapped = 0;
+
+// copy of the oldest message; it may wrap at the end of the data area
+static uint8_t         message[IPFIX_MESSAGE_MAX];
+static spool_entry_t   message_entry = { 0, 0, 0 };
+
+// -----------------------------------------------------------------------------
+// Functions
+// -----------------------------------------------------------------------------
+
+static void ring_write( uint64_t offset, const uint8_t* src, size_t len ) {
+   size_t pos   = offset % header->size;
+   size_t first = header->size - pos;
+
+   if( len <= first ) {
+      memcpy( data + pos, src, len );
+   }
+   else {
+      memcpy( data + pos, src, first );
+      memcpy( data, src + first, len - first );
+   }
+}
+
+static void ring_read( uint64_t offset, uint8_t* dst, size_t len ) {
+   size_t pos   = offset % header->size;
+   size_t first = header->size - pos;
+
+   if( len <= first ) {
+      memcpy( dst, data + pos, len );
+   }
+   else {
+      memcpy( dst, data + pos, first );
+      memcpy( dst + first, data, len - first );
+   }
+}
+
+static spool_entry_t ring_entry( uint64_t offset ) {
+   spool_entry_t e;
+   ring_read( offset, (uint8_t*) &e, sizeof(e) );
+   return e;
+}
+
+// -----------------------------------------------------------------------------
+
+int spool_open( const char* path, uint64_t size ) {
+   struct stat st;
+   int fd;
+
+   if( IPFIX_MESSAGE_MAX + sizeof(spool_entry_t) > size ) {
+      LOGGER_error( "spool size too small: %llu", (unsigned long long) size );
+      return -1;
+   }
+
+   fd = open( path, O_RDWR | O_CREAT, 0644 );
+   if( 0 > fd ) {
+      LOGGER_error( "cannot open spool file '%s': %s", path, strerror(errno) );
+      return -1;
+   }
+   if( 0 > fstat( fd, &st ) ) {
+      LOGGER_error( "cannot stat spool file '%s': %s", path, strerror(errno) );
+      close( fd );
+      return -1;
+   }
+
+   mapped = SPOOL_HEADER_SIZE + size;
+   if( mapped != st.st_size && 0 > ftruncate( fd, mapped ) ) {
+      LOGGER_error( "cannot resize spool file '%s': %s", path, strerror(errno) );
+      close( fd );
+      return -1;
+   }
+
+   header = mmap( NULL, mapped, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+   close( fd );
+   if( MAP_FAILED == header ) {
+      LOGGER_error( "cannot map spool file '%s': %s", path, strerror(errno) );
+      header = NULL;
+      return -1;
+   }
+   data = (uint8_t*) header + SPOOL_HEADER_SIZE;
+
+   if( SPOOL_MAGIC   != header->magic
+    || SPOOL_VERSION != header->version
+    || size          != header->size
+    || header->head - header->tail > size ) {
+      memset( header, 0, sizeof(spool_header_t) );
+      header->magic   = SPOOL_MAGIC;
+      header->version = SPOOL_VERSION;
+      header->size    = size;
+   }
+   else if( 0 < header->messages ) {
+      LOGGER_info( "spool '%s': %llu messages to replay", path
+            , (unsigned long long) header->messages );
+   }
+
+   LOGGER_info( "spool '%s': %llu bytes", path, (unsigned long long) size );
+   return 0;
+}
+
+void spool_close() {
+   if( NULL == header ) {
+      return;
+   }
+   if( 0 < header->dropped ) {
+      LOGGER_warn( "spool: %llu messages overwritten"
+            , (unsigned long long) header->dropped );
+   }
+   msync( header, mapped, MS_SYNC );
+   munmap( header, mapped );
+   header = NULL;
+   data   = NULL;
+}
+
+int spool_enabled() {
+   return NULL != header;
+}
+
+uint64_t spool_pending() {
+   return (NULL != header) ? header->messages : 0;
+}
+
+// -----------------------------------------------------------------------------
+
+int spool_append( uint8_t collector, const uint8_t* msg, uint16_t len ) {
+   spool_entry_t e = { len, collector, 0 };
+   uint64_t needed = sizeof(e) + len;
+
+   if( NULL == header ) {
+      return -1;
+   }
+
+   // make room; drop the oldest messages
+   while( header->size - (header->head - header->tail) < needed ) {
+      header->tail += sizeof(spool_entry_t) + ring_entry( header->tail ).length;
+      header->messages--;
+      header->dropped++;
+      message_entry.length = 0;
+   }
+
+   ring_write( header->head, (const uint8_t*) &e, sizeof(e) );
+   ring_write( header->head + sizeof(e), msg, len );
+   header->head += needed;
+   header->messages++;
+
+   return 0;
+}
+
+const uint8_t* spool_peek( uint8_t* collector, uint16_t* len ) {
+   if( NULL == header || 0 == header->messages ) {
+      return NULL;
+   }
+
+   if( 0 == message_entry.length ) {
+      message_entry = ring_entry( header->tail );
+      ring_read( header->tail + sizeof(spool_entry_t), message
+            , message_entry.length );
+   }
+   *collector = message_entry.collector;
+   *len       = message_entry.length;
+   return message;
+}
+
+void spool_release() {
+   if( NULL == header || 0 == header->messages ) {
+      return;
+   }
+   header->tail += sizeof(spool_entry_t) + ring_entry( header->tail ).length;
+   header->messages--;
+   message_entry.length = 0;
+
+   // keep the offsets small once the spool is drained
+   if( 0 == header->messages ) {
+      header->head = 0;
+      header->tail = 0;
+   }
+}
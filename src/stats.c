@@ -48,6 +48,7 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/time.h>
+#include <time.h>
 
 /* from /usr/src/linux/fs/proc/array.c.  */
 #define PROC_PID_STAT_FORMAT "%d %s %c %d %d %d %d %d %u %lu \
@@ -353,3 +354,37 @@ int get_probe_stats(struct probe_stat *stat ){
 
 	return 0;
 }
+
+/**
+ * Get CPU usage of the process since the previous call, in percent of one
+ * CPU (user and system); independent of get_probe_stats()
+ *
+ * return 0 when successful, -1 otherwise (also on the first call)
+ */
+int get_process_cpu(float *percent) {
+	static struct timespec    time_prev;
+	static unsigned long long ticks_prev = 0;
+	static long               hz = 0;
+
+	struct proc_pid_stat process;
+	struct timespec      now;
+	unsigned long long   ticks;
+	double               elapsed;
+	int                  first = (0 == hz);
+
+	hz = hz? hz:sysconf(_SC_CLK_TCK);
+
+	if( -1 == get_proc_pid_stat(&process) ) return -1;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ticks = process.utime + process.stime;
+
+	elapsed = (now.tv_sec - time_prev.tv_sec)
+			+ (now.tv_nsec - time_prev.tv_nsec) / 1e9;
+	*percent = (first || elapsed <= 0)? 0
+			: 100.0 * (ticks - ticks_prev) / hz / elapsed;
+
+	time_prev  = now;
+	ticks_prev = ticks;
+
+	return (first || elapsed <= 0)? -1 : 0;
+}
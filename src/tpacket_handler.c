@@ -0,0 +1,325 @@
+/*
+ * impd4e - a small network probe which allows to monitor and sample datagrams
+ * from the network based on hash-based packet selection.
+ *
+ * Copyright (c) 2011
+ *
+ * Fraunhofer FOKUS
+ * www.fokus.fraunhofer.de
+ *
+ * in cooperation with
+ *
+ * Technical University Berlin
+ * www.av.tu-berlin.de
+ *
+ * authors:
+ * Ramon Masek <ramon.masek@fokus.fraunhofer.de>
+ * Christian Henke <c.henke@tu-berlin.de>
+ * Carsten Schmoll <carsten.schmoll@fokus.fraunhofer.de>
+ *
+ * For questions/comments contact packettracking@fokus.fraunhofer.de
+ *
+ * This program is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software Foundation;
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// system header files
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <arpa/inet.h>  // htons
+
+#ifdef __linux__
+#include <net/if.h>     // if_nametoindex
+#include <net/ethernet.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
+#endif
+
+// local header files
+#include "tpacket_handler.h"
+
+#include "ev_handler.h"
+#include "packet_handler.h"
+
+#include "settings.h"
+#include "helper.h"
+
+// Custom logger
+#include "logger.h"
+
+
+#ifdef HAVE_TPACKET3
+
+// ----------------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+
+/**
+ * memory mapped TPACKET_V3 receive ring
+ */
+struct tpacket_ring_s {
+   int             fd;
+   uint8_t*        map;         // mmap'ed ring buffer
+   uint32_t        block_size;
+   uint32_t        block_nr;
+   uint32_t        block;       // next block to be read
+   struct pcap_stat stats;      // accumulated kernel statistics
+};
+
+// ----------------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+
+/**
+ * compile the filter expression with libpcap and attach it to the socket;
+ * the filter also truncates the packets to the snap length
+ */
+int tpacket_set_filter(device_dev_t* if_device, const char* bpf) {
+   struct bpf_program fp;
+   struct sock_fprog  prog;
+   int    rv = 0;
+
+   pcap_t* pcap = pcap_open_dead(DLT_EN10MB, g_options.snapLength);
+   if (NULL == pcap) {
+      LOGGER_fatal( "pcap_open_dead failed");
+      return -1;
+   }
+
+   if (-1 == pcap_compile(pcap, &fp, (NULL == bpf) ? "" : bpf, 1, 0)) {
+      LOGGER_fatal( "Couldn't parse filter %s: %s", bpf, pcap_geterr(pcap));
+      pcap_close(pcap);
+      return -1;
+   }
+
+   prog.len    = fp.bf_len;
+   prog.filter = (struct sock_filter*) fp.bf_insns;
+   if (0 > setsockopt(if_device->dh.tpacket->fd, SOL_SOCKET, SO_ATTACH_FILTER
+         , &prog, sizeof(prog))) {
+      LOGGER_fatal( "Couldn't install filter %s: %s", bpf, strerror(errno));
+      rv = -1;
+   }
+
+   pcap_freecode(&fp);
+   pcap_close(pcap);
+   return rv;
+}
+
+// ----------------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+
+/**
+ * kernel statistics; the kernel resets its counter on each read
+ * so they are accumulated to match pcap_stats() semantics
+ */
+int tpacket_stats(device_dev_t* if_device, struct pcap_stat* ps) {
+   struct tpacket_ring_s*    ring = if_device->dh.tpacket;
+   struct tpacket_stats_v3   st;
+   socklen_t                 len = sizeof(st);
+
+   if (0 > getsockopt(ring->fd, SOL_PACKET, PACKET_STATISTICS, &st, &len)) {
+      LOGGER_error("Error DeviceNo   %s: %s", if_device->device_name, strerror(errno));
+      return -1;
+   }
+   // tp_packets includes the dropped packets
+   ring->stats.ps_recv += st.tp_packets;
+   ring->stats.ps_drop += st.tp_drops;
+
+   *ps = ring->stats;
+   return 0;
+}
+
+// ----------------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+
+int tpacket_fileno(device_dev_t* if_device) {
+   return if_device->dh.tpacket->fd;
+}
+
+// ----------------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+
+/**
+ * setup the ring; the caller is responsible to register
+ * the file descriptor at an event loop
+ */
+void open_tpacket_capture(device_dev_t* if_device, options_t *options) {
+   struct tpacket_ring_s* ring = NULL;
+   struct tpacket_req3    req;
+   struct sockaddr_ll     addr;
+   int    version = TPACKET_V3;
+   int    fd = -1;
+
+   // no protocol yet: nothing is received before bind() to the interface
+   fd = socket(AF_PACKET, SOCK_RAW, 0);
+   if (0 > fd) {
+      perror("socket: create");
+      exit(1);
+   }
+
+   if (0 > setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version))) {
+      perror("socket: PACKET_VERSION (TPACKET_V3)");
+      exit(1);
+   }
+
+   // the ring is organized in blocks which are retired by the kernel
+   // either if they are full or if the block timeout expires
+   memset(&req, 0, sizeof(req));
+   req.tp_block_size       = options->tpacket_block_size;
+   req.tp_block_nr         = options->tpacket_ring_size / options->tpacket_block_size;
+   req.tp_frame_size       = TPACKET_ALIGNMENT << 7; // ignored by TPACKET_V3 except for sanity checks
+   req.tp_frame_nr         = (req.tp_block_size * req.tp_block_nr) / req.tp_frame_size;
+   req.tp_retire_blk_tov   = options->tpacket_block_timeout;
+   req.tp_feature_req_word = 0;
+
+   if (0 > setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req))) {
+      perror("socket: PACKET_RX_RING");
+      exit(1);
+   }
+
+   ring = (struct tpacket_ring_s*) calloc(1, sizeof(struct tpacket_ring_s));
+   ring->fd         = fd;
+   ring->block_size = req.tp_block_size;
+   ring->block_nr   = req.tp_block_nr;
+   ring->map = mmap(NULL, ring->block_size * ring->block_nr
+         , PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, fd, 0);
+   if (MAP_FAILED == ring->map) {
+      perror("socket: mmap");
+      exit(1);
+   }
+
+   if_device->device_handle.tpacket = ring;
+   if_device->dh.tpacket = ring;
+
+   // attach the filter before bind(); no packet reaches the ring unfiltered.
+   // It also truncates the packets to the snap length, so it is mandatory
+   if (0 > tpacket_set_filter(if_device, options->bpf)) {
+      LOGGER_fatal( "cannot open tpacket capture: %s", if_device->device_name);
+      exit(1);
+   }
+
+   memset(&addr, 0, sizeof(addr));
+   addr.sll_family   = AF_PACKET;
+   addr.sll_protocol = htons(ETH_P_ALL);
+   addr.sll_ifindex  = if_nametoindex(if_device->device_name);
+   if (0 == addr.sll_ifindex) {
+      LOGGER_fatal( "unknown interface: %s", if_device->device_name);
+      exit(1);
+   }
+   if (0 > bind(fd, (struct sockaddr*) &addr, sizeof(addr))) {
+      perror("socket: bind");
+      exit(1);
+   }
+
+   LOGGER_info("TPACKET_V3 ring: %u blocks of %u bytes; block timeout %u ms"
+         , ring->block_nr, ring->block_size, req.tp_retire_blk_tov);
+
+   if_device->dispatch = tpacket_dispatch;
+
+   /* I want IP address attached to device */
+   if_device->IPv4address = getIPv4AddressFromDevice(if_device->device_name);
+
+   // the packet socket delivers the link layer header; only ethernet
+   // is supported
+   if_device->link_type  = DLT_EN10MB;
+   if_device->pkt_offset = 14;
+}
+
+void open_tpacket(device_dev_t* if_device, options_t *options) {
+
+   open_tpacket_capture(if_device, options);
+   int fd = tpacket_fileno(if_device);
+
+   // register read handling to ev_handler
+   LOGGER_debug("Register io handling for interface: %s", if_device->device_name);
+
+   /* storing a reference of packet device to
+    be passed via watcher on a packet event so
+    we know which device to read the packet from */
+   LOGGER_info("register event io: read tpacket interface (%s)", if_device->device_name);
+   ev_watcher* watcher = event_register_io_r(EV_DEFAULT_ packet_watcher_cb, fd);
+   watcher->data = (device_dev_t *) if_device;
+
+   return;
+}
+
+// ----------------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+
+/**
+ * walk all retired blocks of the ring; the packets are handed over to the
+ * packet handler without copying. A block is returned to the kernel after
+ * all its packets are processed; max_packets might therefore be exceeded
+ * by the remaining packets of the last block.
+ */
+int tpacket_dispatch(dh_t dh, int max_packets, pcap_handler packet_handler, u_char* user_args)
+{
+   struct tpacket_ring_s* ring = dh.tpacket;
+   device_dev_t* device = (device_dev_t*) user_args;
+   int32_t  nPackets = 0;
+
+   struct pcap_pkthdr hdr;
+
+   LOGGER_trace("Enter");
+
+   while (nPackets < max_packets || 0 >= max_packets) {
+      struct tpacket_block_desc* bd = (struct tpacket_block_desc*)
+            (ring->map + ring->block * ring->block_size);
+
+      if (0 == (bd->hdr.bh1.block_status & TP_STATUS_USER)) {
+         // block still owned by the kernel
+         break;
+      }
+      __sync_synchronize();
+
+      uint32_t i;
+      uint32_t num_pkts = bd->hdr.bh1.num_pkts;
+      struct tpacket3_hdr* ppd = (struct tpacket3_hdr*)
+            ((uint8_t*) bd + bd->hdr.bh1.offset_to_first_pkt);
+
+      // the block stays ours until the burst is hashed
+      packet_burst_begin(device);
+      for (i = 0; i < num_pkts; ++i) {
+         hdr.ts.tv_sec  = ppd->tp_sec;
+         hdr.ts.tv_usec = ppd->tp_nsec / 1000;
+         hdr.caplen     = ppd->tp_snaplen;
+         hdr.len        = ppd->tp_len;
+
+         // the kernel strips the VLAN tag if the NIC offloads it
+         #ifdef TP_STATUS_VLAN_VALID
+         device->rx_vlan_id = (ppd->tp_status & TP_STATUS_VLAN_VALID)
+               ? (ppd->hv1.tp_vlan_tci & 0x0fff) : 0;
+         #endif
+
+         packet_handler(user_args, &hdr, (uint8_t*) ppd + ppd->tp_mac);
+
+         ppd = (struct tpacket3_hdr*) ((uint8_t*) ppd + ppd->tp_next_offset);
+      }
+      packet_burst_end(device);
+      nPackets += num_pkts;
+
+      // return block to the kernel
+      __sync_synchronize();
+      bd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+      ring->block = (ring->block + 1) % ring->block_nr;
+   }
+
+   LOGGER_trace("Return");
+   return nPackets;
+}
+
+#endif // HAVE_TPACKET3
+
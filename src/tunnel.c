@@ -0,0 +1,282 @@
+/*
+ * impd4e - a small network probe which allows to monitor and sample datagrams
+ * from the network based on hash-based packet selection.
+ *
+ * Copyright (c) 2011
+ *
+ * Fraunhofer FOKUS
+ * www.fokus.fraunhofer.de
+ *
+ * in cooperation with
+ *
+ * Technical University Berlin
+ * www.av.tu-berlin.de
+ *
+ * authors:
+ * Ramon Masek <ramon.masek@fokus.fraunhofer.de>
+ * Christian Henke <c.henke@tu-berlin.de>
+ * Carsten Schmoll <carsten.schmoll@fokus.fraunhofer.de>
+ *
+ * For questions/comments contact packettracking@fokus.fraunhofer.de
+ *
+ * This program is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software Foundation;
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * tunnel decapsulation
+ *
+ * Locates the inner ip header of IP-in-IP (IPv4 or IPv6 payload), GRE
+ * (RFC 2784/2890, ip or transparent ethernet payload), VXLAN (RFC 7348)
+ * and GTP-U (3GPP TS 29.281, G-PDU) packets, so the selection and the
+ * export work on the inner packet. One level of encapsulation is removed.
+ *
+ * Fragments of the outer packet are left alone; only the first one
+ * carries the tunnel header. IPv6 outer headers with extension headers
+ * are not decapsulated either.
+ */
+
+#include <string.h>    // strchr
+#include <strings.h>   // strncasecmp
+#include <arpa/inet.h> // ntohs
+
+#include "tunnel.h"
+
+// -----------------------------------------------------------------------------
+// Type definitions
+// -----------------------------------------------------------------------------
+
+#define ETHERTYPE_IP      0x0800
+#define ETHERTYPE_IPV6    0x86DD
+#define ETHERTYPE_TEB     0x6558 // transparent ethernet bridging (GRE)
+#define ETHERTYPE_VLAN    0x8100
+#define ETHERTYPE_QINQ    0x88A8
+
+#define GRE_CHECKSUM      0x80
+#define GRE_KEY           0x20
+#define GRE_SEQUENCE      0x10
+
+#define GTP_VERSION_1     0x20
+#define GTP_PT            0x10
+#define GTP_EXTENSION     0x04
+#define GTP_OPTIONAL      0x07 // E, S or PN: optional fields present
+#define GTP_GPDU          0xFF
+
+// -----------------------------------------------------------------------------
+// Functions
+// -----------------------------------------------------------------------------
+
+static inline uint16_t get_u16( const uint8_t* p ) {
+   return ((uint16_t) p[0] << 8) | p[1];
+}
+
+static inline uint32_t get_u32( const uint8_t* p ) {
+   return ((uint32_t) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+/**
+ * skip an ethernet header (and its VLAN tags) at 'offs';
+ * returns the offset of the ip payload, 0 if there is none
+ */
+static uint32_t skip_ethernet( const uint8_t* p, uint32_t len, uint32_t offs ) {
+   uint16_t type;
+   int n;
+
+   offs += 12;
+   for( n = 0; n < LINK_MAX_TAGS && offs + 2 <= len; ++n ) {
+      type = get_u16( p + offs );
+      if( ETHERTYPE_VLAN == type || ETHERTYPE_QINQ == type ) {
+         offs += 4;
+         continue;
+      }
+      return (ETHERTYPE_IP == type || ETHERTYPE_IPV6 == type) ? offs + 2 : 0;
+   }
+   return 0;
+}
+
+static uint32_t decap_gre( const uint8_t* p, uint32_t len, uint32_t offs, uint32_t* id ) {
+   uint32_t hlen = 4;
+   uint16_t type;
+
+   // version 0 only; version 1 is the enhanced GRE of PPTP
+   if( offs + 4 > len || 0 != (p[offs + 1] & 0x07) ) {
+      return 0;
+   }
+   if( p[offs] & GRE_CHECKSUM ) hlen += 4;
+   if( p[offs] & GRE_KEY ) {
+      if( offs + hlen + 4 > len ) {
+         return 0;
+      }
+      *id = get_u32( p + offs + hlen );
+      hlen += 4;
+   }
+   if( p[offs] & GRE_SEQUENCE ) hlen += 4;
+
+   type = get_u16( p + offs + 2 );
+   switch( type ) {
+   case ETHERTYPE_IP:
+   case ETHERTYPE_IPV6:
+      return offs + hlen;
+   case ETHERTYPE_TEB:
+      return skip_ethernet( p, len, offs + hlen );
+   }
+   return 0;
+}
+
+static uint32_t decap_vxlan( const uint8_t* p, uint32_t len, uint32_t offs, uint32_t* id ) {
+   // the I flag marks a valid VNI
+   if( offs + 8 > len || 0 == (p[offs] & 0x08) ) {
+      return 0;
+   }
+   *id = get_u32( p + offs + 4 ) >> 8;
+   return skip_ethernet( p, len, offs + 8 );
+}
+
+static uint32_t decap_gtpu( const uint8_t* p, uint32_t len, uint32_t offs, uint32_t* id ) {
+   uint32_t hlen = 8;
+   uint8_t  next;
+
+   if( offs + 8 > len
+         || GTP_VERSION_1 != (p[offs] & 0xE0) || 0 == (p[offs] & GTP_PT)
+         || GTP_GPDU != p[offs + 1] ) {
+      return 0;
+   }
+   *id = get_u32( p + offs + 4 );
+
+   if( p[offs] & GTP_OPTIONAL ) {
+      if( offs + 12 > len ) {
+         return 0;
+      }
+      hlen = 12;
+      // chain of extension headers; the length is in units of 4 bytes
+      next = (p[offs] & GTP_EXTENSION) ? p[offs + 11] : 0;
+      while( 0 != next ) {
+         uint32_t elen;
+         if( offs + hlen + 1 > len || 0 == (elen = p[offs + hlen] * 4)
+               || offs + hlen + elen > len ) {
+            return 0;
+         }
+         next  = p[offs + hlen + elen - 1];
+         hlen += elen;
+      }
+   }
+   return offs + hlen;
+}
+
+int tunnel_decapsulate( packet_t* packet, packet_info_t* info, uint32_t types ) {
+   const uint8_t* p   = packet->ptr;
+   uint32_t       len = packet->len;
+   uint32_t       offs, inner = 0, id = 0;
+   uint8_t        proto, type = TUNNEL_NONE;
+
+   if( 20 > len ) {
+      return 0;
+   }
+   switch( p[0] & 0xf0 ) {
+   case 0x40:
+      // not fragmented (MF, fragment offset)
+      if( get_u16( p + 6 ) & 0x3fff ) {
+         return 0;
+      }
+      offs  = (p[0] & 0x0f) << 2;
+      proto = p[9];
+      break;
+   case 0x60:
+      if( 40 > len ) {
+         return 0;
+      }
+      offs  = 40;
+      proto = p[6];
+      break;
+   default:
+      return 0;
+   }
+
+   switch( proto ) {
+   case T_IPIP:
+   case T_IPV6:
+      if( types & TUNNEL_IPIP ) {
+         type  = TUNNEL_IPIP;
+         inner = offs;
+      }
+      break;
+   case T_GRE:
+      if( types & TUNNEL_GRE ) {
+         type  = TUNNEL_GRE;
+         inner = decap_gre( p, len, offs, &id );
+      }
+      break;
+   case T_UDP:
+      if( offs + 8 > len ) {
+         return 0;
+      }
+      if( (types & TUNNEL_VXLAN) && VXLAN_PORT == get_u16( p + offs + 2 ) ) {
+         type  = TUNNEL_VXLAN;
+         inner = decap_vxlan( p, len, offs + 8, &id );
+      }
+      else if( (types & TUNNEL_GTPU) && GTPU_PORT == get_u16( p + offs + 2 ) ) {
+         type  = TUNNEL_GTPU;
+         inner = decap_gtpu( p, len, offs + 8, &id );
+      }
+      break;
+   }
+
+   // the payload has to be an ip packet
+   if( 0 == inner || inner + 20 > len
+         || (0x40 != (p[inner] & 0xf0) && 0x60 != (p[inner] & 0xf0)) ) {
+      return 0;
+   }
+
+   packet->ptr += inner;
+   packet->len -= inner;
+   info->tunnel_type = type;
+   info->tunnel_id   = id;
+   return 1;
+}
+
+// -----------------------------------------------------------------------------
+
+int tunnel_parse_types( const char* arg ) {
+   static const struct {
+      const char* name;
+      uint32_t    type;
+   } names[] = {
+        { "ipip",  TUNNEL_IPIP  }
+      , { "gre",   TUNNEL_GRE   }
+      , { "vxlan", TUNNEL_VXLAN }
+      , { "gtp",   TUNNEL_GTPU  }
+      , { "all",   TUNNEL_IPIP | TUNNEL_GRE | TUNNEL_VXLAN | TUNNEL_GTPU }
+   };
+   int types = 0;
+
+   while( '\0' != *arg ) {
+      const char* end = strchr( arg, ',' );
+      size_t n = (NULL == end) ? strlen( arg ) : (size_t) (end - arg);
+      int k, found = 0;
+
+      for( k = 0; k < sizeof(names) / sizeof(names[0]); ++k ) {
+         if( n == strlen( names[k].name ) && 0 == strncasecmp( arg, names[k].name, n ) ) {
+            types |= names[k].type;
+            found  = 1;
+         }
+      }
+      if( !found ) {
+         return -1;
+      }
+      arg += n;
+      if( ',' == *arg ) {
+         ++arg;
+      }
+   }
+   return types;
+}
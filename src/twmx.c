@@ -6,6 +6,7 @@
 
 
 #include "twmx.h"
+#include <string.h>
 
 /* Thomas Wang's 32 bit Mix Function */
 
@@ -87,3 +88,59 @@ uint32_t TWMXHash(uint8_t *data, uint32_t length, uint32_t initval)
    return key;
 }
 #endif
+
+/* incremental interface, the key is consumed in 4 byte words; partial
+ * words are kept in state->tail until the next update completes them */
+#define twmx_word(k) \
+   ((k)[0] +((uint32_t)(k)[1]<<8) +((uint32_t)(k)[2]<<16) +((uint32_t)(k)[3]<<24))
+
+void TWMXHash_init(twmx_state_t *state, uint32_t initval)
+{
+   state->key  = initval;
+   state->fill = 0;
+}
+
+void TWMXHash_update(twmx_state_t *state, const uint8_t *k, uint32_t len)
+{
+   uint32_t key = state->key;
+
+   if (0 != state->fill)
+   {
+      uint32_t n = 4 - state->fill;
+      if (n > len) n = len;
+      memcpy(state->tail + state->fill, k, n);
+      state->fill += n;
+      k += n; len -= n;
+      if (4 > state->fill) return;
+      key += twmx_word(state->tail);
+      mix(key);
+      state->fill = 0;
+   }
+
+   while (len >= 4)
+   {
+      key += twmx_word(k);
+      mix(key);
+      k += 4; len -= 4;
+   }
+
+   memcpy(state->tail, k, len);
+   state->fill = len;
+   state->key  = key;
+}
+
+uint32_t TWMXHash_final(twmx_state_t *state)
+{
+   uint32_t key = state->key;
+   uint8_t *k = state->tail;
+
+   switch(state->fill)      /* all the case statements fall through */
+   {
+   case 3 : key+=((uint32_t)k[2]<<16);
+   case 2 : key+=((uint32_t)k[1]<<8);
+   case 1 : key+=k[0];
+   }
+   mix(key);
+
+   return key;
+}
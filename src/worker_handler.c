@@ -0,0 +1,382 @@
+/*
+ * impd4e - a small network probe which allows to monitor and sample datagrams
+ * from the network based on hash-based packet selection.
+ *
+ * Copyright (c) 2011
+ *
+ * Fraunhofer FOKUS
+ * www.fokus.fraunhofer.de
+ *
+ * in cooperation with
+ *
+ * Technical University Berlin
+ * www.av.tu-berlin.de
+ *
+ * authors:
+ * Ramon Masek <ramon.masek@fokus.fraunhofer.de>
+ * Christian Henke <c.henke@tu-berlin.de>
+ * Carsten Schmoll <carsten.schmoll@fokus.fraunhofer.de>
+ *
+ * For questions/comments contact packettracking@fokus.fraunhofer.de
+ *
+ * This program is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software Foundation;
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// system header files
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <sys/socket.h>
+
+#ifdef __linux__
+#include <linux/if_packet.h>
+#endif
+
+// local header files
+#include "worker_handler.h"
+
+#include "ev_handler.h"
+#include "packet_handler.h"
+#include "pcap_handler.h"
+#include "tpacket_handler.h"
+#include "exporter.h"
+
+#include "settings.h"
+#include "helper.h"
+
+// Custom logger
+#include "logger.h"
+
+
+#ifdef HAVE_PACKET_FANOUT
+
+// ----------------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+
+typedef struct worker_s {
+   pthread_t        thread;
+   struct ev_loop*  loop;
+   ev_async         stop;
+   device_dev_t     device;    // own capture, hash buffer and counters
+
+   // counter values at the last merge
+   uint32_t         last_sampling_size;
+   uint64_t         last_sampling_delta_count;
+   uint64_t         last_totalpacketcount;
+   uint64_t         last_selected_total;
+   path_stats_t     last_path;
+} worker_t;
+
+struct worker_group_s {
+   uint8_t     count;
+   worker_t*   worker;
+};
+
+static struct worker_group_s* groups[MAX_INTERFACES];
+static int group_count = 0;
+
+// ----------------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+
+static void worker_stop_cb(EV_P_ ev_async *w, int revents) {
+   ev_unloop(EV_A_ EVUNLOOP_ALL);
+}
+
+/**
+ * the packet path of a worker; the epoch is odd while the worker might
+ * hold a pointer to a selection (see workers_quiesce())
+ */
+static void worker_packet_cb(EV_P_ ev_watcher *w, int revents) {
+   device_dev_t* dev = (device_dev_t*) w->data;
+
+   __atomic_add_fetch(&dev->sel_epoch, 1, __ATOMIC_SEQ_CST);
+   packet_watcher_cb(EV_A_ w, revents);
+   __atomic_add_fetch(&dev->sel_epoch, 1, __ATOMIC_RELEASE);
+}
+
+static void* worker_run(void* arg) {
+   worker_t* w = (worker_t*) arg;
+
+   LOGGER_info("worker started: %s", w->device.device_name);
+   ev_loop(w->loop, 0);
+   LOGGER_info("worker stopped: %s", w->device.device_name);
+   return NULL;
+}
+
+// ----------------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+
+static void join_fanout(device_dev_t* dev, uint16_t group_id, fanout_mode_t mode) {
+   int fanout = group_id;
+
+   switch (mode) {
+   case FANOUT_CPU:
+      fanout |= PACKET_FANOUT_CPU << 16;
+      break;
+   case FANOUT_HASH:
+   default:
+      fanout |= PACKET_FANOUT_HASH << 16;
+      break;
+   }
+
+   if (0 > setsockopt(get_file_desc(dev), SOL_PACKET, PACKET_FANOUT
+         , &fanout, sizeof(fanout))) {
+      LOGGER_fatal( "join fanout group %u failed: %s: %s"
+            , group_id, dev->device_name, strerror(errno));
+      exit(1);
+   }
+}
+
+void open_workers(device_dev_t* if_device, options_t *options) {
+   struct worker_group_s* g = NULL;
+   // the group id is system wide; make it unique per process and device
+   uint16_t group_id = (getpid() + group_count) & 0xffff;
+   int i;
+
+   g = (struct worker_group_s*) calloc(1, sizeof(struct worker_group_s));
+   g->count  = options->workers;
+   g->worker = (worker_t*) calloc(g->count, sizeof(worker_t));
+
+   for (i = 0; i < g->count; ++i) {
+      worker_t* w = &g->worker[i];
+
+      // start with a copy of the device; hash buffer and counters are
+      // owned by the worker
+      w->device = *if_device;
+      set_defaults_device(&w->device);
+      w->device.template_id = if_device->template_id;
+      w->device.selection   = if_device->selection;
+
+      switch (if_device->device_type) {
+      case TYPE_PCAP:
+         open_pcap_capture(&w->device, options);
+         break;
+      case TYPE_TPACKET:
+         open_tpacket_capture(&w->device, options);
+         break;
+      default:
+         LOGGER_fatal( "workers not supported for interface: %s", if_device->device_name);
+         exit(1);
+      }
+      join_fanout(&w->device, group_id, options->fanout_mode);
+
+      w->loop = ev_loop_new(EVFLAG_AUTO);
+      ev_watcher* watcher = event_register_io_r(w->loop, worker_packet_cb
+            , get_file_desc(&w->device));
+      watcher->data = (device_dev_t *) &w->device;
+
+      ev_async_init(&w->stop, worker_stop_cb);
+      ev_async_start(w->loop, &w->stop);
+   }
+
+   // the device itself is only used for export
+   if_device->IPv4address = g->worker[0].device.IPv4address;
+   if_device->link_type   = g->worker[0].device.link_type;
+   if_device->pkt_offset  = g->worker[0].device.pkt_offset;
+   if_device->workers     = g;
+   groups[group_count++]  = g;
+
+   LOGGER_info("%u workers in fanout group %u: %s", g->count, group_id
+         , if_device->device_name);
+}
+
+// ----------------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+
+void workers_start(EV_P) {
+   int i, k;
+
+   if (0 == group_count) {
+      return;
+   }
+
+   for (i = 0; i < group_count; ++i) {
+      for (k = 0; k < groups[i]->count; ++k) {
+         worker_t* w = &groups[i]->worker[k];
+         if (0 != pthread_create(&w->thread, NULL, worker_run, w)) {
+            LOGGER_fatal( "could not start worker: %s", strerror(errno));
+            exit(1);
+         }
+      }
+   }
+}
+
+void workers_stop() {
+   int i, k;
+
+   if (0 == group_count) {
+      return;
+   }
+
+   for (i = 0; i < group_count; ++i) {
+      for (k = 0; k < groups[i]->count; ++k) {
+         ev_async_send(groups[i]->worker[k].loop, &groups[i]->worker[k].stop);
+      }
+   }
+
+   for (i = 0; i < group_count; ++i) {
+      for (k = 0; k < groups[i]->count; ++k) {
+         pthread_join(groups[i]->worker[k].thread, NULL);
+      }
+   }
+}
+
+// ----------------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+
+// add the difference of the cost counters to the last merge
+static void path_stats_merge(path_stats_t* sum, const path_stats_t* cur
+      , path_stats_t* last) {
+   path_stats_t now = *cur;
+
+   sum->selection_packets += now.selection_packets - last->selection_packets;
+   sum->selection_cycles  += now.selection_cycles  - last->selection_cycles;
+   sum->selection_samples += now.selection_samples - last->selection_samples;
+   sum->export_packets    += now.export_packets    - last->export_packets;
+   sum->export_cycles     += now.export_cycles     - last->export_cycles;
+   sum->export_samples    += now.export_samples    - last->export_samples;
+
+   *last = now;
+}
+
+/**
+ * the counters of a worker are only written by the worker thread;
+ * the difference to the last merge is added to the device
+ */
+void workers_merge_stats(device_dev_t* if_device) {
+   struct worker_group_s* g = if_device->workers;
+   int i;
+
+   for (i = 0; i < g->count; ++i) {
+      worker_t* w = &g->worker[i];
+      uint32_t size  = w->device.sampling_size;
+      uint64_t delta = w->device.sampling_delta_count;
+      uint64_t total = w->device.totalpacketcount;
+      uint64_t sel   = w->device.selected_total;
+
+      if_device->sampling_size        += size  - w->last_sampling_size;
+      if_device->sampling_delta_count += delta - w->last_sampling_delta_count;
+      if_device->totalpacketcount     += total - w->last_totalpacketcount;
+      if_device->selected_total       += sel   - w->last_selected_total;
+
+      w->last_sampling_size        = size;
+      w->last_sampling_delta_count = delta;
+      w->last_totalpacketcount     = total;
+      w->last_selected_total       = sel;
+
+      path_stats_merge(&if_device->path, &w->device.path, &w->last_path);
+   }
+}
+
+/**
+ * the workers keep a copy of the device; the configuration that changes
+ * at runtime is copied again; the selection is the one of the device.
+ * The fields are published with release stores, the inner handler before
+ * the ip handler that calls it; on return no worker uses the old ones.
+ */
+void workers_sync(device_dev_t* if_device) {
+   struct worker_group_s* g = if_device->workers;
+   int i;
+
+   if (NULL == g) {
+      return;
+   }
+
+   for (i = 0; i < g->count; ++i) {
+      device_dev_t* dev = &g->worker[i].device;
+
+      __atomic_store_n(&dev->template_id, if_device->template_id
+            , __ATOMIC_RELEASE);
+      __atomic_store_n(&dev->ip_single_handler, if_device->ip_single_handler
+            , __ATOMIC_RELEASE);
+      __atomic_store_n(&dev->ip_inner_handler, if_device->ip_inner_handler
+            , __ATOMIC_RELEASE);
+      __atomic_store_n(&dev->ip_handler, if_device->ip_handler
+            , __ATOMIC_RELEASE);
+      __atomic_store_n(&dev->selection, if_device->selection
+            , __ATOMIC_SEQ_CST);
+   }
+   workers_quiesce(if_device);
+}
+
+/**
+ * grace period of the configuration: a worker inside the packet path (odd
+ * epoch) might still use the set or handler it loaded before the last store;
+ * wait until it left the path once. Idle workers load the current set next
+ * time. One dispatch call is short, the wait is rare (selection changes).
+ */
+void workers_quiesce(device_dev_t* if_device) {
+   struct worker_group_s* g = if_device->workers;
+   uint32_t epoch[MAX_WORKERS];
+   int i;
+
+   if (NULL == g) {
+      return;
+   }
+
+   for (i = 0; i < g->count; ++i) {
+      epoch[i] = __atomic_load_n(&g->worker[i].device.sel_epoch, __ATOMIC_SEQ_CST);
+   }
+   for (i = 0; i < g->count; ++i) {
+      while ((epoch[i] & 1) && epoch[i]
+            == __atomic_load_n(&g->worker[i].device.sel_epoch, __ATOMIC_ACQUIRE)) {
+         sched_yield();
+      }
+   }
+}
+
+void workers_ring_stats(device_dev_t* if_device, uint32_t* fill, uint64_t* drops) {
+   struct worker_group_s* g = if_device->workers;
+   int i;
+
+   *fill  = 0;
+   *drops = 0;
+   for (i = 0; i < g->count; ++i) {
+      *fill  += export_ring_fill(g->worker[i].device.ring);
+      *drops += g->worker[i].device.ring->drops;
+   }
+}
+
+int workers_capture_stats(device_dev_t* if_device, struct pcap_stat* ps) {
+   struct worker_group_s* g = if_device->workers;
+   struct pcap_stat s;
+   int i;
+
+   memset(ps, 0, sizeof(*ps));
+   for (i = 0; i < g->count; ++i) {
+      device_dev_t* dev = &g->worker[i].device;
+      memset(&s, 0, sizeof(s));
+
+      if (TYPE_TPACKET == dev->device_type) {
+         if (0 > tpacket_stats(dev, &s)) {
+            return -1;
+         }
+      }
+      else if (0 > pcap_stats(dev->device_handle.pcap, &s)) {
+         LOGGER_error("Error DeviceNo   %s: %s", dev->device_name,
+               pcap_geterr(dev->device_handle.pcap));
+         return -1;
+      }
+      ps->ps_recv += s.ps_recv;
+      ps->ps_drop += s.ps_drop;
+   }
+   return 0;
+}
+
+#endif // HAVE_PACKET_FANOUT
+
@@ -0,0 +1,314 @@
+/*
+ * impd4e - a small network probe which allows to monitor and sample datagrams
+ * from the network based on hash-based packet selection.
+ *
+ * Copyright (c) 2011
+ *
+ * Fraunhofer FOKUS
+ * www.fokus.fraunhofer.de
+ *
+ * in cooperation with
+ *
+ * Technical University Berlin
+ * www.av.tu-berlin.de
+ *
+ * authors:
+ * Ramon Masek <ramon.masek@fokus.fraunhofer.de>
+ * Christian Henke <c.henke@tu-berlin.de>
+ * Carsten Schmoll <carsten.schmoll@fokus.fraunhofer.de>
+ *
+ * For questions/comments contact packettracking@fokus.fraunhofer.de
+ *
+ * This program is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software Foundation;
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * collector restart test of the encoder and the spool
+ *
+ * A tcp collector on the loopback gets packet id records, then it is
+ * killed (the connection is reset) and restarted on the same port. The
+ * messages of the outage have to go to the spool, and the new connection
+ * has to start with the template sets, followed by all spooled messages
+ * in order.
+ *
+ * The test drives the encoder like the exporter thread does, without
+ * libipfix; ipfix() and get_template() are provided here.
+ *
+ * usage: impd4e_check
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "logger.h"
+#include "constants.h"
+#include "settings.h"
+#include "ipfix_handler.h"
+#include "ipfix_encoder.h"
+#include "spool.h"
+
+#define RECORDS     200  // records per phase
+#define WAIT_TIME   (COLLECTOR_RETRY_TIME + 5) // seconds
+
+#define CHECK(cond) \
+   do { if( !(cond) ) { \
+      fprintf( stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond ); \
+      exit(1); } } while(0)
+
+// -----------------------------------------------------------------------------
+// what the probe provides otherwise
+// -----------------------------------------------------------------------------
+
+static ipfix_t           handle;
+static ipfix_template_t  templates[TEMPLATE_COUNT];
+
+ipfix_t* ipfix() {
+   return &handle;
+}
+
+ipfix_template_t* get_template( int template_id ) {
+   return &templates[template_id];
+}
+
+static export_fields_t fields_ts[] = {
+   { 0, 323, 8 }, // observationTimeMicroseconds
+   { 0, 326, 4 }, // digestHashValue
+};
+
+// -----------------------------------------------------------------------------
+// collector
+// -----------------------------------------------------------------------------
+
+static int collector_listen( uint16_t* port ) {
+   struct sockaddr_in sa;
+   socklen_t len = sizeof(sa);
+   int one = 1;
+   int fd = socket( AF_INET, SOCK_STREAM, 0 );
+
+   CHECK( 0 <= fd );
+   setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one) );
+   memset( &sa, 0, sizeof(sa) );
+   sa.sin_family      = AF_INET;
+   sa.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+   sa.sin_port        = htons( *port );
+   CHECK( 0 == bind( fd, (struct sockaddr*) &sa, sizeof(sa) ) );
+   CHECK( 0 == listen( fd, 1 ) );
+   CHECK( 0 == getsockname( fd, (struct sockaddr*) &sa, &len ) );
+   *port = ntohs( sa.sin_port );
+   return fd;
+}
+
+// kill the collector: reset the connection, nothing is read any more
+static void collector_kill( int conn, int listen_fd ) {
+   struct linger l = { 1, 0 };
+
+   setsockopt( conn, SOL_SOCKET, SO_LINGER, &l, sizeof(l) );
+   close( conn );
+   close( listen_fd );
+}
+
+static uint16_t get_u16( const uint8_t* p ) {
+   return (p[0] << 8) | p[1];
+}
+
+static uint32_t get_u32( const uint8_t* p ) {
+   return ((uint32_t) get_u16( p ) << 16) | get_u16( p + 2 );
+}
+
+/**
+ * read the messages of the connection until nothing comes for a while;
+ * counts the template and the data messages and checks the order
+ */
+typedef struct stream {
+   uint8_t  buf[1<<20];
+   uint32_t len;
+   int      templates;   // template messages
+   int      data;        // data messages
+   int      data_first;  // a data message came before the template sets
+   uint32_t last_seqno;
+   int      seqno_back;  // sequence number decreased
+} stream_t;
+
+// one round of the exporter thread; there is no other thread to lock out
+static void pump( int rounds ) {
+   int i;
+
+   for( i = 0; i < rounds; ++i ) {
+      ipfix_encoder_take();
+      ipfix_encoder_send();
+      ipfix_encoder_replay( 1 << 30 );
+   }
+}
+
+static void collector_read( int conn, stream_t* s ) {
+   struct pollfd pfd = { conn, POLLIN, 0 };
+   ssize_t n;
+
+   for( ;; ) {
+      pump( 1 );
+      if( 0 >= poll( &pfd, 1, 200 ) ) {
+         break;
+      }
+      n = recv( conn, s->buf + s->len, sizeof(s->buf) - s->len, 0 );
+      if( 0 >= n ) {
+         break;
+      }
+      s->len += n;
+   }
+
+   while( IPFIX_HEADER_SIZE <= s->len && get_u16( s->buf + 2 ) <= s->len ) {
+      uint16_t len = get_u16( s->buf + 2 );
+      uint16_t set = get_u16( s->buf + IPFIX_HEADER_SIZE );
+
+      CHECK( 10 == get_u16( s->buf ) );
+      if( IPFIX_SETID_TEMPLATE == set ) {
+         s->templates++;
+      }
+      else {
+         uint32_t seqno = get_u32( s->buf + 8 );
+         if( 0 == s->templates ) {
+            s->data_first = 1;
+         }
+         if( 0 < s->data && seqno < s->last_seqno ) {
+            s->seqno_back = 1;
+         }
+         s->last_seqno = seqno;
+         s->data++;
+      }
+      memmove( s->buf, s->buf + len, s->len - len );
+      s->len -= len;
+   }
+}
+
+static int collector_accept( int listen_fd ) {
+   struct pollfd pfd = { listen_fd, POLLIN, 0 };
+   time_t end = time(NULL) + WAIT_TIME;
+
+   // the encoder connects by itself, at the latest after the retry time
+   while( time(NULL) < end ) {
+      pump( 1 );
+      if( 0 < poll( &pfd, 1, 100 ) ) {
+         return accept( listen_fd, NULL, NULL );
+      }
+   }
+   return -1;
+}
+
+// -----------------------------------------------------------------------------
+
+static void encode( int n ) {
+   static uint32_t id = 0;
+   pktid_record_t r;
+   int i;
+
+   memset( &r, 0, sizeof(r) );
+   for( i = 0; i < n; ++i ) {
+      r.timestamp = 1000 + id;
+      r.hash_id   = id++;
+      CHECK( 0 == ipfix_encode_record( TS_ID, &r ) );
+      // one message per 10 records
+      if( 9 == i % 10 ) {
+         ipfix_encoder_flush();
+      }
+   }
+   ipfix_encoder_flush();
+}
+
+int main( int argc, char** argv ) {
+   static options_t options;
+   static stream_t before, after;
+   char spool_path[] = "/tmp/impd4e_check_XXXXXX";
+   collector_stats_t cs;
+   const char* host;
+   int port_i, listen_fd, conn, i;
+   uint16_t port = 0;
+
+   logger_init( LOGGER_LEVEL_WARN );
+
+   for( i = 0; i < TEMPLATE_COUNT; ++i ) {
+      templates[i].tid = 256 + i;
+   }
+   handle.sourceid = 1;
+
+   listen_fd = collector_listen( &port );
+
+   CHECK( 0 <= mkstemp( spool_path ) );
+   CHECK( 0 == spool_open( spool_path, 1024 * 1024 ) );
+
+   strcpy( options.collectors[0].host, "127.0.0.1" );
+   options.collectors[0].port = port;
+   options.number_collectors  = 1;
+   options.collectorProto     = IPFIX_PROTO_TCP;
+   options.distribution       = DISTRIBUTE_ALL;
+
+   ipfix_encoder_add_template( TS_ID, fields_ts, 2 );
+   ipfix_encoder_init();
+   ipfix_encoder_set_collectors( &options );
+   ipfix_encoder_set_message_size( IPFIX_MESSAGE_SIZE );
+
+   // collector up
+   encode( RECORDS );
+   conn = collector_accept( listen_fd );
+   CHECK( 0 <= conn );
+   collector_read( conn, &before );
+   CHECK( 1 <= before.templates );
+   CHECK( !before.data_first );
+
+   // collector killed; the messages go to the spool
+   collector_kill( conn, listen_fd );
+   for( i = 0; i < 100 && 0 == spool_pending(); ++i ) {
+      encode( RECORDS );
+      pump( 1 );
+      usleep( 10000 );
+   }
+   CHECK( 0 < spool_pending() );
+   encode( RECORDS );
+   pump( 1 );
+   ipfix_encoder_take();
+   CHECK( 0 == ipfix_encoder_collector_stats( 0, &host, &port_i, &cs ) );
+   CHECK( 0 < cs.spooled );
+
+   // collector restarted on the same port; templates first, then the spool
+   listen_fd = collector_listen( &port );
+   conn = collector_accept( listen_fd );
+   CHECK( 0 <= conn );
+   collector_read( conn, &after );
+   ipfix_encoder_take();
+   CHECK( 0 == ipfix_encoder_collector_stats( 0, &host, &port_i, &cs ) );
+   printf( "before: %d template, %d data messages; spooled %llu, replayed %llu"
+           ", after: %d template, %d data messages\n"
+         , before.templates, before.data
+         , (unsigned long long) cs.spooled, (unsigned long long) cs.replayed
+         , after.templates, after.data );
+   CHECK( 0 == spool_pending() );
+   CHECK( cs.spooled == cs.replayed );
+   CHECK( 1 <= after.templates );
+   CHECK( !after.data_first );
+   CHECK( cs.replayed == after.data );
+   CHECK( !after.seqno_back );
+
+   close( conn );
+   close( listen_fd );
+   spool_close();
+   unlink( spool_path );
+   printf( "collector restart: ok\n" );
+   return 0;
+}